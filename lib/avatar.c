@@ -19,14 +19,46 @@
 
 #include "config.h"
 
+#include <glib/gstdio.h>
+
+#include <string.h>
+
 #include "osso-abook-contact.h"
+#include "osso-abook-debug.h"
 #include "osso-abook-log.h"
+#include "osso-abook-util.h"
 #include "osso-abook-utils-private.h"
 
 #include "avatar.h"
 
 #define MAX_AVATAR_SIZE 512000
 
+/* pre-rendered avatars are stored as raw pixels that can be mmapped */
+#define THUMBNAIL_MAGIC "OABT"
+#define THUMBNAIL_VERSION 1
+#define THUMBNAIL_HEADER_SIZE 128
+/* about 2000 thumbnails at 64x64, or 400 at 144x144 */
+#define MAX_THUMBNAILS_SIZE (32 * 1024 * 1024)
+
+union thumbnail_header
+{
+  struct
+  {
+    char magic[4];
+    guint32 version;
+    guint32 width;
+    guint32 height;
+    guint32 rowstride;
+    guint32 has_alpha;
+    char checksum[65];
+  } h;
+  char pad[THUMBNAIL_HEADER_SIZE];
+};
+
+G_STATIC_ASSERT(sizeof(union thumbnail_header) == THUMBNAIL_HEADER_SIZE);
+
+static gint64 thumbnails_size = -1;
+
 struct _avatar_data
 {
   char *data;
@@ -192,3 +224,262 @@ _osso_abook_avatar_data_new()
 {
   return g_slice_new0(avatar_data);
 }
+
+static const char *
+thumbnails_dir(void)
+{
+  static gchar *dir = NULL;
+
+  if (!dir)
+    dir = g_build_filename(osso_abook_get_work_dir(), "thumbnails", NULL);
+
+  return dir;
+}
+
+static gchar *
+thumbnail_path(const char *uid, const char *cache_name)
+{
+  gchar *key = g_strconcat(uid, "\n", cache_name, NULL);
+  gchar *name = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+  gchar *path = g_build_filename(thumbnails_dir(), name, NULL);
+
+  g_free(name);
+  g_free(key);
+
+  return path;
+}
+
+static gsize
+thumbnail_pixels_size(guint width, guint height, guint rowstride,
+                      gboolean has_alpha)
+{
+  /* gdk-pixbuf does not pad the last row */
+  return (gsize)(height - 1) * rowstride + width * (has_alpha ? 4 : 3);
+}
+
+/* the header comes from disk, so don't let its sizes overflow */
+static gboolean
+thumbnail_header_valid(const union thumbnail_header *header, gsize len)
+{
+  guint n_channels;
+  gsize row_size;
+  gsize pixels_size;
+
+  if ((len < sizeof(*header)) ||
+      memcmp(header->h.magic, THUMBNAIL_MAGIC, sizeof(header->h.magic)) ||
+      (header->h.version != THUMBNAIL_VERSION) ||
+      !header->h.width || !header->h.height)
+  {
+    return FALSE;
+  }
+
+  n_channels = header->h.has_alpha ? 4 : 3;
+
+  if (header->h.width > G_MAXUINT32 / n_channels)
+    return FALSE;
+
+  row_size = (gsize)header->h.width * n_channels;
+  pixels_size = len - sizeof(*header);
+
+  if ((header->h.rowstride < row_size) || (pixels_size < row_size))
+    return FALSE;
+
+  return header->h.height - 1 <=
+         (pixels_size - row_size) / header->h.rowstride;
+}
+
+static void
+thumbnail_unmap(guchar *pixels, gpointer data)
+{
+  g_mapped_file_unref(data);
+}
+
+__attribute__ ((visibility("hidden"))) GdkPixbuf *
+_osso_abook_avatar_thumbnail_load(const char *uid, const char *checksum,
+                                  const char *cache_name)
+{
+  const union thumbnail_header *header;
+  GdkPixbuf *pixbuf = NULL;
+  GMappedFile *mapped;
+  gchar *path;
+  gsize len;
+
+  g_return_val_if_fail(uid != NULL, NULL);
+  g_return_val_if_fail(checksum != NULL, NULL);
+  g_return_val_if_fail(cache_name != NULL, NULL);
+
+  path = thumbnail_path(uid, cache_name);
+
+  /* private mapping, so consumers can't modify the file through the pixbuf */
+  mapped = g_mapped_file_new(path, TRUE, NULL);
+
+  if (!mapped)
+    goto out;
+
+  header = (const union thumbnail_header *)g_mapped_file_get_contents(mapped);
+  len = g_mapped_file_get_length(mapped);
+
+  if (!thumbnail_header_valid(header, len) ||
+      strncmp(header->h.checksum, checksum, sizeof(header->h.checksum)))
+  {
+    /* stale, the photo changed since the thumbnail was rendered */
+    OSSO_ABOOK_NOTE(AVATAR, "dropping stale thumbnail %s", path);
+    g_mapped_file_unref(mapped);
+    g_unlink(path);
+    goto out;
+  }
+
+  pixbuf = gdk_pixbuf_new_from_data(
+      (guchar *)g_mapped_file_get_contents(mapped) + sizeof(*header),
+      GDK_COLORSPACE_RGB, header->h.has_alpha, 8, header->h.width,
+      header->h.height, header->h.rowstride, thumbnail_unmap, mapped);
+
+  /* mtime is used for LRU pruning */
+  g_utime(path, NULL);
+
+out:
+  g_free(path);
+
+  return pixbuf;
+}
+
+struct thumbnail_file
+{
+  gchar *path;
+  time_t mtime;
+  goffset size;
+};
+
+static int
+compare_thumbnail_files(gconstpointer a, gconstpointer b)
+{
+  const struct thumbnail_file *file_a = a;
+  const struct thumbnail_file *file_b = b;
+
+  if (file_a->mtime < file_b->mtime)
+    return -1;
+
+  return file_a->mtime > file_b->mtime;
+}
+
+/* removes least recently used thumbnails until below limit, returns the size
+ * of the thumbnails left */
+static gint64
+thumbnails_prune(gint64 limit)
+{
+  GArray *files = g_array_new(FALSE, FALSE, sizeof(struct thumbnail_file));
+  GDir *dir = g_dir_open(thumbnails_dir(), 0, NULL);
+  gint64 total = 0;
+  const gchar *name;
+  guint i;
+
+  if (!dir)
+    return 0;
+
+  while ((name = g_dir_read_name(dir)))
+  {
+    struct thumbnail_file file;
+    struct stat st;
+
+    file.path = g_build_filename(thumbnails_dir(), name, NULL);
+
+    if (g_stat(file.path, &st) || !S_ISREG(st.st_mode))
+    {
+      g_free(file.path);
+      continue;
+    }
+
+    file.mtime = st.st_mtime;
+    file.size = st.st_size;
+    total += file.size;
+    g_array_append_val(files, file);
+  }
+
+  g_dir_close(dir);
+  g_array_sort(files, compare_thumbnail_files);
+
+  for (i = 0; i < files->len; i++)
+  {
+    struct thumbnail_file *file =
+      &g_array_index(files, struct thumbnail_file, i);
+
+    if ((total > limit) && !g_unlink(file->path))
+      total -= file->size;
+
+    g_free(file->path);
+  }
+
+  g_array_free(files, TRUE);
+
+  return total;
+}
+
+__attribute__ ((visibility("hidden"))) void
+_osso_abook_avatar_thumbnail_save(const char *uid, const char *checksum,
+                                  const char *cache_name, GdkPixbuf *pixbuf)
+{
+  union thumbnail_header header;
+  gboolean has_alpha;
+  gsize pixels_size;
+  gchar *contents;
+  gchar *path;
+  GError *error = NULL;
+
+  g_return_if_fail(uid != NULL);
+  g_return_if_fail(checksum != NULL);
+  g_return_if_fail(cache_name != NULL);
+  g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+
+  has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+
+  if ((gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB) ||
+      (gdk_pixbuf_get_bits_per_sample(pixbuf) != 8) ||
+      (gdk_pixbuf_get_n_channels(pixbuf) != (has_alpha ? 4 : 3)) ||
+      (strlen(checksum) >= sizeof(header.h.checksum)))
+  {
+    return;
+  }
+
+  if (g_mkdir_with_parents(thumbnails_dir(), 0700))
+    return;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.h.magic, THUMBNAIL_MAGIC, sizeof(header.h.magic));
+  header.h.version = THUMBNAIL_VERSION;
+  header.h.width = gdk_pixbuf_get_width(pixbuf);
+  header.h.height = gdk_pixbuf_get_height(pixbuf);
+  header.h.rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  header.h.has_alpha = has_alpha;
+  strcpy(header.h.checksum, checksum);
+
+  pixels_size = thumbnail_pixels_size(header.h.width, header.h.height,
+                                      header.h.rowstride, has_alpha);
+  contents = g_malloc(sizeof(header) + pixels_size);
+  memcpy(contents, &header, sizeof(header));
+  memcpy(contents + sizeof(header), gdk_pixbuf_get_pixels(pixbuf),
+         pixels_size);
+
+  path = thumbnail_path(uid, cache_name);
+
+  if (g_file_set_contents(path, contents, sizeof(header) + pixels_size,
+                          &error))
+  {
+    if (thumbnails_size < 0)
+      thumbnails_size = thumbnails_prune(MAX_THUMBNAILS_SIZE);
+    else
+      thumbnails_size += sizeof(header) + pixels_size;
+
+    /* prune below the limit, so we don't have to rescan on every save */
+    if (thumbnails_size > MAX_THUMBNAILS_SIZE)
+      thumbnails_size = thumbnails_prune(MAX_THUMBNAILS_SIZE * 3 / 4);
+  }
+  else
+  {
+    OSSO_ABOOK_NOTE(AVATAR, "cannot save thumbnail %s: %s", path,
+                    error->message);
+    g_clear_error(&error);
+  }
+
+  g_free(path);
+  g_free(contents);
+}
@@ -41,4 +41,12 @@ _osso_abook_avatar_data_free(avatar_data *avatar);
 avatar_data *
 _osso_abook_avatar_data_new();
 
+GdkPixbuf *
+_osso_abook_avatar_thumbnail_load(const char *uid, const char *checksum,
+                                  const char *cache_name);
+
+void
+_osso_abook_avatar_thumbnail_save(const char *uid, const char *checksum,
+                                  const char *cache_name, GdkPixbuf *pixbuf);
+
 #endif // AVATAR_H
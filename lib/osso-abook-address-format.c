@@ -21,244 +21,491 @@
 
 #include <glib.h>
 
+#include <string.h>
+
 #include "osso-abook-address-format.h"
 #include "osso-abook-log.h"
+#include "osso-abook-utils-private.h"
 
 #define FALLBACK_FORMAT ", [%E|%S|PB %B| [%P|%L]|%R|%C]"
 #define FORMAT_FILE "/usr/share/libosso-abook/address_formats"
 
-static char *format = NULL;
+/* maximum nesting of [] groups */
+#define MAX_DEPTH 8
 
 /*
- * fmg - does more or less the same what original code was doing, LMK if it
- * misbehaves
+ * Formats look like "sep[item|item|...]". An item is a mix of literal text,
+ * %X field references and nested "sep[...]" groups. Items whose fields are
+ * all empty are left out, the others are joined with the separator.
+ *
+ * Formats are compiled once to a flat program, formatting an address is then
+ * a single pass over it.
  */
-static gchar *
-format_address(OssoABookAddress *address, const char *fmt)
+typedef enum
 {
-  const char *start;
-  const char *end;
-  const char *last_sep = NULL;
-  gchar *sep;
-  GString *formatted_address;
-  int bracket_count = 1;
+  OP_GROUP,      /* separator in offset/len */
+  OP_ITEM,
+  OP_LITERAL,    /* text in offset/len */
+  OP_FIELD,      /* field index in offset */
+  OP_END_ITEM,
+  OP_END_GROUP
+} address_op_code;
+
+typedef struct
+{
+  address_op_code code;
+  guint offset;
+  guint len;
+} address_op;
+
+enum
+{
+  FIELD_P_O_BOX,
+  FIELD_EXTENSION,
+  FIELD_STREET,
+  FIELD_CITY,
+  FIELD_REGION,
+  FIELD_POSTAL,
+  FIELD_COUNTRY,
+  FIELD_COUNT
+};
+
+typedef struct
+{
+  gchar *format;
+  address_op *ops;
+  guint n_ops;
+  /* length of all literals and separators */
+  gsize static_len;
+  /* number of references to each field */
+  guint field_refs[FIELD_COUNT];
+} address_program;
+
+/* preferred language name -> address_program */
+static GHashTable *programs = NULL;
+static GKeyFile *format_file = NULL;
+static address_program *fallback_program = NULL;
+
+static int
+field_from_char(char c)
+{
+  switch (c)
+  {
+    case 'B':
+      return FIELD_P_O_BOX;
+    case 'E':
+      return FIELD_EXTENSION;
+    case 'S':
+      return FIELD_STREET;
+    case 'L':
+      return FIELD_CITY;
+    case 'R':
+      return FIELD_REGION;
+    case 'P':
+      return FIELD_POSTAL;
+    case 'C':
+      return FIELD_COUNTRY;
+  }
+
+  return -1;
+}
+
+static void
+emit(GArray *ops, address_op_code code, guint offset, guint len)
+{
+  address_op op = { code, offset, len };
+
+  g_array_append_val(ops, op);
+}
+
+static void
+emit_literal(address_program *program, GArray *ops, const char *start,
+             const char *end)
+{
+  if (end > start)
+  {
+    emit(ops, OP_LITERAL, start - program->format, end - start);
+    program->static_len += end - start;
+  }
+}
+
+/* *p points after the opening [, on success it points after the closing ] */
+static gboolean
+compile_group(address_program *program, GArray *ops, const char **p,
+              const char *sep, guint sep_len, int depth)
+{
+  const char *literal;
+
+  if (depth > MAX_DEPTH)
+  {
+    g_warning("Groups nested too deep in: '%s'", program->format);
+    return FALSE;
+  }
+
+  emit(ops, OP_GROUP, sep - program->format, sep_len);
+  emit(ops, OP_ITEM, 0, 0);
+  program->static_len += sep_len;
+  literal = *p;
+
+  while (TRUE)
+  {
+    switch (**p)
+    {
+      case '\0':
+      {
+        g_warning("Group did not end with ] in: '%s'", program->format);
+        return FALSE;
+      }
+      case '%':
+      {
+        int field = field_from_char((*p)[1]);
+
+        if (field < 0)
+        {
+          g_warning("Unsupported format '%c'",
+                    g_utf8_get_char(g_utf8_next_char(*p)));
+          return FALSE;
+        }
+
+        emit_literal(program, ops, literal, *p);
+        emit(ops, OP_FIELD, field, 0);
+        program->field_refs[field]++;
+        *p += 2;
+        literal = *p;
+        break;
+      }
+      case '[':
+      {
+        /* the text in front of a nested group is its separator */
+        const char *nested_sep = literal;
+        guint nested_sep_len = *p - literal;
+
+        (*p)++;
+
+        if (!compile_group(program, ops, p, nested_sep, nested_sep_len,
+                           depth + 1))
+        {
+          return FALSE;
+        }
+
+        literal = *p;
+        break;
+      }
+      case '|':
+      {
+        emit_literal(program, ops, literal, *p);
+        emit(ops, OP_END_ITEM, 0, 0);
+        emit(ops, OP_ITEM, 0, 0);
+        program->static_len += sep_len;
+        (*p)++;
+        literal = *p;
+        break;
+      }
+      case ']':
+      {
+        emit_literal(program, ops, literal, *p);
+        emit(ops, OP_END_ITEM, 0, 0);
+        emit(ops, OP_END_GROUP, 0, 0);
+        (*p)++;
+        return TRUE;
+      }
+      default:
+        (*p)++;
+    }
+  }
+}
+
+static void
+address_program_free(address_program *program)
+{
+  if (program)
+  {
+    g_free(program->format);
+    g_free(program->ops);
+    g_slice_free(address_program, program);
+  }
+}
+
+static address_program *
+address_program_compile(const char *fmt)
+{
+  address_program *program;
+  const char *p;
+  GArray *ops;
 
-  g_return_val_if_fail(address, NULL);
   g_return_val_if_fail(fmt, NULL);
 
-  start = strchr(fmt, '[');
+  p = strchr(fmt, '[');
 
-  if (!start)
+  if (!p)
   {
     g_warning("Group did not start with [ in: '%s'", fmt);
     return NULL;
   }
 
-  if (start[strlen(start) - 1] != ']')
+  program = g_slice_new0(address_program);
+  program->format = g_strdup(fmt);
+  ops = g_array_new(FALSE, FALSE, sizeof(address_op));
+  p = program->format + (p - fmt);
+  p++;
+
+  if (!compile_group(program, ops, &p, program->format, p - 1 - program->format,
+                     0))
   {
-    g_warning("Group did not end with ] in: '%s'", fmt);
+    g_array_free(ops, TRUE);
+    address_program_free(program);
     return NULL;
   }
 
-  sep = g_strndup(fmt, start - fmt);
-  formatted_address = g_string_new("");
-  start++;
-  end = start;
-
-  do
+  if (*p)
   {
-    gchar *token = NULL;
+    g_warning("Trailing characters after ] in: '%s'", fmt);
+    g_array_free(ops, TRUE);
+    address_program_free(program);
+    return NULL;
+  }
 
-    while (*end)
-    {
-      char c = *end;
+  program->n_ops = ops->len;
+  program->ops = (address_op *)g_array_free(ops, FALSE);
 
-      if ((c == '[') || (c == ']') || (c == '|') || (c == '%'))
-        break;
+  return program;
+}
 
-      end++;
-    }
+struct group_state
+{
+  guint sep_offset;
+  guint sep_len;
+  gboolean empty;
+  /* position to truncate to if the current item turns out to be empty */
+  gsize item_start;
+  gsize item_data_start;
+  gboolean item_has_fields;
+  gboolean item_has_data;
+};
 
-    if (end - start && (*end != '['))
-    {
-      token = g_strndup(start, end - start);
+static gchar *
+address_program_run(const address_program *program, OssoABookAddress *address)
+{
+  const char *fields[FIELD_COUNT];
+  gsize field_lens[FIELD_COUNT];
+  struct group_state stack[MAX_DEPTH + 2];
+  struct group_state *group = stack;
+  gsize max_len = program->static_len;
+  gsize len = 0;
+  gchar *buf;
+  guint i;
+
+  fields[FIELD_P_O_BOX] = address->p_o_box;
+  fields[FIELD_EXTENSION] = address->extension;
+  fields[FIELD_STREET] = address->street;
+  fields[FIELD_CITY] = address->city;
+  fields[FIELD_REGION] = address->region;
+  fields[FIELD_POSTAL] = address->postal;
+  fields[FIELD_COUNTRY] = address->country;
+
+  for (i = 0; i < FIELD_COUNT; i++)
+  {
+    field_lens[i] = fields[i] ? strlen(fields[i]) : 0;
+    max_len += field_lens[i] * program->field_refs[i];
+  }
 
-      g_string_append(formatted_address, token);
-      g_free(token);
-      token = NULL;
-    }
-    else
-    {
-      switch (*end)
-      {
-        case '[':
-        {
-          end = strchr(end, ']');
+  buf = g_malloc(max_len + 1);
 
-          if (end)
-          {
-            gchar *group;
+  /* the outermost group lives in an item of its own */
+  group->item_has_fields = FALSE;
+  group->item_has_data = FALSE;
 
-            if (last_sep)
-            {
-              group = g_strndup(last_sep + 1, end - last_sep);
-              last_sep = NULL;
-            }
-            else
-              group = g_strndup(start, end - start + 1);
+  for (i = 0; i < program->n_ops; i++)
+  {
+    const address_op *op = &program->ops[i];
 
-            token = format_address(address, group);
-            g_free(group);
-          }
+    switch (op->code)
+    {
+      case OP_GROUP:
+      {
+        group++;
+        group->empty = TRUE;
+        group->sep_offset = op->offset;
+        group->sep_len = op->len;
+        break;
+      }
+      case OP_ITEM:
+      {
+        group->item_start = len;
+        group->item_has_fields = FALSE;
+        group->item_has_data = FALSE;
 
-          break;
-        }
-        case ']':
+        if (!group->empty)
         {
-          token = g_strndup(start, end - start);
-          bracket_count--;
-
-          break;
+          memcpy(buf + len, program->format + group->sep_offset,
+                 group->sep_len);
+          len += group->sep_len;
         }
-        case '|':
+
+        group->item_data_start = len;
+        break;
+      }
+      case OP_LITERAL:
+      {
+        memcpy(buf + len, program->format + op->offset, op->len);
+        len += op->len;
+        break;
+      }
+      case OP_FIELD:
+      {
+        group->item_has_fields = TRUE;
+
+        if (field_lens[op->offset])
         {
-          token = g_strdup(sep);
-          last_sep = end;
-          break;
+          memcpy(buf + len, fields[op->offset], field_lens[op->offset]);
+          len += field_lens[op->offset];
+          group->item_has_data = TRUE;
         }
-        case '%':
+
+        break;
+      }
+      case OP_END_ITEM:
+      {
+        if (group->item_has_data ||
+            (!group->item_has_fields && (len > group->item_data_start)))
         {
-          char *data = "";
-
-          switch (*(end + 1))
-          {
-            case 'B':
-            {
-              data = address->p_o_box;
-              break;
-            }
-            case 'C':
-            {
-              data = address->country;
-              break;
-            }
-            case 'E':
-            {
-              data = address->extension;
-              break;
-            }
-            case 'L':
-            {
-              data = address->city;
-              break;
-            }
-            case 'P':
-            {
-              data = address->postal;
-              break;
-            }
-            case 'R':
-            {
-              data = address->region;
-              break;
-            }
-            case 'S':
-            {
-              data = address->street;
-              break;
-            }
-            default:
-            {
-              g_warning("Unsupported format '%c'",
-                        g_utf8_get_char(g_utf8_next_char(end)));
-            }
-          }
-
-          token = g_strdup_printf("%s", data);
-          end++;
-          last_sep = end;
+          group->empty = FALSE;
         }
+        else
+          len = group->item_start;
+
+        break;
       }
+      case OP_END_GROUP:
+      {
+        gboolean empty = group->empty;
 
-      end++;
-    }
+        group--;
+        group->item_has_fields = TRUE;
 
-    if (token)
-    {
-      g_string_append(formatted_address, token);
-      g_free(token);
-      token = NULL;
-    }
+        if (!empty)
+          group->item_has_data = TRUE;
 
-    start = end;
+        break;
+      }
+    }
   }
-  while (*start);
-
-  g_free(sep);
-
-  if (bracket_count < 0)
-    g_warning("unmatched ]");
 
-  if (formatted_address->len)
-    return g_string_free(formatted_address, FALSE);
+  if (!len)
+  {
+    g_free(buf);
+    return NULL;
+  }
 
-  g_string_free(formatted_address, TRUE);
+  buf[len] = 0;
 
-  return NULL;
+  return buf;
 }
 
-char *
-osso_abook_address_format(OssoABookAddress *address)
+static address_program *
+load_program(void)
 {
-  char *formated_address;
-  gchar *tmp_format = NULL;
+  address_program *program = NULL;
+  gchar *fmt = NULL;
 
-  if (!format)
+  if (!format_file)
   {
     GError *error = NULL;
-    GKeyFile *key_file = g_key_file_new();
 
-    if (g_key_file_load_from_file(
-          key_file, FORMAT_FILE, G_KEY_FILE_NONE, &error))
-    {
-      tmp_format = g_key_file_get_locale_string(key_file, "Address Formats",
-                                                "format", NULL, &error);
-
-      if (error)
-        OSSO_ABOOK_WARN("Could not get address format: %s", error->message);
+    format_file = g_key_file_new();
 
-      g_clear_error(&error);
-    }
-    else
+    if (!g_key_file_load_from_file(format_file, FORMAT_FILE, G_KEY_FILE_NONE,
+                                   &error))
     {
       OSSO_ABOOK_WARN("Could not open address format file '%s': %s",
                       FORMAT_FILE, error ? error->message : "Unknown error");
       g_clear_error(&error);
     }
+  }
 
-    g_key_file_free(key_file);
+  if (g_key_file_has_group(format_file, "Address Formats"))
+  {
+    GError *error = NULL;
 
-    if (g_utf8_validate(tmp_format, -1, NULL))
-    {
-      if (!tmp_format)
-        tmp_format = FALLBACK_FORMAT;
-    }
-    else
-    {
-      g_free(tmp_format);
-      tmp_format = FALLBACK_FORMAT;
-    }
+    fmt = g_key_file_get_locale_string(format_file, "Address Formats",
+                                       "format", NULL, &error);
+
+    if (error)
+      OSSO_ABOOK_WARN("Could not get address format: %s", error->message);
+
+    g_clear_error(&error);
+  }
+
+  if (fmt && g_utf8_validate(fmt, -1, NULL))
+    program = address_program_compile(fmt);
+
+  g_free(fmt);
+
+  return program;
+}
+
+static const address_program *
+get_program()
+{
+  /* the same list g_key_file_get_locale_string() picks the format with */
+  const char *locale = g_get_language_names()[0];
+  address_program *program;
+
+  if (!programs)
+  {
+    programs = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify)address_program_free);
+  }
+
+  if (!g_hash_table_lookup_extended(programs, locale, NULL,
+                                    (gpointer *)&program))
+  {
+    program = load_program();
+    g_hash_table_insert(programs, g_strdup(locale), program);
+  }
+
+  if (!program)
+  {
+    if (!fallback_program)
+      fallback_program = address_program_compile(FALLBACK_FORMAT);
 
-    format = tmp_format;
+    program = fallback_program;
   }
 
-  formated_address = format_address(address, format);
+  return program;
+}
+
+char *
+osso_abook_address_format(OssoABookAddress *address)
+{
+  g_return_val_if_fail(address, NULL);
+
+  return address_program_run(get_program(), address);
+}
+
+char *
+_osso_abook_address_format_with_format(OssoABookAddress *address,
+                                       const char *fmt)
+{
+  static GHashTable *compiled = NULL;
+  address_program *program;
+
+  g_return_val_if_fail(address, NULL);
+  g_return_val_if_fail(fmt, NULL);
+
+  if (!compiled)
+  {
+    compiled = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify)address_program_free);
+  }
 
-  if (!formated_address)
+  if (!g_hash_table_lookup_extended(compiled, fmt, NULL, (gpointer *)&program))
   {
-    format = FALLBACK_FORMAT;
-    formated_address = format_address(address, FALLBACK_FORMAT);
+    program = address_program_compile(fmt);
+    g_hash_table_insert(compiled, g_strdup(fmt), program);
   }
 
-  return formated_address;
+  return program ? address_program_run(program, address) : NULL;
 }
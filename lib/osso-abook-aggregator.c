@@ -42,6 +42,52 @@ enum
   LAST_SIGNAL
 };
 
+typedef enum
+{
+  INDEX_PHONE,
+  INDEX_EMAIL,
+  INDEX_SIP,
+  INDEX_IM,
+  INDEX_COUNT
+} ContactIndexType;
+
+struct contact_index
+{
+  /* key -> GHashTable (master and roster contacts) */
+  GHashTable *buckets;
+  /* contact -> GPtrArray (keys) */
+  GHashTable *keys;
+};
+
+/* the subset of EBookQuery that find_contacts() evaluates natively */
+typedef enum
+{
+  QUERY_AND,
+  QUERY_OR,
+  QUERY_NOT,
+  QUERY_IS,
+  QUERY_CONTAINS,
+  QUERY_BEGINS_WITH,
+  QUERY_ENDS_WITH,
+  QUERY_EXISTS
+} CompiledQueryOp;
+
+typedef struct _CompiledQuery CompiledQuery;
+
+struct _CompiledQuery
+{
+  CompiledQueryOp op;
+  /* vCard attribute name of field tests */
+  gchar *attr_name;
+  gchar *value;
+  /* folded value, as compared against folded attribute values */
+  gchar *key;
+  GPtrArray *children;
+};
+
+/* don't let the cache of compiled queries grow without bounds */
+#define MAX_COMPILED_QUERIES 64
+
 static guint signals[LAST_SIGNAL] = {};
 static GQuark master_quark;
 static GQuark roster_quark;
@@ -58,6 +104,9 @@ struct _OssoABookAggregatorPrivate
   GHashTable *temp_master_contacts;
   /* master uid -> GHashTable (postponed contacts) */
   GHashTable *postponed_contacts;
+  struct contact_index indexes[INDEX_COUNT];
+  /* query string -> CompiledQuery, NULL if it has to go through sexp */
+  GHashTable *compiled_queries;
   GPtrArray *contacts_added;
   GPtrArray *contacts_removed;
   GPtrArray *contacts_changed;
@@ -98,6 +147,11 @@ static void
 create_temporary_master(OssoABookAggregator *aggregator,
                         OssoABookContact *roster_contact,
                         const char *tag);
+static void
+compiled_query_free(CompiledQuery *query);
+static gboolean
+find_compiled_contacts(OssoABookAggregator *aggregator, const char *query_text,
+                       GList **contacts);
 
 static OssoABookRoster *default_aggregator = NULL;
 
@@ -136,8 +190,8 @@ static gboolean
 accept_contact(OssoABookAggregatorPrivate *priv, OssoABookContact *contact)
 {
   const char *uid = e_contact_get_const(E_CONTACT(contact), E_CONTACT_UID);
-  GList *roster_contacts;
-  GList *l;
+  OssoABookContactRosterIter iter;
+  OssoABookContact *roster_contact;
   GHashTable *table;
 
   if (contact && priv->sexp && osso_abook_contact_is_roster_contact(contact) &&
@@ -150,21 +204,19 @@ accept_contact(OssoABookAggregatorPrivate *priv, OssoABookContact *contact)
   if (contact_passes_filters(priv, uid, contact))
     return TRUE;
 
-  roster_contacts = osso_abook_contact_get_roster_contacts(contact);
+  _osso_abook_contact_roster_iter_init(&iter, contact);
 
-  for (l = roster_contacts; l; l = l->next)
+  while (_osso_abook_contact_roster_iter_next(&iter, &roster_contact))
   {
-    if (contact_passes_filters(priv, e_contact_get_const(E_CONTACT(l->data),
-                                                         E_CONTACT_UID),
-                               l->data))
+    if (contact_passes_filters(priv,
+                               e_contact_get_const(E_CONTACT(roster_contact),
+                                                   E_CONTACT_UID),
+                               roster_contact))
     {
-      g_list_free(roster_contacts);
       return TRUE;
     }
   }
 
-  g_list_free(roster_contacts);
-
   table = g_hash_table_lookup(priv->postponed_contacts, uid);
 
   if (table)
@@ -191,6 +243,136 @@ get_temporary_uid(OssoABookContact *contact)
   return g_object_get_data(G_OBJECT(contact), "temporary-uid");
 }
 
+static void
+contact_index_remove(struct contact_index *index, OssoABookContact *contact)
+{
+  GPtrArray *keys = g_hash_table_lookup(index->keys, contact);
+  int i;
+
+  if (!keys)
+    return;
+
+  for (i = 0; i < keys->len; i++)
+  {
+    GHashTable *bucket = g_hash_table_lookup(index->buckets, keys->pdata[i]);
+
+    if (bucket)
+    {
+      g_hash_table_remove(bucket, contact);
+
+      if (!g_hash_table_size(bucket))
+        g_hash_table_remove(index->buckets, keys->pdata[i]);
+    }
+  }
+
+  g_hash_table_remove(index->keys, contact);
+}
+
+/* takes ownership of key */
+static void
+contact_index_add(struct contact_index *index, OssoABookContact *contact,
+                  gchar *key)
+{
+  GPtrArray *keys = g_hash_table_lookup(index->keys, contact);
+  GHashTable *bucket;
+  int i;
+
+  if (!keys)
+  {
+    keys = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_insert(index->keys, g_object_ref(contact), keys);
+  }
+
+  for (i = 0; i < keys->len; i++)
+  {
+    if (!strcmp(keys->pdata[i], key))
+    {
+      g_free(key);
+      return;
+    }
+  }
+
+  bucket = g_hash_table_lookup(index->buckets, key);
+
+  if (!bucket)
+  {
+    bucket = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_hash_table_insert(index->buckets, g_strdup(key), bucket);
+  }
+
+  g_hash_table_insert(bucket, contact, contact);
+  g_ptr_array_add(keys, key);
+}
+
+static void
+contact_indexes_remove(OssoABookAggregatorPrivate *priv,
+                       OssoABookContact *contact)
+{
+  int i;
+
+  for (i = 0; i < INDEX_COUNT; i++)
+    contact_index_remove(&priv->indexes[i], contact);
+}
+
+/* Phone numbers are indexed unstripped only: every value matched by
+ * osso_abook_query_phone_number() shares its key with either the
+ * unstripped or the DTMF stripped key of the query. */
+static void
+contact_indexes_update(OssoABookAggregatorPrivate *priv,
+                       OssoABookContact *contact)
+{
+  const char *sip_attr_name = e_contact_vcard_attribute(E_CONTACT_SIP);
+  const char *bound_name;
+  GList *attr;
+
+  contact_indexes_remove(priv, contact);
+
+  for (attr = e_vcard_get_attributes(E_VCARD(contact)); attr;
+       attr = attr->next)
+  {
+    const char *attr_name = e_vcard_attribute_get_name(attr->data);
+    ContactIndexType type;
+    GList *v;
+
+    if (!attr_name)
+      continue;
+
+    if (!g_ascii_strcasecmp(attr_name, EVC_TEL))
+      type = INDEX_PHONE;
+    else if (!g_ascii_strcasecmp(attr_name, EVC_EMAIL))
+      type = INDEX_EMAIL;
+    else if (!g_ascii_strcasecmp(attr_name, sip_attr_name))
+      type = INDEX_SIP;
+    else
+      continue;
+
+    for (v = e_vcard_attribute_get_values(attr->data); v; v = v->next)
+    {
+      gchar *key;
+
+      if (!v->data)
+        continue;
+
+      if (type == INDEX_PHONE)
+        key = _osso_abook_phone_number_get_index_key(v->data, FALSE);
+      else if (type == INDEX_SIP)
+        key = g_ascii_strdown(osso_abook_strip_sip_prefix(v->data), -1);
+      else
+        key = g_ascii_strdown(v->data, -1);
+
+      contact_index_add(&priv->indexes[type], contact, key);
+    }
+  }
+
+  bound_name = osso_abook_contact_get_bound_name(contact);
+
+  if (bound_name)
+  {
+    contact_index_add(&priv->indexes[INDEX_IM], contact,
+                      g_ascii_strdown(bound_name, -1));
+  }
+}
+
 static void
 osso_abook_aggregator_emit(OssoABookAggregator *aggregator, guint signal_id,
                            GQuark detail, GPtrArray *arr, const char *tag)
@@ -229,6 +411,9 @@ osso_abook_aggregator_emit(OssoABookAggregator *aggregator, guint signal_id,
   {
     for (i = 0; i < arr->len; i++)
     {
+      /* attaching or detaching roster contacts can change anything */
+      _osso_abook_contact_clear_changed_fields(arr->pdata[i]);
+
       if (!osso_abook_contact_is_roster_contact(arr->pdata[i]) &&
           !accept_contact(priv, arr->pdata[i]))
       {
@@ -271,8 +456,14 @@ osso_abook_aggregator_emit(OssoABookAggregator *aggregator, guint signal_id,
   contacts = g_new(OssoABookContact *, arr->len + 1);
   memcpy(contacts, arr->pdata, arr->len * sizeof(contacts[0]));
   contacts[arr->len] = NULL;
+
+  OSSO_ABOOK_SAMPLE("aggregator-emit-size", arr->len);
+  OSSO_ABOOK_STAT_TIMER_START("aggregator-emit");
+
   g_ptr_array_remove_range(arr, 0, arr->len);
   g_signal_emit(aggregator, signal_id, detail, contacts);
+
+  OSSO_ABOOK_STAT_TIMER_END();
 }
 
 static void
@@ -314,6 +505,9 @@ voicemail_contact_reset_cb(OssoABookVoicemailContact *contact,
     }
   }
 
+  if (valid && exists)
+    contact_indexes_update(priv, OSSO_ABOOK_CONTACT(contact));
+
   if (valid != exists)
   {
     if (valid)
@@ -375,6 +569,7 @@ static void
 osso_abook_aggregator_init(OssoABookAggregator *aggregator)
 {
   OssoABookAggregatorPrivate *priv = OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator);
+  int i;
 
   priv->master_contacts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
                                                 g_object_unref0);
@@ -384,6 +579,18 @@ osso_abook_aggregator_init(OssoABookAggregator *aggregator)
                                                      g_free, g_object_unref0);
   priv->postponed_contacts = g_hash_table_new_full(
     g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_unref);
+
+  for (i = 0; i < INDEX_COUNT; i++)
+  {
+    priv->indexes[i].buckets = g_hash_table_new_full(
+      g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_unref);
+    priv->indexes[i].keys = g_hash_table_new_full(
+      g_direct_hash, g_direct_equal, g_object_unref,
+      (GDestroyNotify)g_ptr_array_unref);
+  }
+
+  priv->compiled_queries = g_hash_table_new_full(
+    g_str_hash, g_str_equal, g_free, (GDestroyNotify)compiled_query_free);
   priv->contacts_added = g_ptr_array_new();
   priv->contacts_removed = g_ptr_array_new();
   priv->contacts_changed = g_ptr_array_new();
@@ -415,6 +622,7 @@ osso_abook_aggregator_dispose(GObject *object)
 {
   OssoABookAggregator *aggregator = OSSO_ABOOK_AGGREGATOR(object);
   OssoABookAggregatorPrivate *priv = OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator);
+  int i;
 
   if (priv->master_contacts)
     g_hash_table_remove_all(priv->master_contacts);
@@ -428,13 +636,17 @@ osso_abook_aggregator_dispose(GObject *object)
   if (priv->postponed_contacts)
     g_hash_table_remove_all(priv->postponed_contacts);
 
+  for (i = 0; i < INDEX_COUNT; i++)
+  {
+    g_hash_table_remove_all(priv->indexes[i].buckets);
+    g_hash_table_remove_all(priv->indexes[i].keys);
+  }
+
   destroy_contacts_array(priv->contacts_added);
   destroy_contacts_array(priv->contacts_removed);
 
   if (priv->filters)
   {
-    int i;
-
     for (i = 0; i < priv->filters->len; i++)
     {
       gpointer obj = priv->filters->pdata[i];
@@ -475,11 +687,20 @@ osso_abook_aggregator_finalize(GObject *object)
 {
   OssoABookAggregatorPrivate *priv =
     OSSO_ABOOK_AGGREGATOR_PRIVATE(OSSO_ABOOK_AGGREGATOR(object));
+  int i;
 
   g_hash_table_destroy(priv->master_contacts);
   g_hash_table_destroy(priv->roster_contacts);
   g_hash_table_destroy(priv->temp_master_contacts);
   g_hash_table_destroy(priv->postponed_contacts);
+
+  for (i = 0; i < INDEX_COUNT; i++)
+  {
+    g_hash_table_destroy(priv->indexes[i].buckets);
+    g_hash_table_destroy(priv->indexes[i].keys);
+  }
+
+  g_hash_table_destroy(priv->compiled_queries);
   g_ptr_array_free(priv->contacts_added, TRUE);
   g_ptr_array_free(priv->contacts_removed, TRUE);
   g_ptr_array_free(priv->contacts_changed, TRUE);
@@ -744,6 +965,12 @@ create_master_contact(OssoABookAggregator *aggregator,
 {
   OssoABookAggregatorPrivate *priv = OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator);
   const char *uid = e_contact_get_const(E_CONTACT(contact), E_CONTACT_UID);
+  OssoABookContact *old_contact;
+
+  old_contact = g_hash_table_lookup(priv->master_contacts, uid);
+
+  if (old_contact && (old_contact != contact))
+    contact_indexes_remove(priv, old_contact);
 
   if (accept_contact(priv, contact))
   {
@@ -762,6 +989,7 @@ create_master_contact(OssoABookAggregator *aggregator,
 
     g_hash_table_insert(priv->master_contacts, g_strdup(uid),
                         g_object_ref(contact));
+    contact_indexes_update(priv, contact);
 
     process_postponed_contacts(aggregator, contact);
 
@@ -810,6 +1038,7 @@ remove_master_contact(const char *uid, OssoABookAggregatorPrivate *priv)
   if (!osso_abook_is_temporary_uid(uid))
     _osso_abook_eventlogger_remove(contact);
 
+  contact_indexes_remove(priv, contact);
   g_hash_table_remove(priv->postponed_contacts, uid);
   g_hash_table_remove(priv->master_contacts, uid);
 }
@@ -856,15 +1085,26 @@ osso_abook_aggregator_contacts_changed(OssoABookRoster *roster,
       const gchar *uid = e_contact_get_const(E_CONTACT(contact), E_CONTACT_UID);
       OssoABookContact *master_contact =
         g_hash_table_lookup(priv->master_contacts, uid);
+      OssoABookContactFields fields = OSSO_ABOOK_CONTACT_FIELD_ALL;
+      gboolean addresses_changed;
+
+      if (master_contact && (contact != master_contact))
+        fields = _osso_abook_contact_diff(master_contact, contact);
+
+      /* addresses feed the eventlogger and the lookup indexes */
+      addresses_changed = !!(fields & ~(OSSO_ABOOK_CONTACT_FIELD_NAME |
+                                        OSSO_ABOOK_CONTACT_FIELD_PHOTO |
+                                        OSSO_ABOOK_CONTACT_FIELD_PRESENCE));
 
-      _osso_abook_eventlogger_update(contact, master_contact);
+      if (addresses_changed)
+        _osso_abook_eventlogger_update(contact, master_contact);
 
       if (master_contact && (contact != master_contact))
       {
-        OSSO_ABOOK_NOTE(AGGREGATOR, "reset master contact %s (%s)",
+        OSSO_ABOOK_NOTE(AGGREGATOR, "reset master contact %s (%s), fields %x",
                         osso_abook_contact_get_display_name(master_contact),
-                        uid);
-        osso_abook_contact_reset(master_contact, contact);
+                        uid, fields);
+        _osso_abook_contact_reset_with_fields(master_contact, contact, fields);
         contact = master_contact;
       }
 
@@ -875,6 +1115,12 @@ osso_abook_aggregator_contacts_changed(OssoABookRoster *roster,
         *_contacts = contact;
       }
 
+      if (addresses_changed &&
+          (g_hash_table_lookup(priv->master_contacts, uid) == contact))
+      {
+        contact_indexes_update(priv, contact);
+      }
+
       process_postponed_contacts(aggregator, contact);
       _contacts++;
     }
@@ -1204,6 +1450,13 @@ osso_abook_aggregator_find_contacts(OssoABookAggregator *aggregator,
     return osso_abook_aggregator_find_contacts_full(aggregator, NULL, NULL);
 
   query_text = e_book_query_to_string(query);
+
+  if (find_compiled_contacts(aggregator, query_text, &contacts))
+  {
+    g_free(query_text);
+    return contacts;
+  }
+
   sexp = e_book_backend_sexp_new(query_text);
   contacts = osso_abook_aggregator_find_contacts_full(
     aggregator, find_contacts_predicate, sexp);
@@ -1237,16 +1490,18 @@ osso_abook_aggregator_find_contacts_full(OssoABookAggregator *aggregator,
     {
       /* contact was not accepted by the predicate, now try with roster
          contacts */
-      GList *rc = osso_abook_contact_get_roster_contacts(c);
+      OssoABookContactRosterIter rc_iter;
+      OssoABookContact *rc;
+      gboolean accepted = FALSE;
+
+      _osso_abook_contact_roster_iter_init(&rc_iter, c);
 
-      while (rc && !predicate(rc->data, user_data))
-        rc = g_list_delete_link(rc, rc);
+      while (!accepted && _osso_abook_contact_roster_iter_next(&rc_iter, &rc))
+        accepted = predicate(rc, user_data);
 
-      if (!rc)
+      if (!accepted)
         /* all roster contacts were rejected */
         continue;
-      else
-        g_list_free(rc);
     }
 
     contacts = g_list_prepend(contacts, c);
@@ -1415,6 +1670,7 @@ restore_master_contact_cb(EBook *book, EBookStatus status, EContact *econtact,
           g_ptr_array_add(priv->contacts_added, g_object_ref(contact));
           g_hash_table_insert(priv->master_contacts, g_strdup(uid),
                               g_object_ref(contact));
+          contact_indexes_update(priv, contact);
         }
 
         g_object_unref(contact);
@@ -1553,87 +1809,174 @@ create_temporary_master(OssoABookAggregator *aggregator,
 }
 
 static void
-contact_filter_changed_cb(OssoABookContactFilter *filter, gpointer user_data)
+refilter_master_contact(OssoABookAggregator *aggregator, const char *uid,
+                        OssoABookContact *contact)
 {
-  OssoABookAggregator *aggregator = user_data;
   OssoABookAggregatorPrivate *priv = OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator);
-  GHashTableIter iter;
-  const gchar *uid;
-  OssoABookContact *contact;
-
-  g_return_if_fail(NULL != priv->filters);
-
-  g_hash_table_iter_init(&iter, priv->master_contacts);
 
-  while (g_hash_table_iter_next(&iter, (gpointer *)&uid, (gpointer *)&contact))
+  if (contact)
   {
-    if (contact)
+    if (!accept_contact(priv, contact))
     {
-      if (!accept_contact(priv, contact))
-      {
-        GList *l;
-
-        OSSO_ABOOK_NOTE(
-          AGGREGATOR,
-          "%s@%p: discarding master contact %s",
-          osso_abook_roster_get_book_uri(OSSO_ABOOK_ROSTER(aggregator)),
-          aggregator, uid);
+      GList *l;
 
-        for (l = osso_abook_contact_get_roster_contacts(contact); l;
-             l = g_list_delete_link(l, l))
-        {
-          postpone_roster_contact(aggregator, uid, l->data);
-        }
+      OSSO_ABOOK_NOTE(
+        AGGREGATOR,
+        "%s@%p: discarding master contact %s",
+        osso_abook_roster_get_book_uri(OSSO_ABOOK_ROSTER(aggregator)),
+        aggregator, uid);
 
-        g_ptr_array_add(priv->contacts_removed, g_object_ref(contact));
-        g_hash_table_insert(priv->master_contacts, g_strdup(uid), NULL);
+      for (l = osso_abook_contact_get_roster_contacts(contact); l;
+           l = g_list_delete_link(l, l))
+      {
+        postpone_roster_contact(aggregator, uid, l->data);
       }
+
+      contact_indexes_remove(priv, contact);
+      g_ptr_array_add(priv->contacts_removed, g_object_ref(contact));
+      g_hash_table_insert(priv->master_contacts, g_strdup(uid), NULL);
     }
-    else
+  }
+  else
+  {
+    gboolean passed = passes_by_uid(priv, uid);
+
+    if (!passed)
     {
-      gboolean passed = passes_by_uid(priv, uid);
+      GHashTable *postponed = g_hash_table_lookup(priv->postponed_contacts,
+                                                  uid);
 
-      if (!passed)
+      if (postponed)
       {
-        GHashTable *postponed = g_hash_table_lookup(priv->postponed_contacts,
-                                                    uid);
-
-        if (postponed)
-        {
-          gpointer tmp_uid;
-          gpointer tmp_contact;
-          GHashTableIter tmp_iter;
+        gpointer tmp_uid;
+        gpointer tmp_contact;
+        GHashTableIter tmp_iter;
 
-          g_hash_table_iter_init(&tmp_iter, postponed);
+        g_hash_table_iter_init(&tmp_iter, postponed);
 
-          while (g_hash_table_iter_next(&tmp_iter, &tmp_uid, &tmp_contact))
+        while (g_hash_table_iter_next(&tmp_iter, &tmp_uid, &tmp_contact))
+        {
+          if (passes_by_uid(priv, tmp_uid))
           {
-            if (passes_by_uid(priv, tmp_uid))
-            {
-              passed = TRUE;
-              break;
-            }
+            passed = TRUE;
+            break;
           }
         }
       }
+    }
+
+    if (passed)
+      restore_master_contact(aggregator, uid);
+  }
+}
+
+static void
+refilter_roster_contact(OssoABookAggregator *aggregator, const char *uid,
+                        OssoABookContact *contact)
+{
+  OssoABookAggregatorPrivate *priv = OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator);
+
+  if (!osso_abook_contact_get_master_uids(contact) &&
+      !g_hash_table_lookup(priv->master_contacts, uid))
+  {
+    if (accept_contact(priv, contact))
+      create_temporary_master(aggregator, contact, __FUNCTION__);
+  }
+}
+
+/* only re-evaluates the contacts a filter reports as changed */
+static void
+refilter_uids(OssoABookAggregator *aggregator, const char * const *uids)
+{
+  const char * const *changed_uids = uids;
+  OssoABookAggregatorPrivate *priv = OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator);
+  GHashTable *master_uids = g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTableIter iter;
+  gpointer master_uid;
+
+  for (; *uids; uids++)
+  {
+    OssoABookContact *roster_contact =
+      g_hash_table_lookup(priv->roster_contacts, *uids);
+
+    /* a changed UID can be a master contact or a roster contact attached
+     * to or postponed for some master contacts */
+    g_hash_table_insert(master_uids, (gpointer)*uids, NULL);
+
+    if (roster_contact)
+    {
+      GList *l;
 
-      if (passed)
-        restore_master_contact(aggregator, uid);
+      for (l = osso_abook_contact_get_master_uids(roster_contact); l;
+           l = l->next)
+      {
+        g_hash_table_insert(master_uids, l->data, NULL);
+      }
     }
   }
 
-  g_hash_table_iter_init(&iter, priv->roster_contacts);
+  g_hash_table_iter_init(&iter, master_uids);
 
-  while (g_hash_table_iter_next(&iter, (gpointer *)&uid, (gpointer *)&contact))
+  while (g_hash_table_iter_next(&iter, &master_uid, NULL))
   {
-    if (!osso_abook_contact_get_master_uids(contact) &&
-        !g_hash_table_lookup(priv->master_contacts, uid))
+    gpointer uid;
+    gpointer contact;
+
+    if (g_hash_table_lookup_extended(priv->master_contacts, master_uid, &uid,
+                                     &contact))
     {
-      if (accept_contact(priv, contact))
-        create_temporary_master(aggregator, contact, __FUNCTION__);
+      refilter_master_contact(aggregator, uid, contact);
     }
   }
 
+  g_hash_table_destroy(master_uids);
+
+  for (uids = changed_uids; *uids; uids++)
+  {
+    OssoABookContact *roster_contact =
+      g_hash_table_lookup(priv->roster_contacts, *uids);
+
+    if (roster_contact)
+      refilter_roster_contact(aggregator, *uids, roster_contact);
+  }
+}
+
+static void
+contact_filter_changed_cb(OssoABookContactFilter *filter, gpointer user_data)
+{
+  OssoABookAggregator *aggregator = user_data;
+  OssoABookAggregatorPrivate *priv = OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator);
+  const char * const *uids;
+  GHashTableIter iter;
+  const gchar *uid;
+  OssoABookContact *contact;
+
+  g_return_if_fail(NULL != priv->filters);
+
+  uids = osso_abook_contact_filter_get_changed_uids(filter);
+
+  if (uids)
+  {
+    OSSO_ABOOK_NOTE(
+      AGGREGATOR, "%s@%p: %d UIDs changed by %s",
+      osso_abook_roster_get_book_uri(OSSO_ABOOK_ROSTER(aggregator)),
+      aggregator, g_strv_length((gchar **)uids), G_OBJECT_TYPE_NAME(filter));
+
+    refilter_uids(aggregator, uids);
+    osso_abook_aggregator_emit_all(aggregator, __FUNCTION__);
+    return;
+  }
+
+  g_hash_table_iter_init(&iter, priv->master_contacts);
+
+  while (g_hash_table_iter_next(&iter, (gpointer *)&uid, (gpointer *)&contact))
+    refilter_master_contact(aggregator, uid, contact);
+
+  g_hash_table_iter_init(&iter, priv->roster_contacts);
+
+  while (g_hash_table_iter_next(&iter, (gpointer *)&uid, (gpointer *)&contact))
+    refilter_roster_contact(aggregator, uid, contact);
+
   osso_abook_aggregator_emit_all(aggregator, __FUNCTION__);
 }
 
@@ -1786,11 +2129,17 @@ roster_contacts_added_cb(OssoABookRoster *roster, OssoABookContact **contacts,
     gboolean at_least_one_postponed = FALSE;
     gboolean at_least_one_not_attached = FALSE;
     gboolean all_detached = TRUE;
+    const char *roster_uid =
+      e_contact_get_const(E_CONTACT(contact), E_CONTACT_UID);
+    OssoABookContact *old_contact =
+      g_hash_table_lookup(priv->roster_contacts, roster_uid);
+
+    if (old_contact && (old_contact != contact))
+      contact_indexes_remove(priv, old_contact);
 
-    g_hash_table_insert(priv->roster_contacts,
-                        g_strdup(e_contact_get_const(E_CONTACT(contact),
-                                                     E_CONTACT_UID)),
+    g_hash_table_insert(priv->roster_contacts, g_strdup(roster_uid),
                         g_object_ref(contact));
+    contact_indexes_update(priv, contact);
 
     for (uid = osso_abook_contact_get_master_uids(contact); uid;
          uid = uid->next)
@@ -1914,6 +2263,7 @@ roster_contacts_changed_cb(OssoABookRoster *roster, OssoABookContact **contacts,
     contact_uids = osso_abook_string_list_sort(contact_uids);
 
     osso_abook_contact_reset(roster_contact, contact);
+    contact_indexes_update(priv, roster_contact);
 
     while (roster_uids || contact_uids)
     {
@@ -2039,6 +2389,7 @@ roster_contacts_removed_cb(OssoABookRoster *roster, const char **uids,
 
       osso_abook_string_list_free(master_uids);
       remove_temporary_master(aggregator, uid, NULL, __FUNCTION__);
+      contact_indexes_remove(priv, roster_contact);
       g_hash_table_remove(priv->roster_contacts, uid);
     }
     else
@@ -2333,56 +2684,687 @@ osso_abook_aggregator_lookup(OssoABookAggregator *aggregator, const char *uid)
   return NULL;
 }
 
-GList *
-osso_abook_aggregator_find_contacts_for_phone_number(
-  OssoABookAggregator *aggregator,
-  const char *phone_number,
-  gboolean fuzzy_match)
+static void
+add_contact_match(OssoABookAggregatorPrivate *priv, GHashTable *matches,
+                  OssoABookContact *contact, gboolean include_masters)
 {
-  EBookQuery *query;
-  GList *contacts;
-
-  g_return_val_if_fail(OSSO_ABOOK_IS_AGGREGATOR(aggregator), NULL);
-  g_return_val_if_fail(!IS_EMPTY(phone_number), NULL);
+  const char *uid = e_contact_get_const(E_CONTACT(contact), E_CONTACT_UID);
+  OssoABookContact *master_contact;
+  GList *l;
 
-  query = osso_abook_query_phone_number(phone_number, fuzzy_match);
-  contacts = osso_abook_aggregator_find_contacts(aggregator, query);
-  e_book_query_unref(query);
+  if (!uid)
+    return;
 
-  if (contacts && contacts->next)
-    return osso_abook_sort_phone_number_matches(contacts, phone_number);
+  if (g_hash_table_lookup(priv->master_contacts, uid) == contact)
+  {
+    if (include_masters)
+      g_hash_table_insert(matches, contact, contact);
 
-  return contacts;
-}
+    return;
+  }
 
-static gboolean
-filter_im_predicate(OssoABookContact *contact, gpointer user_data)
-{
-  gpointer *data = user_data;
-  GList *roster_contacts = osso_abook_contact_get_roster_contacts(contact);
-  GList *l;
-  gboolean rv = FALSE;
+  if (g_hash_table_lookup(priv->roster_contacts, uid) != contact)
+    return;
 
-  for (l = roster_contacts; l; l = l->next)
+  for (l = osso_abook_contact_get_master_uids(contact); l; l = l->next)
   {
-    if ((!data[1] || data[1] == osso_abook_contact_get_account(l->data)) &&
-        !strcasecmp(osso_abook_contact_get_bound_name(l->data), data[0]))
+    master_contact = g_hash_table_lookup(priv->master_contacts, l->data);
+
+    if (master_contact &&
+        _osso_abook_contact_has_roster_contact(master_contact, contact))
     {
-      rv = TRUE;
-      break;
+      g_hash_table_insert(matches, master_contact, master_contact);
     }
   }
 
-  g_list_free(roster_contacts);
+  master_contact = g_hash_table_lookup(priv->temp_master_contacts, uid);
 
-  return rv;
+  if (master_contact &&
+      _osso_abook_contact_has_roster_contact(master_contact, contact))
+  {
+    const char *temp_uid =
+      e_contact_get_const(E_CONTACT(master_contact), E_CONTACT_UID);
+
+    if (g_hash_table_lookup(priv->master_contacts, temp_uid) == master_contact)
+      g_hash_table_insert(matches, master_contact, master_contact);
+  }
 }
 
-GList *
-osso_abook_aggregator_find_contacts_for_im_contact(
+/* Adds the master contacts of all indexed contacts that are stored under
+ * key and accepted by predicate to matches. Returns the number of indexed
+ * contacts the predicate was run on. */
+static guint
+find_indexed_contacts(OssoABookAggregatorPrivate *priv, GHashTable *matches,
+                      ContactIndexType type, const char *key,
+                      OssoABookContactPredicate predicate, gpointer user_data)
+{
+  GHashTable *bucket = g_hash_table_lookup(priv->indexes[type].buckets, key);
+  GHashTableIter iter;
+  OssoABookContact *contact;
+
+  if (!bucket)
+    return 0;
+
+  g_hash_table_iter_init(&iter, bucket);
+
+  while (g_hash_table_iter_next(&iter, (gpointer *)&contact, NULL))
+  {
+    if (predicate(contact, user_data))
+      add_contact_match(priv, matches, contact, type != INDEX_IM);
+  }
+
+  return g_hash_table_size(bucket);
+}
+
+static GList *
+get_matches(OssoABookAggregator *aggregator, GHashTable *matches,
+            const char *what)
+{
+  GList *contacts = g_hash_table_get_keys(matches);
+
+  OSSO_ABOOK_NOTE(AGGREGATOR, "%s@%p: %d contacts found for %s",
+                  osso_abook_roster_get_book_uri(OSSO_ABOOK_ROSTER(aggregator)),
+                  aggregator, g_hash_table_size(matches), what);
+
+  g_hash_table_destroy(matches);
+
+  return contacts;
+}
+
+static void
+compiled_query_free(CompiledQuery *query)
+{
+  if (!query)
+    return;
+
+  if (query->children)
+    g_ptr_array_free(query->children, TRUE);
+
+  g_free(query->attr_name);
+  g_free(query->value);
+  g_free(query->key);
+  g_slice_free(CompiledQuery, query);
+}
+
+/* case insensitive and, for QUERY_CONTAINS, accent insensitive like the
+ * compare functions of e-book-backend-sexp */
+static gchar *
+fold_query_value(const char *value, gboolean strip_marks)
+{
+  gchar *normalized;
+  gchar *folded;
+
+  if (!g_utf8_validate(value, -1, NULL))
+    return NULL;
+
+  normalized = g_utf8_normalize(value, -1, G_NORMALIZE_NFD);
+
+  if (strip_marks)
+  {
+    GString *s = g_string_sized_new(strlen(normalized));
+    const char *p;
+
+    for (p = normalized; *p; p = g_utf8_next_char(p))
+    {
+      gunichar uc = g_utf8_get_char(p);
+
+      if (!g_unichar_ismark(uc))
+        g_string_append_unichar(s, uc);
+    }
+
+    g_free(normalized);
+    normalized = g_string_free(s, FALSE);
+  }
+
+  folded = g_utf8_casefold(normalized, -1);
+  g_free(normalized);
+
+  return folded;
+}
+
+static void
+skip_spaces(const char **p)
+{
+  while (g_ascii_isspace(**p))
+    (*p)++;
+}
+
+static gchar *
+parse_query_string(const char **p)
+{
+  GString *s;
+
+  skip_spaces(p);
+
+  if (**p != '"')
+    return NULL;
+
+  s = g_string_new(NULL);
+
+  for ((*p)++; **p != '"'; (*p)++)
+  {
+    if (**p == '\\')
+      (*p)++;
+
+    if (!**p)
+    {
+      g_string_free(s, TRUE);
+      return NULL;
+    }
+
+    g_string_append_c(s, **p);
+  }
+
+  (*p)++;
+
+  return g_string_free(s, FALSE);
+}
+
+static gboolean
+is_vcard_attribute_name(const char *name)
+{
+  const char *p;
+
+  /* EContact field names are lower case and have special semantics */
+  for (p = name; *p; p++)
+  {
+    if (!g_ascii_isupper(*p) && !g_ascii_isdigit(*p) && (*p != '-'))
+      return FALSE;
+  }
+
+  return p != name;
+}
+
+/* parses one s-expression, returns NULL for shapes it doesn't know */
+static CompiledQuery *
+parse_query(const char **p, int depth)
+{
+  static const struct
+  {
+    const char *name;
+    CompiledQueryOp op;
+  } ops[] =
+  {
+    { "and", QUERY_AND },
+    { "or", QUERY_OR },
+    { "not", QUERY_NOT },
+    { "is", QUERY_IS },
+    { "contains", QUERY_CONTAINS },
+    { "beginswith", QUERY_BEGINS_WITH },
+    { "endswith", QUERY_ENDS_WITH },
+    { "exists", QUERY_EXISTS },
+    { "exists_vcard", QUERY_EXISTS }
+  };
+  CompiledQuery *query;
+  const char *name;
+  gsize len;
+  int i;
+
+  skip_spaces(p);
+
+  if ((**p != '(') || (depth > 16))
+    return NULL;
+
+  (*p)++;
+  skip_spaces(p);
+  name = *p;
+
+  while (g_ascii_isalnum(**p) || (**p == '_') || (**p == '-'))
+    (*p)++;
+
+  len = *p - name;
+
+  for (i = 0; i < G_N_ELEMENTS(ops); i++)
+  {
+    if ((strlen(ops[i].name) == len) && !strncmp(ops[i].name, name, len))
+      break;
+  }
+
+  if (i == G_N_ELEMENTS(ops))
+    return NULL;
+
+  query = g_slice_new0(CompiledQuery);
+  query->op = ops[i].op;
+
+  if ((query->op == QUERY_AND) || (query->op == QUERY_OR) ||
+      (query->op == QUERY_NOT))
+  {
+    query->children =
+      g_ptr_array_new_with_free_func((GDestroyNotify)compiled_query_free);
+
+    for (skip_spaces(p); **p != ')'; skip_spaces(p))
+    {
+      CompiledQuery *child = parse_query(p, depth + 1);
+
+      if (!child)
+        goto error;
+
+      g_ptr_array_add(query->children, child);
+    }
+
+    if (!query->children->len ||
+        ((query->op == QUERY_NOT) && (query->children->len != 1)))
+    {
+      goto error;
+    }
+  }
+  else
+  {
+    query->attr_name = parse_query_string(p);
+
+    if (!query->attr_name || !is_vcard_attribute_name(query->attr_name))
+      goto error;
+
+    if (query->op != QUERY_EXISTS)
+    {
+      query->value = parse_query_string(p);
+
+      if (!query->value)
+        goto error;
+
+      query->key = fold_query_value(query->value,
+                                    query->op == QUERY_CONTAINS);
+
+      if (!query->key)
+        goto error;
+    }
+
+    skip_spaces(p);
+
+    if (**p != ')')
+      goto error;
+  }
+
+  (*p)++;
+
+  return query;
+
+error:
+  compiled_query_free(query);
+
+  return NULL;
+}
+
+static CompiledQuery *
+compile_query(const char *query_text)
+{
+  const char *p = query_text;
+  CompiledQuery *query = parse_query(&p, 0);
+
+  if (query)
+  {
+    skip_spaces(&p);
+
+    if (*p)
+    {
+      compiled_query_free(query);
+      query = NULL;
+    }
+  }
+
+  return query;
+}
+
+static gboolean
+match_attribute_value(CompiledQuery *query, const char *value)
+{
+  gchar *folded;
+  gboolean rv = FALSE;
+
+  if (query->op == QUERY_EXISTS)
+    return !IS_EMPTY(value);
+
+  folded = fold_query_value(value, query->op == QUERY_CONTAINS);
+
+  if (!folded)
+    return FALSE;
+
+  switch (query->op)
+  {
+    case QUERY_IS:
+    {
+      rv = !strcmp(folded, query->key);
+      break;
+    }
+    case QUERY_CONTAINS:
+    {
+      rv = strstr(folded, query->key) != NULL;
+      break;
+    }
+    case QUERY_BEGINS_WITH:
+    {
+      rv = g_str_has_prefix(folded, query->key);
+      break;
+    }
+    case QUERY_ENDS_WITH:
+    {
+      rv = g_str_has_suffix(folded, query->key);
+      break;
+    }
+    default:
+      break;
+  }
+
+  g_free(folded);
+
+  return rv;
+}
+
+static gboolean
+compiled_query_match(OssoABookContact *contact, gpointer user_data)
+{
+  CompiledQuery *query = user_data;
+  GList *attr;
+  int i;
+
+  switch (query->op)
+  {
+    case QUERY_AND:
+    {
+      for (i = 0; i < query->children->len; i++)
+      {
+        if (!compiled_query_match(contact, query->children->pdata[i]))
+          return FALSE;
+      }
+
+      return TRUE;
+    }
+    case QUERY_OR:
+    {
+      for (i = 0; i < query->children->len; i++)
+      {
+        if (compiled_query_match(contact, query->children->pdata[i]))
+          return TRUE;
+      }
+
+      return FALSE;
+    }
+    case QUERY_NOT:
+      return !compiled_query_match(contact, query->children->pdata[0]);
+    default:
+      break;
+  }
+
+  for (attr = e_vcard_get_attributes(E_VCARD(contact)); attr;
+       attr = attr->next)
+  {
+    const char *attr_name = e_vcard_attribute_get_name(attr->data);
+    GList *v;
+
+    if (!attr_name || g_ascii_strcasecmp(attr_name, query->attr_name))
+      continue;
+
+    for (v = e_vcard_attribute_get_values(attr->data); v; v = v->next)
+    {
+      if (v->data && match_attribute_value(query, v->data))
+        return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Gets the index and the key under which all contacts passing a field test
+ * are stored. */
+static gboolean
+get_query_index_key(CompiledQuery *query, ContactIndexType *type, gchar **key)
+{
+  const char *p;
+
+  if (!g_ascii_strcasecmp(query->attr_name, EVC_TEL))
+  {
+    if (query->op == QUERY_IS)
+    {
+      *type = INDEX_PHONE;
+      *key = _osso_abook_phone_number_get_index_key(query->value, FALSE);
+      return TRUE;
+    }
+
+    /* the fuzzy test of osso_abook_query_phone_number() */
+    if (query->op == QUERY_ENDS_WITH)
+    {
+      *key = _osso_abook_phone_number_get_index_key(query->value, FALSE);
+
+      if ((strlen(*key) == 7) && !strcmp(*key, query->value))
+      {
+        *type = INDEX_PHONE;
+        return TRUE;
+      }
+
+      g_free(*key);
+    }
+
+    return FALSE;
+  }
+
+  if ((query->op != QUERY_IS) || g_ascii_strcasecmp(query->attr_name, EVC_EMAIL))
+    return FALSE;
+
+  for (p = query->value; *p; p++)
+  {
+    if (!g_ascii_isprint(*p))
+      return FALSE;
+  }
+
+  *type = INDEX_EMAIL;
+  *key = g_ascii_strdown(query->value, -1);
+
+  return TRUE;
+}
+
+static gboolean
+can_use_index(CompiledQuery *query)
+{
+  ContactIndexType type;
+  gchar *key;
+  int i;
+
+  switch (query->op)
+  {
+    case QUERY_AND:
+    {
+      for (i = 0; i < query->children->len; i++)
+      {
+        if (can_use_index(query->children->pdata[i]))
+          return TRUE;
+      }
+
+      return FALSE;
+    }
+    case QUERY_OR:
+    {
+      for (i = 0; i < query->children->len; i++)
+      {
+        if (!can_use_index(query->children->pdata[i]))
+          return FALSE;
+      }
+
+      return TRUE;
+    }
+    case QUERY_NOT:
+    case QUERY_EXISTS:
+      return FALSE;
+    default:
+      break;
+  }
+
+  if (!get_query_index_key(query, &type, &key))
+    return FALSE;
+
+  g_free(key);
+
+  return TRUE;
+}
+
+/* Adds the master contacts of indexed contacts that might pass query and
+ * that do pass root to matches. */
+static void
+find_query_candidates(OssoABookAggregatorPrivate *priv, GHashTable *matches,
+                      CompiledQuery *query, CompiledQuery *root)
+{
+  ContactIndexType type;
+  gchar *key;
+  int i;
+
+  switch (query->op)
+  {
+    case QUERY_AND:
+    {
+      /* every match passes all children, any indexed one will do */
+      for (i = 0; i < query->children->len; i++)
+      {
+        if (can_use_index(query->children->pdata[i]))
+        {
+          find_query_candidates(priv, matches, query->children->pdata[i],
+                                root);
+          break;
+        }
+      }
+
+      return;
+    }
+    case QUERY_OR:
+    {
+      for (i = 0; i < query->children->len; i++)
+        find_query_candidates(priv, matches, query->children->pdata[i], root);
+
+      return;
+    }
+    default:
+      break;
+  }
+
+  if (get_query_index_key(query, &type, &key))
+  {
+    find_indexed_contacts(priv, matches, type, key, compiled_query_match,
+                          root);
+    g_free(key);
+  }
+}
+
+/* Answers find_contacts() without the sexp interpreter when the query is
+ * made of vCard field tests. Returns FALSE for other queries. */
+static gboolean
+find_compiled_contacts(OssoABookAggregator *aggregator, const char *query_text,
+                       GList **contacts)
+{
+  OssoABookAggregatorPrivate *priv = OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator);
+  CompiledQuery *query;
+
+  if (!g_hash_table_lookup_extended(priv->compiled_queries, query_text, NULL,
+                                    (gpointer *)&query))
+  {
+    if (g_hash_table_size(priv->compiled_queries) >= MAX_COMPILED_QUERIES)
+      g_hash_table_remove_all(priv->compiled_queries);
+
+    query = compile_query(query_text);
+
+    OSSO_ABOOK_NOTE(AGGREGATOR, "%s@%p: %s query %s",
+                    osso_abook_roster_get_book_uri(
+                      OSSO_ABOOK_ROSTER(aggregator)),
+                    aggregator, query ? "compiled" : "cannot compile",
+                    query_text);
+
+    g_hash_table_insert(priv->compiled_queries, g_strdup(query_text), query);
+  }
+
+  if (!query)
+    return FALSE;
+
+  if (can_use_index(query))
+  {
+    GHashTable *matches = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    find_query_candidates(priv, matches, query, query);
+    *contacts = get_matches(aggregator, matches, query_text);
+  }
+  else
+  {
+    *contacts = osso_abook_aggregator_find_contacts_full(
+      aggregator, compiled_query_match, query);
+  }
+
+  return TRUE;
+}
+
+GList *
+osso_abook_aggregator_find_contacts_for_phone_number(
+  OssoABookAggregator *aggregator,
+  const char *phone_number,
+  gboolean fuzzy_match)
+{
+  OssoABookAggregatorPrivate *priv;
+  EBookQuery *query;
+  EBookBackendSExp *sexp;
+  GHashTable *matches;
+  GList *contacts;
+  gchar *query_text;
+  gchar *key;
+  gchar *stripped_key;
+  guint candidates;
+
+  g_return_val_if_fail(OSSO_ABOOK_IS_AGGREGATOR(aggregator), NULL);
+  g_return_val_if_fail(!IS_EMPTY(phone_number), NULL);
+
+  priv = OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator);
+
+  query = osso_abook_query_phone_number(phone_number, fuzzy_match);
+  query_text = e_book_query_to_string(query);
+  sexp = e_book_backend_sexp_new(query_text);
+  g_free(query_text);
+  e_book_query_unref(query);
+
+  g_return_val_if_fail(sexp != NULL, NULL);
+
+  /* only contacts sharing a key with the number can match the query */
+  key = _osso_abook_phone_number_get_index_key(phone_number, FALSE);
+  stripped_key = _osso_abook_phone_number_get_index_key(phone_number, TRUE);
+  matches = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  candidates = find_indexed_contacts(priv, matches, INDEX_PHONE, key,
+                                     find_contacts_predicate, sexp);
+
+  if (strcmp(key, stripped_key))
+  {
+    candidates += find_indexed_contacts(priv, matches, INDEX_PHONE,
+                                        stripped_key, find_contacts_predicate,
+                                        sexp);
+  }
+
+  /* compare with the master contacts a full scan would have evaluated */
+  OSSO_ABOOK_COUNT("aggregator-phone-lookups", 1);
+  OSSO_ABOOK_COUNT("aggregator-phone-candidates", candidates);
+  OSSO_ABOOK_COUNT("aggregator-phone-master-contacts",
+                   g_hash_table_size(priv->master_contacts));
+
+  contacts = get_matches(aggregator, matches, phone_number);
+  g_object_unref(sexp);
+  g_free(stripped_key);
+  g_free(key);
+
+  if (contacts && contacts->next)
+    return osso_abook_sort_phone_number_matches(contacts, phone_number);
+
+  return contacts;
+}
+
+static gboolean
+filter_im_predicate(OssoABookContact *contact, gpointer user_data)
+{
+  gpointer *data = user_data;
+  const char *bound_name = osso_abook_contact_get_bound_name(contact);
+
+  return (!data[1] || data[1] == osso_abook_contact_get_account(contact)) &&
+         bound_name && !strcasecmp(bound_name, data[0]);
+}
+
+GList *
+osso_abook_aggregator_find_contacts_for_im_contact(
   OssoABookAggregator *aggregator, const char *username, TpAccount *account)
 {
+  GHashTable *matches;
   gpointer data[2];
+  gchar *key;
 
   g_return_val_if_fail(OSSO_ABOOK_IS_AGGREGATOR(aggregator), NULL);
   g_return_val_if_fail(account == NULL || TP_IS_ACCOUNT(account), NULL);
@@ -2391,8 +3373,13 @@ osso_abook_aggregator_find_contacts_for_im_contact(
   data[0] = (gpointer)username;
   data[1] = account;
 
-    return osso_abook_aggregator_find_contacts_full(
-      aggregator, filter_im_predicate, data);
+  key = g_ascii_strdown(username, -1);
+  matches = g_hash_table_new(g_direct_hash, g_direct_equal);
+  find_indexed_contacts(OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator), matches,
+                        INDEX_IM, key, filter_im_predicate, data);
+  g_free(key);
+
+  return get_matches(aggregator, matches, username);
 }
 
 static gboolean
@@ -2421,12 +3408,20 @@ osso_abook_aggregator_find_contacts_for_email_address(
   OssoABookAggregator *aggregator,
   const char *address)
 {
+  GHashTable *matches;
+  gchar *key;
+
   g_return_val_if_fail(OSSO_ABOOK_IS_AGGREGATOR(aggregator), NULL);
   g_return_val_if_fail(NULL != address, NULL);
 
-  return osso_abook_aggregator_find_contacts_full(aggregator,
-                                                  filter_emails_predicate,
-                                                  (gpointer)address);
+  key = g_ascii_strdown(address, -1);
+  matches = g_hash_table_new(g_direct_hash, g_direct_equal);
+  find_indexed_contacts(OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator), matches,
+                        INDEX_EMAIL, key, filter_emails_predicate,
+                        (gpointer)address);
+  g_free(key);
+
+  return get_matches(aggregator, matches, address);
 }
 
 static gboolean
@@ -2455,15 +3450,22 @@ osso_abook_aggregator_find_contacts_for_sip_address(
   OssoABookAggregator *aggregator, const char *address)
 {
   const gchar *stripped;
+  GHashTable *matches;
   GList *contacts;
+  gchar *key;
   char *at;
 
   g_return_val_if_fail(OSSO_ABOOK_IS_AGGREGATOR(aggregator), NULL);
   g_return_val_if_fail(NULL != address, NULL);
 
   stripped = osso_abook_strip_sip_prefix(address);
-  contacts = osso_abook_aggregator_find_contacts_full(
-        aggregator, filter_sip_predicate, (gpointer)stripped);
+  key = g_ascii_strdown(stripped, -1);
+  matches = g_hash_table_new(g_direct_hash, g_direct_equal);
+  find_indexed_contacts(OSSO_ABOOK_AGGREGATOR_PRIVATE(aggregator), matches,
+                        INDEX_SIP, key, filter_sip_predicate,
+                        (gpointer)stripped);
+  g_free(key);
+  contacts = get_matches(aggregator, matches, stripped);
 
   at = strchr(stripped, '@');
 
@@ -21,6 +21,7 @@
 
 #include "osso-abook-alpha-shortcuts.h"
 #include "osso-abook-contact-view.h"
+#include "osso-abook-row-model.h"
 #include "osso-abook-util.h"
 
 enum
@@ -36,6 +37,7 @@ enum
 struct _OssoABookAlphaShortcutsPrivate
 {
   OssoABookContactView *contact_view;
+  GtkTreeView *contact_tree_view;
   GtkWidget *pannable_area;
   GtkListStore *list_store;
   GtkWidget *tree_view;
@@ -43,6 +45,14 @@ struct _OssoABookAlphaShortcutsPrivate
   GtkTreeViewColumn *column;
   int current_row;
   int tap_count;
+  gunichar *group_letters[N_LETTER_GROUPS];
+  guint visible_groups;
+  GtkTreeModel *model;
+  /* folded initial of every row of model, in model order */
+  GArray *initials;
+  /* initial -> index of the first row with it, plus one */
+  GHashTable *first_rows;
+  guint sync_index_id;
 };
 
 typedef struct _OssoABookAlphaShortcutsPrivate OssoABookAlphaShortcutsPrivate;
@@ -66,12 +76,294 @@ osso_abook_alpha_shortcuts_dispose(GObject *object)
   G_OBJECT_CLASS(osso_abook_alpha_shortcuts_parent_class)->dispose(object);
 }
 
+static void
+osso_abook_alpha_shortcuts_finalize(GObject *object)
+{
+  OssoABookAlphaShortcutsPrivate *priv =
+    PRIVATE(OSSO_ABOOK_ALPHA_SHORTCUTS(object));
+  int i;
+
+  for (i = 0; i < N_LETTER_GROUPS; i++)
+    g_free(priv->group_letters[i]);
+
+  g_array_free(priv->initials, TRUE);
+  g_hash_table_destroy(priv->first_rows);
+
+  G_OBJECT_CLASS(osso_abook_alpha_shortcuts_parent_class)->finalize(object);
+}
+
 static void
 osso_abook_alpha_shortcuts_class_init(OssoABookAlphaShortcutsClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
 
   object_class->dispose = osso_abook_alpha_shortcuts_dispose;
+  object_class->finalize = osso_abook_alpha_shortcuts_finalize;
+}
+
+/* lower case, with a following combining mark composed in, so "E\u0301"
+ * and "\u00c9" both give "\u00e9" */
+static gunichar
+fold_initial(const char *s)
+{
+  gunichar c;
+  gunichar mark;
+  gunichar composed;
+
+  if (!s || !*s)
+    return 0;
+
+  c = g_utf8_get_char_validated(s, -1);
+
+  if ((c == (gunichar)-1) || (c == (gunichar)-2))
+    return 0;
+
+  s = g_utf8_next_char(s);
+  mark = g_utf8_get_char_validated(s, -1);
+
+  if (*s && g_unichar_ismark(mark) && g_unichar_compose(c, mark, &composed))
+    c = composed;
+
+  return g_unichar_tolower(c);
+}
+
+static gunichar
+get_row_initial(GtkTreeModel *model, GtkTreeIter *iter)
+{
+  OssoABookListStoreRow *row =
+    osso_abook_row_model_iter_get_row(OSSO_ABOOK_ROW_MODEL(model), iter);
+
+  if (!row || !row->contact)
+    return 0;
+
+  return fold_initial(osso_abook_contact_get_display_name(row->contact));
+}
+
+static void
+update_letter_groups(OssoABookAlphaShortcutsPrivate *priv)
+{
+  guint visible_groups = 0;
+  guint index;
+
+  for (index = 0; index < N_LETTER_GROUPS; index++)
+  {
+    const gunichar *c;
+
+    if (!priv->model)
+    {
+      visible_groups |= 1 << index;
+      continue;
+    }
+
+    for (c = priv->group_letters[index]; *c; c++)
+    {
+      if (g_hash_table_contains(priv->first_rows, GUINT_TO_POINTER(*c)))
+      {
+        visible_groups |= 1 << index;
+        break;
+      }
+    }
+  }
+
+  if (visible_groups == priv->visible_groups)
+    return;
+
+  priv->visible_groups = visible_groups;
+  priv->current_row = -1;
+  priv->tap_count = 0;
+  gtk_list_store_clear(priv->list_store);
+
+  for (index = 0; index < N_LETTER_GROUPS; index++)
+  {
+    gchar *msg_id;
+    GtkTreeIter iter;
+    guint len = 0;
+
+    if (!(visible_groups & (1 << index)))
+      continue;
+
+    while (priv->group_letters[index][len])
+      len++;
+
+    msg_id = g_strdup_printf("addr_li_alpha_%d", index);
+    gtk_list_store_append(priv->list_store, &iter);
+    gtk_list_store_set(priv->list_store, &iter,
+                       COLUMN_LABEL, _(msg_id),
+                       COLUMN_NUM_LETTERS, len,
+                       COLUMN_INDEX, index,
+                       -1);
+    g_free(msg_id);
+  }
+}
+
+static void
+sync_index(OssoABookAlphaShortcutsPrivate *priv)
+{
+  guint i;
+
+  if (priv->sync_index_id)
+  {
+    g_source_remove(priv->sync_index_id);
+    priv->sync_index_id = 0;
+  }
+
+  g_hash_table_remove_all(priv->first_rows);
+
+  for (i = 0; i < priv->initials->len; i++)
+  {
+    gpointer initial =
+      GUINT_TO_POINTER(g_array_index(priv->initials, gunichar, i));
+
+    if (initial && !g_hash_table_contains(priv->first_rows, initial))
+      g_hash_table_insert(priv->first_rows, initial, GUINT_TO_POINTER(i + 1));
+  }
+
+  update_letter_groups(priv);
+}
+
+static gboolean
+sync_index_idle(gpointer user_data)
+{
+  OssoABookAlphaShortcutsPrivate *priv = PRIVATE(user_data);
+
+  priv->sync_index_id = 0;
+  sync_index(priv);
+
+  return FALSE;
+}
+
+static void
+schedule_sync_index(OssoABookAlphaShortcuts *shortcuts)
+{
+  OssoABookAlphaShortcutsPrivate *priv = PRIVATE(shortcuts);
+
+  if (!priv->sync_index_id)
+  {
+    priv->sync_index_id =
+      gdk_threads_add_idle_full(G_PRIORITY_DEFAULT_IDLE, sync_index_idle,
+                                shortcuts, NULL);
+  }
+}
+
+static void
+row_inserted_cb(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter,
+                gpointer user_data)
+{
+  OssoABookAlphaShortcutsPrivate *priv = PRIVATE(user_data);
+  gunichar initial = get_row_initial(model, iter);
+
+  g_array_insert_val(priv->initials, gtk_tree_path_get_indices(path)[0],
+                     initial);
+  schedule_sync_index(user_data);
+}
+
+static void
+row_deleted_cb(GtkTreeModel *model, GtkTreePath *path, gpointer user_data)
+{
+  OssoABookAlphaShortcutsPrivate *priv = PRIVATE(user_data);
+
+  g_array_remove_index(priv->initials, gtk_tree_path_get_indices(path)[0]);
+  schedule_sync_index(user_data);
+}
+
+static void
+row_changed_cb(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter,
+               gpointer user_data)
+{
+  OssoABookAlphaShortcutsPrivate *priv = PRIVATE(user_data);
+  gint index = gtk_tree_path_get_indices(path)[0];
+  gunichar initial = get_row_initial(model, iter);
+
+  g_return_if_fail(index < (gint)priv->initials->len);
+
+  if (g_array_index(priv->initials, gunichar, index) != initial)
+  {
+    g_array_index(priv->initials, gunichar, index) = initial;
+    schedule_sync_index(user_data);
+  }
+}
+
+static void
+rows_reordered_cb(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter,
+                  gint *new_order, gpointer user_data)
+{
+  OssoABookAlphaShortcutsPrivate *priv = PRIVATE(user_data);
+  GArray *initials;
+  guint i;
+
+  /* toplevel rows only */
+  if (iter)
+    return;
+
+  initials = g_array_sized_new(FALSE, FALSE, sizeof(gunichar),
+                               priv->initials->len);
+
+  for (i = 0; i < priv->initials->len; i++)
+  {
+    g_array_append_val(initials,
+                       g_array_index(priv->initials, gunichar, new_order[i]));
+  }
+
+  g_array_free(priv->initials, TRUE);
+  priv->initials = initials;
+  schedule_sync_index(user_data);
+}
+
+static void
+set_model(OssoABookAlphaShortcuts *shortcuts, GtkTreeModel *model)
+{
+  OssoABookAlphaShortcutsPrivate *priv = PRIVATE(shortcuts);
+
+  if (model && !OSSO_ABOOK_IS_ROW_MODEL(model))
+    model = NULL;
+
+  if (priv->model == model)
+    return;
+
+  if (priv->model)
+  {
+    g_signal_handlers_disconnect_matched(
+      priv->model, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, shortcuts);
+    g_object_unref(priv->model);
+    priv->model = NULL;
+  }
+
+  g_array_set_size(priv->initials, 0);
+
+  if (model)
+  {
+    GtkTreeIter iter;
+
+    priv->model = g_object_ref(model);
+
+    if (gtk_tree_model_get_iter_first(model, &iter))
+    {
+      do
+      {
+        gunichar initial = get_row_initial(model, &iter);
+
+        g_array_append_val(priv->initials, initial);
+      }
+      while (gtk_tree_model_iter_next(model, &iter));
+    }
+
+    g_signal_connect(model, "row-inserted",
+                     G_CALLBACK(row_inserted_cb), shortcuts);
+    g_signal_connect(model, "row-deleted",
+                     G_CALLBACK(row_deleted_cb), shortcuts);
+    g_signal_connect(model, "row-changed",
+                     G_CALLBACK(row_changed_cb), shortcuts);
+    g_signal_connect(model, "rows-reordered",
+                     G_CALLBACK(rows_reordered_cb), shortcuts);
+  }
+
+  sync_index(priv);
+}
+
+static void
+notify_model_cb(GtkTreeView *tree_view, GParamSpec *pspec, gpointer user_data)
+{
+  set_model(user_data, gtk_tree_view_get_model(tree_view));
 }
 
 static void
@@ -162,78 +454,51 @@ hildon_row_tapped_cb(GtkTreeView *tree_view, GtkTreePath *path,
     priv->tap_count = 1;
   }
 
+  if (priv->sync_index_id)
+    sync_index(priv);
+
   while (index < N_LETTER_GROUPS)
   {
-    const gchar *c;
-    gchar *msg_id_idx = g_strdup_printf("addr_li_alpha_%d%d", index, index);
-
-    for (c = _(msg_id_idx); *c == '!'; c++)
-      ;
+    const gunichar *c = priv->group_letters[index];
 
     if (!not_first_time)
     {
       int i;
 
-      for (i = 1; i < priv->tap_count; i++)
-        c = g_utf8_next_char(c);
+      for (i = 1; (i < priv->tap_count) && *c; i++)
+        c++;
     }
 
-    while (*c)
+    for (; *c; c++)
     {
-      gunichar letter = g_unichar_tolower(g_utf8_get_char_validated(c, -1));
-      GtkTreeModel *model = gtk_tree_view_get_model(contact_tree_view);
-      GtkTreeIter contact_iter;
+      guint row = GPOINTER_TO_UINT(
+          g_hash_table_lookup(priv->first_rows, GUINT_TO_POINTER(*c)));
 
-      if (gtk_tree_model_get_iter_first(model, &contact_iter))
+      if (row)
       {
-        do
-        {
-          const char *display_name;
-          OssoABookContact *contact;
-
-          gtk_tree_model_get(model, &contact_iter,
-                             OSSO_ABOOK_LIST_STORE_COLUMN_CONTACT, &contact,
-                             -1);
-          display_name = osso_abook_contact_get_display_name(contact);
-
-          if (display_name)
-          {
-            if (letter == g_unichar_tolower(g_utf8_get_char(display_name)))
-            {
-              GdkRectangle rect;
-              gint y;
-              GtkTreePath *contact_path =
-                gtk_tree_model_get_path(model, &contact_iter);
-
-              gtk_tree_view_get_background_area(
-                GTK_TREE_VIEW(contact_tree_view), contact_path, NULL, &rect);
-
-              gtk_tree_view_convert_bin_window_to_tree_coords(
-                GTK_TREE_VIEW(contact_tree_view), 0, rect.y, 0, &y);
-              y += pannable_area->allocation.height / 2;
-
-              if (not_first_time)
-                y -= rect.height;
-
-              hildon_pannable_area_jump_to(
-                HILDON_PANNABLE_AREA(pannable_area), -1, y);
-              gtk_tree_path_free(contact_path);
-              g_object_unref(contact);
-              g_free(msg_id_idx);
-              return;
-            }
-          }
-
-          g_object_unref(contact);
-        }
-        while (gtk_tree_model_iter_next(model, &contact_iter));
+        GdkRectangle rect;
+        gint y;
+        GtkTreePath *contact_path = gtk_tree_path_new_from_indices(row - 1, -1);
+
+        gtk_tree_view_get_background_area(
+          GTK_TREE_VIEW(contact_tree_view), contact_path, NULL, &rect);
+
+        gtk_tree_view_convert_bin_window_to_tree_coords(
+          GTK_TREE_VIEW(contact_tree_view), 0, rect.y, 0, &y);
+        y += pannable_area->allocation.height / 2;
+
+        if (not_first_time)
+          y -= rect.height;
+
+        hildon_pannable_area_jump_to(
+          HILDON_PANNABLE_AREA(pannable_area), -1, y);
+        gtk_tree_path_free(contact_path);
+        return;
       }
 
-      c = g_utf8_next_char(c);
       not_first_time = TRUE;
     }
 
-    g_free(msg_id_idx);
     index++;
   }
 
@@ -277,21 +542,30 @@ osso_abook_alpha_shortcuts_init(OssoABookAlphaShortcuts *shortcuts)
    */
   for (index = 0; index < N_LETTER_GROUPS; index++)
   {
-    gchar *msg_id = g_strdup_printf("addr_li_alpha_%d", index);
     gchar *msg_id_idx = g_strdup_printf("addr_li_alpha_%d%d", index, index);
-    GtkTreeIter iter;
-    guint len = g_utf8_strlen(_(msg_id_idx), -1);
+    const gchar *c;
+    glong len;
+    glong i;
+
+    for (c = _(msg_id_idx); *c == '!'; c++)
+      ;
+
+    len = g_utf8_strlen(c, -1);
+    priv->group_letters[index] = g_new0(gunichar, len + 1);
+
+    for (i = 0; i < len; i++)
+    {
+      priv->group_letters[index][i] = fold_initial(c);
+      c = g_utf8_next_char(c);
+    }
 
-    gtk_list_store_append(priv->list_store, &iter);
-    gtk_list_store_set(priv->list_store, &iter,
-                       COLUMN_LABEL, _(msg_id),
-                       COLUMN_NUM_LETTERS, len,
-                       COLUMN_INDEX, index,
-                       -1);
     g_free(msg_id_idx);
-    g_free(msg_id);
   }
 
+  priv->initials = g_array_new(FALSE, FALSE, sizeof(gunichar));
+  priv->first_rows = g_hash_table_new(g_direct_hash, g_direct_equal);
+  update_letter_groups(priv);
+
   pannable_area = osso_abook_pannable_area_new();
   g_object_set(pannable_area,
                "vscrollbar-policy", GTK_POLICY_NEVER,
@@ -328,6 +602,17 @@ contact_view_finalize(gpointer data, GObject *where_the_object_was)
   OssoABookAlphaShortcutsPrivate *priv = PRIVATE(shortcuts);
 
   priv->contact_view = NULL;
+  set_model(shortcuts, NULL);
+
+  if (priv->contact_tree_view)
+  {
+    g_object_remove_weak_pointer(G_OBJECT(priv->contact_tree_view),
+                                 (gpointer *)&priv->contact_tree_view);
+    g_signal_handlers_disconnect_matched(
+      priv->contact_tree_view, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_FUNC,
+      0, 0, NULL, notify_model_cb, shortcuts);
+    priv->contact_tree_view = NULL;
+  }
 
   if (priv->pannable_area)
   {
@@ -361,6 +646,13 @@ osso_abook_alpha_shortcuts_widget_hook(OssoABookAlphaShortcuts *shortcuts,
                    G_CALLBACK(vertical_movement_cb), shortcuts);
   g_object_weak_ref(G_OBJECT(priv->pannable_area), pannable_area_finalize,
                     shortcuts);
+  priv->contact_tree_view = osso_abook_tree_view_get_tree_view(
+      OSSO_ABOOK_TREE_VIEW(contact_view));
+  g_object_add_weak_pointer(G_OBJECT(priv->contact_tree_view),
+                            (gpointer *)&priv->contact_tree_view);
+  g_signal_connect(priv->contact_tree_view, "notify::model",
+                   G_CALLBACK(notify_model_cb), shortcuts);
+  set_model(shortcuts, gtk_tree_view_get_model(priv->contact_tree_view));
 }
 
 void
@@ -386,6 +678,18 @@ osso_abook_alpha_shortcuts_widget_unhook(OssoABookAlphaShortcuts *shortcuts)
     priv->pannable_area = NULL;
   }
 
+  if (priv->contact_tree_view)
+  {
+    g_object_remove_weak_pointer(G_OBJECT(priv->contact_tree_view),
+                                 (gpointer *)&priv->contact_tree_view);
+    g_signal_handlers_disconnect_matched(
+      priv->contact_tree_view, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_FUNC,
+      0, 0, NULL, notify_model_cb, shortcuts);
+    priv->contact_tree_view = NULL;
+  }
+
+  set_model(shortcuts, NULL);
+
   g_object_weak_unref(G_OBJECT(priv->contact_view), contact_view_finalize,
                       shortcuts);
   priv->contact_view = NULL;
@@ -3,13 +3,19 @@
 #include <gtk/gtkprivate.h>
 
 #include "osso-abook-avatar-cache.h"
+#include "osso-abook-debug.h"
 #include "osso-abook-utils-private.h"
 
 struct _OssoABookAvatarCachePrivate
 {
+  /* least recently used first, links are embedded in CachedImage */
   GQueue queue;
   GHashTable *cached_images;
   guint limit;
+  guint byte_limit;
+  gsize bytes;
+  /* images of named caches also count against the global budget */
+  gboolean global;
 };
 
 typedef struct _OssoABookAvatarCachePrivate OssoABookAvatarCachePrivate;
@@ -20,6 +26,11 @@ struct _CachedImage
   OssoABookAvatar *avatar;
   GdkPixbuf *pixbuf;
   gpointer image_token;
+  /* identifies the source image instead of image_token, if set */
+  gchar *key;
+  gsize size;
+  GList link;
+  GList global_link;
 };
 
 typedef struct _CachedImage CachedImage;
@@ -35,26 +46,61 @@ G_DEFINE_TYPE_WITH_PRIVATE(
 
 enum
 {
-  PROP_CACHE_LIMIT = 1
+  PROP_CACHE_LIMIT = 1,
+  PROP_BYTE_LIMIT
 };
 
 #define DEFAULT_CACHE_LIMIT 100
+#define GLOBAL_BYTE_LIMIT (8 * 1024 * 1024)
 
 static GHashTable *cache_by_name = NULL;
 
+/* all images of the named caches, least recently used first. These caches
+ * live until dropped, one per avatar scale in use, so they share one budget
+ * rather than each growing up to its own limit. */
+static GQueue global_queue = G_QUEUE_INIT;
+static gsize global_bytes = 0;
+
+static void
+cached_image_evict(CachedImage *cached_image)
+{
+  OssoABookAvatarCachePrivate *priv =
+    OSSO_ABOOK_AVATAR_CACHE_PRIVATE(cached_image->cache);
+
+  OSSO_ABOOK_NOTE(AVATAR, "evicting %p from cache %p (%" G_GSIZE_FORMAT
+                  " bytes)", cached_image->avatar, cached_image->cache,
+                  cached_image->size);
+  OSSO_ABOOK_COUNT("avatar-cache-evictions", 1);
+
+  g_hash_table_remove(priv->cached_images, cached_image->avatar);
+}
+
 static void
 prune_n_items(OssoABookAvatarCachePrivate *priv, guint n_items)
 {
-  guint queue_length = g_queue_get_length(&priv->queue);
-  guint i;
+  g_warn_if_fail(priv->queue.length ==
+                 g_hash_table_size(priv->cached_images));
 
-  g_warn_if_fail(queue_length == g_hash_table_size(priv->cached_images));
+  while (n_items-- && priv->queue.head)
+    cached_image_evict(priv->queue.head->data);
+}
 
-  if (queue_length < n_items)
-    n_items = queue_length;
+/* makes room for extra_bytes in the cache, and in the global budget if the
+ * cache is a named one */
+static void
+prune_bytes(OssoABookAvatarCachePrivate *priv, gsize extra_bytes)
+{
+  if (priv->byte_limit)
+  {
+    while (priv->queue.head && (priv->bytes + extra_bytes > priv->byte_limit))
+      cached_image_evict(priv->queue.head->data);
+  }
 
-  for (i = 0; i < n_items; i++)
-    g_hash_table_remove(priv->cached_images, g_queue_pop_head(&priv->queue));
+  if (!priv->global)
+    return;
+
+  while (global_queue.head && (global_bytes + extra_bytes > GLOBAL_BYTE_LIMIT))
+    cached_image_evict(global_queue.head->data);
 }
 
 static void
@@ -77,6 +123,16 @@ osso_abook_avatar_cache_set_property(GObject *object, guint property_id,
       priv->limit = new_limit;
       break;
     }
+    case PROP_BYTE_LIMIT:
+    {
+      OssoABookAvatarCache *cache = OSSO_ABOOK_AVATAR_CACHE(object);
+      OssoABookAvatarCachePrivate *priv =
+        OSSO_ABOOK_AVATAR_CACHE_PRIVATE(cache);
+
+      priv->byte_limit = g_value_get_uint(value);
+      prune_bytes(priv, 0);
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
       break;
@@ -98,6 +154,15 @@ osso_abook_avatar_cache_get_property(GObject *object, guint property_id,
       g_value_set_uint(value, priv->limit);
       break;
     }
+    case PROP_BYTE_LIMIT:
+    {
+      OssoABookAvatarCache *cache = OSSO_ABOOK_AVATAR_CACHE(object);
+      OssoABookAvatarCachePrivate *priv =
+        OSSO_ABOOK_AVATAR_CACHE_PRIVATE(cache);
+
+      g_value_set_uint(value, priv->byte_limit);
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
       break;
@@ -117,7 +182,6 @@ osso_abook_avatar_cache_dispose(GObject *object)
     priv->cached_images = NULL;
   }
 
-  g_queue_clear(&priv->queue);
   G_OBJECT_CLASS(osso_abook_avatar_cache_parent_class)->dispose(object);
 }
 
@@ -140,6 +204,16 @@ osso_abook_avatar_cache_class_init(OssoABookAvatarCacheClass *klass)
       G_MAXUINT,
       DEFAULT_CACHE_LIMIT,
       GTK_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+  g_object_class_install_property(
+    object_class, PROP_BYTE_LIMIT,
+    g_param_spec_uint(
+      "byte-limit",
+      "Byte Limit",
+      "Maximum number of bytes of pixel data to cache, 0 for no limit",
+      0,
+      G_MAXUINT,
+      0,
+      GTK_PARAM_READWRITE));
 }
 
 static void
@@ -149,8 +223,6 @@ cached_image_free(CachedImage *cached_image, gboolean keep_avatar)
     OSSO_ABOOK_AVATAR_CACHE_PRIVATE(cached_image->cache);
   OssoABookAvatar *avatar = cached_image->avatar;
 
-  g_queue_remove(&priv->queue, avatar);
-
   if (keep_avatar)
     cached_image->avatar = NULL;
 
@@ -167,6 +239,17 @@ static void
 cached_image_destroy(gpointer data)
 {
   CachedImage *cached_image = data;
+  OssoABookAvatarCachePrivate *priv =
+    OSSO_ABOOK_AVATAR_CACHE_PRIVATE(cached_image->cache);
+
+  g_queue_unlink(&priv->queue, &cached_image->link);
+  priv->bytes -= cached_image->size;
+
+  if (priv->global)
+  {
+    g_queue_unlink(&global_queue, &cached_image->global_link);
+    global_bytes -= cached_image->size;
+  }
 
   if (cached_image->avatar)
   {
@@ -177,6 +260,7 @@ cached_image_destroy(gpointer data)
   if (cached_image->pixbuf)
     g_object_unref(cached_image->pixbuf);
 
+  g_free(cached_image->key);
   g_slice_free(CachedImage, cached_image);
 }
 
@@ -232,6 +316,7 @@ osso_abook_avatar_cache_get_for_name(const char *name)
   if (!cache)
   {
     cache = osso_abook_avatar_cache_new();
+    OSSO_ABOOK_AVATAR_CACHE_PRIVATE(cache)->global = TRUE;
     g_hash_table_insert(cache_by_name, g_strdup(name), cache);
   }
 
@@ -259,20 +344,20 @@ osso_abook_avatar_cache_get_limit(OssoABookAvatarCache *self)
   return priv->limit;
 }
 
-void
-osso_abook_avatar_cache_add(OssoABookAvatarCache *self, OssoABookAvatar *avatar,
-                            GdkPixbuf *pixbuf)
+static void
+cache_add(OssoABookAvatarCache *self, OssoABookAvatar *avatar,
+          GdkPixbuf *pixbuf, const char *key)
 {
-  OssoABookAvatarCachePrivate *priv;
+  OssoABookAvatarCachePrivate *priv = OSSO_ABOOK_AVATAR_CACHE_PRIVATE(self);
   guint table_size;
   guint limit;
   CachedImage *cached_image;
 
-  g_return_if_fail(OSSO_ABOOK_IS_AVATAR_CACHE(self));
-  g_return_if_fail(OSSO_ABOOK_IS_AVATAR(avatar));
-  g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+  /* replaced images must not count against the new one */
+  cached_image = g_hash_table_lookup(priv->cached_images, avatar);
 
-  priv = OSSO_ABOOK_AVATAR_CACHE_PRIVATE(self);
+  if (cached_image)
+    g_hash_table_remove(priv->cached_images, avatar);
 
   table_size = g_hash_table_size(priv->cached_images);
   limit = priv->limit;
@@ -284,41 +369,122 @@ osso_abook_avatar_cache_add(OssoABookAvatarCache *self, OssoABookAvatar *avatar,
   cached_image->cache = self;
   cached_image->avatar = avatar;
   cached_image->pixbuf = g_object_ref(pixbuf);
-  cached_image->image_token = osso_abook_avatar_get_image_token(avatar);
+
+  if (key)
+    cached_image->key = g_strdup(key);
+  else
+    cached_image->image_token = osso_abook_avatar_get_image_token(avatar);
+
+  cached_image->size = (gsize)gdk_pixbuf_get_rowstride(pixbuf) *
+    gdk_pixbuf_get_height(pixbuf);
+  cached_image->link.data = cached_image;
+  cached_image->global_link.data = cached_image;
+
+  prune_bytes(priv, cached_image->size);
 
   g_object_weak_ref(G_OBJECT(avatar), avatar_finalyzed_cb, cached_image);
   g_hash_table_insert(priv->cached_images, avatar, cached_image);
-  g_queue_push_tail(&priv->queue, cached_image->avatar);
+  g_queue_push_tail_link(&priv->queue, &cached_image->link);
+  priv->bytes += cached_image->size;
+
+  if (priv->global)
+  {
+    g_queue_push_tail_link(&global_queue, &cached_image->global_link);
+    global_bytes += cached_image->size;
+  }
 }
 
-GdkPixbuf *
-osso_abook_avatar_cache_lookup(OssoABookAvatarCache *self,
-                               OssoABookAvatar *avatar)
+static GdkPixbuf *
+cache_lookup(OssoABookAvatarCache *self, OssoABookAvatar *avatar,
+             const char *key)
 {
-  OssoABookAvatarCachePrivate *priv;
+  OssoABookAvatarCachePrivate *priv = OSSO_ABOOK_AVATAR_CACHE_PRIVATE(self);
   CachedImage *cached_image;
+  gboolean valid;
 
-  g_return_val_if_fail(OSSO_ABOOK_IS_AVATAR_CACHE(self), NULL);
-  g_return_val_if_fail(OSSO_ABOOK_IS_AVATAR(avatar), NULL);
-
-  priv = OSSO_ABOOK_AVATAR_CACHE_PRIVATE(self);
   cached_image = g_hash_table_lookup(priv->cached_images, avatar);
 
   if (cached_image)
   {
-    if (cached_image->image_token == osso_abook_avatar_get_image_token(avatar))
+    /* keyed images are checked without asking the avatar for its image */
+    if (cached_image->key)
+      valid = !g_strcmp0(cached_image->key, key);
+    else
     {
-      g_queue_remove(&priv->queue, cached_image->avatar);
-      g_queue_push_tail(&priv->queue, cached_image->avatar);
+      valid = cached_image->image_token ==
+        osso_abook_avatar_get_image_token(avatar);
+    }
+
+    if (valid)
+    {
+      g_queue_unlink(&priv->queue, &cached_image->link);
+      g_queue_push_tail_link(&priv->queue, &cached_image->link);
+
+      if (priv->global)
+      {
+        g_queue_unlink(&global_queue, &cached_image->global_link);
+        g_queue_push_tail_link(&global_queue, &cached_image->global_link);
+      }
+
+      OSSO_ABOOK_COUNT("avatar-cache-hits", 1);
+
       return cached_image->pixbuf;
     }
     else
       cached_image_free(cached_image, FALSE);
   }
 
+  OSSO_ABOOK_COUNT("avatar-cache-misses", 1);
+
   return NULL;
 }
 
+void
+osso_abook_avatar_cache_add(OssoABookAvatarCache *self, OssoABookAvatar *avatar,
+                            GdkPixbuf *pixbuf)
+{
+  g_return_if_fail(OSSO_ABOOK_IS_AVATAR_CACHE(self));
+  g_return_if_fail(OSSO_ABOOK_IS_AVATAR(avatar));
+  g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+
+  cache_add(self, avatar, pixbuf, NULL);
+}
+
+GdkPixbuf *
+osso_abook_avatar_cache_lookup(OssoABookAvatarCache *self,
+                               OssoABookAvatar *avatar)
+{
+  g_return_val_if_fail(OSSO_ABOOK_IS_AVATAR_CACHE(self), NULL);
+  g_return_val_if_fail(OSSO_ABOOK_IS_AVATAR(avatar), NULL);
+
+  return cache_lookup(self, avatar, NULL);
+}
+
+void
+_osso_abook_avatar_cache_add_for_key(OssoABookAvatarCache *cache,
+                                     OssoABookAvatar *avatar,
+                                     GdkPixbuf *pixbuf, const char *key)
+{
+  g_return_if_fail(OSSO_ABOOK_IS_AVATAR_CACHE(cache));
+  g_return_if_fail(OSSO_ABOOK_IS_AVATAR(avatar));
+  g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+  g_return_if_fail(key != NULL);
+
+  cache_add(cache, avatar, pixbuf, key);
+}
+
+GdkPixbuf *
+_osso_abook_avatar_cache_lookup_for_key(OssoABookAvatarCache *cache,
+                                        OssoABookAvatar *avatar,
+                                        const char *key)
+{
+  g_return_val_if_fail(OSSO_ABOOK_IS_AVATAR_CACHE(cache), NULL);
+  g_return_val_if_fail(OSSO_ABOOK_IS_AVATAR(avatar), NULL);
+  g_return_val_if_fail(key != NULL, NULL);
+
+  return cache_lookup(cache, avatar, key);
+}
+
 void
 osso_abook_avatar_cache_clear(OssoABookAvatarCache *self)
 {
@@ -41,6 +41,7 @@ struct _OssoABookAvatarImagePrivate
   GdkPixbuf *pixbuf;
   GdkPixbuf *default_avatar_pixbuf;
   cairo_surface_t *surface;
+  cairo_surface_t *shadow_surface;
   gdouble background_opacity;
   int border_width;
   int border_radius;
@@ -54,7 +55,8 @@ struct _OssoABookAvatarImagePrivate
   GtkAdjustment *zadjustment;
   guint redraw_timeout_id;
   gboolean pending_redraw : 1;
-  gboolean redraw_now : 1;
+  gboolean scaled_nearest : 1;
+  guint dirty : 3;
 };
 
 typedef struct _OssoABookAvatarImagePrivate OssoABookAvatarImagePrivate;
@@ -71,6 +73,15 @@ G_DEFINE_TYPE_WITH_PRIVATE(
                                                                                   *) \
                                                                                 image)))
 
+/* what expose has to re-render before painting */
+enum
+{
+  DIRTY_SCALE = 1 << 0,
+  DIRTY_CONTENT = 1 << 1,
+  DIRTY_SHADOW = 1 << 2,
+  DIRTY_ALL = (1 << 3) - 1
+};
+
 enum
 {
   PROP_AVATAR = 1,
@@ -106,6 +117,7 @@ osso_abook_avatar_image_init(OssoABookAvatarImage *image)
   hildon_helper_set_logical_color(GTK_WIDGET(image), GTK_RC_FG,
                                   GTK_STATE_NORMAL, "AvatarStrokeColor");
   priv->pending_redraw = FALSE;
+  priv->dirty = DIRTY_ALL;
 }
 
 static gboolean
@@ -129,12 +141,12 @@ redraw_widget(gpointer user_data)
 }
 
 static void
-redraw(OssoABookAvatarImage *image)
+redraw(OssoABookAvatarImage *image, guint dirty)
 {
   OssoABookAvatarImagePrivate *priv = OSSO_ABOOK_AVATAR_IMAGE_PRIVATE(image);
 
   priv->pending_redraw = FALSE;
-  priv->redraw_now = TRUE;
+  priv->dirty |= dirty;
 
   if (priv->redraw_timeout_id)
   {
@@ -219,7 +231,7 @@ calculate_zoom_and_redraw(OssoABookAvatarImage *image)
   if (diff > 1.0e-10)
     g_object_notify(G_OBJECT(image), "minimum-zoom");
 
-  redraw(image);
+  redraw(image, DIRTY_SCALE | DIRTY_CONTENT);
 }
 
 static void
@@ -285,7 +297,19 @@ destroy_cairo_surface(OssoABookAvatarImagePrivate *priv)
     priv->surface = NULL;
   }
 
-  priv->redraw_now = TRUE;
+  priv->dirty |= DIRTY_CONTENT;
+}
+
+static void
+destroy_shadow_surface(OssoABookAvatarImagePrivate *priv)
+{
+  if (priv->shadow_surface)
+  {
+    cairo_surface_destroy(priv->shadow_surface);
+    priv->shadow_surface = NULL;
+  }
+
+  priv->dirty |= DIRTY_SHADOW;
 }
 
 static void
@@ -317,8 +341,9 @@ adjustment_value_changed_cb(OssoABookAvatarImage *image)
 {
   OssoABookAvatarImagePrivate *priv = OSSO_ABOOK_AVATAR_IMAGE_PRIVATE(image);
 
+  /* pan and zoom only move the image, the frame around it stays valid */
   priv->pending_redraw = TRUE;
-  priv->redraw_now = TRUE;
+  priv->dirty |= DIRTY_SCALE;
 
   if (priv->redraw_timeout_id)
     return;
@@ -485,6 +510,7 @@ osso_abook_avatar_image_set_property(GObject *object, guint property_id,
       if (size != priv->size)
       {
         priv->size = size;
+        priv->dirty |= DIRTY_SHADOW;
         destroy_pixbuf(priv);
         destroy_default_avatar_pixbuf(priv);
         calculate_zoom_and_redraw(image);
@@ -502,7 +528,7 @@ osso_abook_avatar_image_set_property(GObject *object, guint property_id,
         g_free(priv->fallback_icon);
         priv->fallback_icon = g_strdup(icon);
         destroy_default_avatar_pixbuf(priv);
-        redraw(image);
+        redraw(image, DIRTY_SCALE | DIRTY_CONTENT);
       }
 
       break;
@@ -517,14 +543,14 @@ osso_abook_avatar_image_set_property(GObject *object, guint property_id,
     {
       replace_adjustment(image, &priv->xadjustment, g_value_get_object(value),
                          adjustment_value_changed_cb);
-      redraw(image);
+      redraw(image, DIRTY_SCALE | DIRTY_CONTENT);
       break;
     }
     case PROP_YADJUSTMENT:
     {
       replace_adjustment(image, &priv->yadjustment, g_value_get_object(value),
                          adjustment_value_changed_cb);
-      redraw(image);
+      redraw(image, DIRTY_SCALE | DIRTY_CONTENT);
       break;
     }
     case PROP_ZADJUSTMENT:
@@ -532,7 +558,7 @@ osso_abook_avatar_image_set_property(GObject *object, guint property_id,
       replace_adjustment(image, &priv->zadjustment, g_value_get_object(value),
                          zadjustment_value_changed_cb);
       zadjustment_value_changed_cb(image);
-      redraw(image);
+      redraw(image, DIRTY_SCALE | DIRTY_CONTENT);
       break;
     }
     default:
@@ -632,17 +658,127 @@ osso_abook_avatar_image_dispose(GObject *object)
   destroy_pixbuf(priv);
   destroy_scaled_pixbuf(priv);
   destroy_cairo_surface(priv);
+  destroy_shadow_surface(priv);
   destroy_default_avatar_pixbuf(priv);
 
   G_OBJECT_CLASS(osso_abook_avatar_image_parent_class)->dispose(object);
 }
 
+static void
+render_shadow(OssoABookAvatarImagePrivate *priv, GtkWidget *widget)
+{
+  cairo_t *cr = cairo_create(priv->shadow_surface);
+  int i;
+
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.0);
+  cairo_paint(cr);
+  cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+  cairo_translate(cr,
+                  rint(0.5f * (widget->allocation.width - priv->size)),
+                  rint(0.5f * (widget->allocation.height - priv->size)));
+  cairo_set_source_rgba(cr, priv->red, priv->green, priv->blue,
+                        priv->shadow_opacity / (gdouble)priv->shadow_size);
+
+  for (i = priv->shadow_size + 1; i > 1; i--)
+  {
+    gint shadow_size = priv->shadow_size;
+    gint size = 2 * i + priv->size - shadow_size;
+    draw_shadow(cr, shadow_size - i, shadow_size - i, size, size,
+                2 * (priv->border_radius + i));
+    cairo_fill(cr);
+  }
+
+  cairo_destroy(cr);
+}
+
+static void
+render_content(OssoABookAvatarImagePrivate *priv, GtkWidget *widget)
+{
+  GtkStyle *style = widget->style;
+  cairo_t *surface_cr = cairo_create(priv->surface);
+
+  if (has_adjustments(priv))
+  {
+    GtkStateType state = gtk_widget_get_state(widget);
+
+    cairo_set_source_rgba(surface_cr,
+                          (gdouble)style->bg[state].red / 65535.0,
+                          (gdouble)style->bg[state].green / 65535.0,
+                          (gdouble)style->bg[state].blue / 65535.0,
+                          priv->background_opacity);
+  }
+  else
+    cairo_set_source_rgba(surface_cr, 0.0, 0.0, 0.0, 0.0);
+
+  cairo_set_operator(surface_cr, CAIRO_OPERATOR_SOURCE);
+  cairo_paint(surface_cr);
+  cairo_set_operator(surface_cr, CAIRO_OPERATOR_OVER);
+
+  if (priv->shadow_size > 0)
+  {
+    cairo_set_source_surface(surface_cr, priv->shadow_surface, 0, 0);
+    cairo_paint(surface_cr);
+  }
+
+  cairo_translate(surface_cr,
+                  rint(0.5f * (widget->allocation.width - priv->size)),
+                  rint(0.5f * (widget->allocation.height - priv->size)));
+  draw_shadow(surface_cr, -0.5, -0.5, priv->size + 1, priv->size + 1,
+              2 * priv->border_radius);
+
+  if (has_adjustments(priv))
+  {
+    cairo_set_operator(surface_cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_rgba(surface_cr, 0.0, 0.0, 0.0, 0.0);
+    cairo_fill_preserve(surface_cr);
+    cairo_set_operator(surface_cr, CAIRO_OPERATOR_OVER);
+  }
+  else
+  {
+    GtkStateType state = gtk_widget_get_state(widget);
+
+    gdk_cairo_set_source_color(surface_cr,
+                               &style->bg[state]);
+    cairo_fill_preserve(surface_cr);
+    gdk_cairo_set_source_pixbuf(
+      surface_cr, priv->scaled_pixbuf,
+      floor(0.5f * (priv->size -
+                    gdk_pixbuf_get_width(priv->scaled_pixbuf))),
+      floor(0.5f * (priv->size -
+                    gdk_pixbuf_get_height(priv->scaled_pixbuf))));
+    cairo_fill_preserve(surface_cr);
+    cairo_fill_preserve(surface_cr);
+
+    if (state == GTK_STATE_INSENSITIVE)
+    {
+      cairo_set_source_rgba(surface_cr,
+                            (gdouble)style->bg[state].red / 65535.0,
+                            (gdouble)style->bg[state].green / 65535.0,
+                            (gdouble)style->bg[state].blue / 65535.0,
+                            priv->background_opacity);
+      cairo_fill_preserve(surface_cr);
+    }
+  }
+
+  if (priv->border_width > 0)
+  {
+    cairo_set_line_width(surface_cr, priv->border_width);
+    gdk_cairo_set_source_color(surface_cr,
+                               &style->fg[GTK_WIDGET(widget)->state]);
+    cairo_stroke(surface_cr);
+  }
+
+  cairo_destroy(surface_cr);
+}
+
 static gboolean
 osso_abook_avatar_image_expose_event(GtkWidget *widget, GdkEventExpose *event)
 {
   OssoABookAvatarImage *image;
   OssoABookAvatarImagePrivate *priv;
   GtkStyle *style;
+  GdkRectangle area;
   cairo_t *window_cr;
   gint h;
   gint w;
@@ -653,6 +789,9 @@ osso_abook_avatar_image_expose_event(GtkWidget *widget, GdkEventExpose *event)
   priv = OSSO_ABOOK_AVATAR_IMAGE_PRIVATE(image);
   style = widget->style;
 
+  if (!gdk_rectangle_intersect(&event->area, &widget->allocation, &area))
+    goto out;
+
   if (priv->scaled_pixbuf)
   {
     w = gdk_pixbuf_get_width(priv->scaled_pixbuf);
@@ -670,19 +809,22 @@ osso_abook_avatar_image_expose_event(GtkWidget *widget, GdkEventExpose *event)
     priv->scaled_pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, 1, 8,
                                          widget->allocation.width,
                                          widget->allocation.height);
+    priv->dirty |= DIRTY_SCALE;
   }
 
-  if (priv->pending_redraw)
+  /* scale fast while panning or zooming, the redraw timeout brings in the
+   * high quality version once the adjustments settle down */
+  if ((priv->dirty & DIRTY_SCALE) ||
+      (priv->scaled_nearest && !priv->pending_redraw))
   {
     scale_pixbuf(get_pixbuf(image), priv->scaled_pixbuf, priv->size,
                  get_current_zoom(priv), priv->xadjustment, priv->yadjustment,
-                 GDK_INTERP_NEAREST);
-  }
-  else
-  {
-    scale_pixbuf(get_pixbuf(image), priv->scaled_pixbuf, priv->size,
-                 get_current_zoom(priv), priv->xadjustment, priv->yadjustment,
-                 GDK_INTERP_HYPER);
+                 priv->pending_redraw ? GDK_INTERP_NEAREST : GDK_INTERP_HYPER);
+    priv->scaled_nearest = priv->pending_redraw;
+    priv->dirty &= ~DIRTY_SCALE;
+
+    if (!has_adjustments(priv))
+      priv->dirty |= DIRTY_CONTENT;
   }
 
   priv->pending_redraw = FALSE;
@@ -693,11 +835,11 @@ osso_abook_avatar_image_expose_event(GtkWidget *widget, GdkEventExpose *event)
     gdk_gc_set_clip_region(gc, event->region);
     gdk_gc_set_foreground(gc, &style->bg[gtk_widget_get_state(widget)]);
     gdk_draw_rectangle(event->window, gc, TRUE,
-                       widget->allocation.x, widget->allocation.y,
-                       widget->allocation.width, widget->allocation.height);
+                       area.x, area.y, area.width, area.height);
     gdk_draw_pixbuf(event->window, gc, priv->scaled_pixbuf,
-                    0, 0, widget->allocation.x, widget->allocation.y,
-                    widget->allocation.width, widget->allocation.height,
+                    area.x - widget->allocation.x,
+                    area.y - widget->allocation.y,
+                    area.x, area.y, area.width, area.height,
                     GDK_RGB_DITHER_NORMAL, 0, 0);
     g_object_unref(gc);
   }
@@ -720,100 +862,31 @@ osso_abook_avatar_image_expose_event(GtkWidget *widget, GdkEventExpose *event)
   if ((widget->allocation.width != w) || (widget->allocation.height != h))
   {
     destroy_cairo_surface(priv);
+    destroy_shadow_surface(priv);
     priv->surface = cairo_surface_create_similar(cairo_get_target(window_cr),
                                                  CAIRO_CONTENT_COLOR_ALPHA,
                                                  widget->allocation.width,
                                                  widget->allocation.height);
   }
 
-  if (priv->redraw_now)
+  if ((priv->dirty & DIRTY_SHADOW) && (priv->shadow_size > 0))
   {
-    cairo_t *surface_cr = cairo_create(priv->surface);
-
-    if (has_adjustments(priv))
+    if (!priv->shadow_surface)
     {
-      GtkStateType state = gtk_widget_get_state(widget);
-
-      cairo_set_source_rgba(surface_cr,
-                            (gdouble)style->bg[state].red / 65535.0,
-                            (gdouble)style->bg[state].green / 65535.0,
-                            (gdouble)style->bg[state].blue / 65535.0,
-                            priv->background_opacity);
+      priv->shadow_surface = cairo_surface_create_similar(
+          priv->surface, CAIRO_CONTENT_COLOR_ALPHA,
+          widget->allocation.width, widget->allocation.height);
     }
-    else
-      cairo_set_source_rgba(surface_cr, 0.0, 0.0, 0.0, 0.0);
-
-    cairo_set_operator(surface_cr, CAIRO_OPERATOR_SOURCE);
-    cairo_paint(surface_cr);
-    cairo_set_operator(surface_cr, CAIRO_OPERATOR_OVER);
-    cairo_translate(surface_cr,
-                    rint(0.5f * (widget->allocation.width - priv->size)),
-                    rint(0.5f * (widget->allocation.height - priv->size)));
 
-    if (priv->shadow_size > 0)
-    {
-      int i;
-
-      cairo_set_source_rgba(surface_cr, priv->red, priv->green, priv->blue,
-                            priv->shadow_opacity / (gdouble)priv->shadow_size);
-
-      for (i = priv->shadow_size + 1; i > 1; i--)
-      {
-        gint shadow_size = priv->shadow_size;
-        gint size = 2 * i + priv->size - shadow_size;
-        draw_shadow(surface_cr, shadow_size - i, shadow_size - i, size, size,
-                    2 * (priv->border_radius + i));
-        cairo_fill(surface_cr);
-      }
-    }
-
-    draw_shadow(surface_cr, -0.5, -0.5, priv->size + 1, priv->size + 1,
-                2 * priv->border_radius);
-
-    if (has_adjustments(priv))
-    {
-      cairo_set_operator(surface_cr, CAIRO_OPERATOR_SOURCE);
-      cairo_set_source_rgba(surface_cr, 0.0, 0.0, 0.0, 0.0);
-      cairo_fill_preserve(surface_cr);
-      cairo_set_operator(surface_cr, CAIRO_OPERATOR_OVER);
-    }
-    else
-    {
-      GtkStateType state = gtk_widget_get_state(widget);
-
-      gdk_cairo_set_source_color(surface_cr,
-                                 &style->bg[state]);
-      cairo_fill_preserve(surface_cr);
-      gdk_cairo_set_source_pixbuf(
-        surface_cr, priv->scaled_pixbuf,
-        floor(0.5f * (priv->size -
-                      gdk_pixbuf_get_width(priv->scaled_pixbuf))),
-        floor(0.5f * (priv->size -
-                      gdk_pixbuf_get_height(priv->scaled_pixbuf))));
-      cairo_fill_preserve(surface_cr);
-      cairo_fill_preserve(surface_cr);
-
-      if (state == GTK_STATE_INSENSITIVE)
-      {
-        cairo_set_source_rgba(surface_cr,
-                              (gdouble)style->bg[state].red / 65535.0,
-                              (gdouble)style->bg[state].green / 65535.0,
-                              (gdouble)style->bg[state].blue / 65535.0,
-                              priv->background_opacity);
-        cairo_fill_preserve(surface_cr);
-      }
-    }
-
-    if (priv->border_width > 0)
-    {
-      cairo_set_line_width(surface_cr, priv->border_width);
-      gdk_cairo_set_source_color(surface_cr,
-                                 &style->fg[GTK_WIDGET(widget)->state]);
-      cairo_stroke(surface_cr);
-    }
+    render_shadow(priv, widget);
+    priv->dirty &= ~DIRTY_SHADOW;
+    priv->dirty |= DIRTY_CONTENT;
+  }
 
-    cairo_destroy(surface_cr);
-    priv->redraw_now = FALSE;
+  if (priv->dirty & DIRTY_CONTENT)
+  {
+    render_content(priv, widget);
+    priv->dirty &= ~DIRTY_CONTENT;
   }
 
   cairo_set_source_surface(window_cr, priv->surface,
@@ -821,6 +894,7 @@ osso_abook_avatar_image_expose_event(GtkWidget *widget, GdkEventExpose *event)
   cairo_paint(window_cr);
   cairo_destroy(window_cr);
 
+out:
   OSSO_ABOOK_LOCAL_TIMER_END();
 
   return TRUE;
@@ -841,7 +915,7 @@ static void
 osso_abook_avatar_image_state_changed(GtkWidget *widget,
                                       GtkStateType previous_state)
 {
-  redraw(OSSO_ABOOK_AVATAR_IMAGE(widget));
+  redraw(OSSO_ABOOK_AVATAR_IMAGE(widget), DIRTY_CONTENT);
 }
 
 static void
@@ -876,7 +950,7 @@ osso_abook_avatar_image_style_set(GtkWidget *widget, GtkStyle *previous_style)
     priv->green = 0.0f;
   }
 
-  redraw(OSSO_ABOOK_AVATAR_IMAGE(widget));
+  redraw(OSSO_ABOOK_AVATAR_IMAGE(widget), DIRTY_ALL);
   gtk_widget_queue_resize(widget);
 }
 
@@ -4,8 +4,12 @@
 
 #include "osso-abook-avatar-cache.h"
 #include "osso-abook-avatar.h"
+#include "osso-abook-contact.h"
+#include "osso-abook-contact-private.h"
 #include "osso-abook-utils-private.h"
 
+#include "avatar.h"
+
 typedef OssoABookAvatarIface OssoABookAvatarInterface;
 
 G_DEFINE_INTERFACE(
@@ -131,40 +135,105 @@ osso_abook_avatar_get_image_rounded(OssoABookAvatar *avatar, int width,
                                     int height, gboolean crop, int radius,
                                     const guint8 border_color[4])
 {
-  gchar *name;
-  GdkPixbuf *image;
+  OssoABookAvatarIface *iface;
   OssoABookAvatarCache *cache;
+  const char *checksum = NULL;
+  const char *uid = NULL;
+  GdkPixbuf *image;
+  GdkPixbuf *source;
+  gchar *name;
 
   g_return_val_if_fail(OSSO_ABOOK_IS_AVATAR(avatar), NULL);
 
+  iface = OSSO_ABOOK_AVATAR_GET_IFACE(avatar);
   name = _osso_abook_avatar_get_cache_name(width, height, crop, radius,
                                            border_color);
   cache = osso_abook_avatar_cache_get_for_name(name);
-  image = osso_abook_avatar_cache_lookup(cache, avatar);
-  g_free(name);
 
-  if (image)
-    image = g_object_ref(image);
+  /* contacts' own photos are rendered once and kept on disk. Their images
+   * are keyed by the photo, so neither a memory nor a disk cache hit has to
+   * decode it. */
+  if (!iface->get_image_scaled && OSSO_ABOOK_IS_CONTACT(avatar))
+  {
+    uid = e_contact_get_const(E_CONTACT(avatar), E_CONTACT_UID);
+
+    if (uid)
+    {
+      checksum = _osso_abook_contact_get_photo_checksum(
+          OSSO_ABOOK_CONTACT(avatar));
+    }
+  }
+
+  if (checksum)
+    image = _osso_abook_avatar_cache_lookup_for_key(cache, avatar, checksum);
   else
+    image = osso_abook_avatar_cache_lookup(cache, avatar);
+
+  if (image)
   {
-    OssoABookAvatarIface *iface = OSSO_ABOOK_AVATAR_GET_IFACE(avatar);
+    g_free(name);
 
-    if (iface->get_image_scaled)
-      image = iface->get_image_scaled(avatar, width, height, crop);
-    else
+    return g_object_ref(image);
+  }
+
+  if (iface->get_image_scaled)
+  {
+    image = iface->get_image_scaled(avatar, width, height, crop);
+
+    if (image)
+      osso_abook_avatar_cache_add(cache, avatar, image);
+
+    g_free(name);
+
+    return image;
+  }
+
+  if (checksum)
+  {
+    image = _osso_abook_avatar_thumbnail_load(uid, checksum, name);
+
+    if (image)
     {
-      image = osso_abook_avatar_get_image(avatar);
-
-      if (image)
-      {
-        image = _osso_abook_scale_pixbuf_and_crop(image, width, height, crop,
-                                                  border_color ? 1 : 0);
-        _osso_abook_pixbuf_cut_corners(image, radius, border_color);
-        osso_abook_avatar_cache_add(cache, avatar, image);
-      }
+      _osso_abook_avatar_cache_add_for_key(cache, avatar, image, checksum);
+      g_free(name);
+
+      return image;
     }
   }
 
+  source = osso_abook_avatar_get_image(avatar);
+
+  if (source)
+  {
+    gboolean from_photo = FALSE;
+
+    image = _osso_abook_scale_pixbuf_and_crop(source, width, height, crop,
+                                              border_color ? 1 : 0);
+    _osso_abook_pixbuf_cut_corners(image, radius, border_color);
+
+    /* server images must not end up keyed by the contact's photo */
+    if (checksum && osso_abook_avatar_is_done_loading(avatar))
+    {
+      GdkPixbuf *photo =
+        osso_abook_contact_get_photo(OSSO_ABOOK_CONTACT(avatar));
+
+      from_photo = photo == source;
+
+      if (photo)
+        g_object_unref(photo);
+    }
+
+    if (from_photo)
+    {
+      _osso_abook_avatar_thumbnail_save(uid, checksum, name, image);
+      _osso_abook_avatar_cache_add_for_key(cache, avatar, image, checksum);
+    }
+    else
+      osso_abook_avatar_cache_add(cache, avatar, image);
+  }
+
+  g_free(name);
+
   return image;
 }
 
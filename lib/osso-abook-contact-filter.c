@@ -68,3 +68,20 @@ osso_abook_contact_filter_get_flags(OssoABookContactFilter *filter)
 
   return 0;
 }
+
+/* UIDs whose acceptance changed, only valid while contact-filter-changed is
+ * emitted. NULL means any contact might be affected. */
+const char * const *
+osso_abook_contact_filter_get_changed_uids(OssoABookContactFilter *filter)
+{
+  OssoABookContactFilterIface *iface;
+
+  g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT_FILTER(filter), NULL);
+
+  iface = OSSO_ABOOK_CONTACT_FILTER_GET_IFACE(filter);
+
+  if (iface->get_changed_uids)
+    return iface->get_changed_uids(filter);
+
+  return NULL;
+}
@@ -46,6 +46,8 @@ typedef struct _OssoABookContactFilter OssoABookContactFilter;
  * @accept: virtual method for osso_abook_contact_filter_accept()
  * @contact_filter_changed: virtual method for OssoABookContactFilter::contact-filter-changed
  * @get_flags: capabilities of the filter
+ * @get_changed_uids: virtual method for
+ * osso_abook_contact_filter_get_changed_uids()
  *
  * Virtual methods of the #OssoABookContactFilter interface.
  */
@@ -60,6 +62,8 @@ struct _OssoABookContactFilterIface {
         OssoABookContactFilterFlags (* get_flags)              (OssoABookContactFilter *filter);
 
         void                        (* contact_filter_changed) (OssoABookContactFilter *filter);
+
+        const char * const *        (* get_changed_uids)       (OssoABookContactFilter *filter);
 };
 
 GType
@@ -73,6 +77,10 @@ osso_abook_contact_filter_accept    (OssoABookContactFilter *filter,
 OssoABookContactFilterFlags
 osso_abook_contact_filter_get_flags (OssoABookContactFilter *filter);
 
+const char * const *
+osso_abook_contact_filter_get_changed_uids
+                                    (OssoABookContactFilter *filter);
+
 G_END_DECLS
 
 #endif /* __OSSO_ABOOK_CONTACT_FILTER_H__ */
@@ -22,10 +22,63 @@
 
 G_BEGIN_DECLS
 
+/* groups of vCard attributes, as reported by _osso_abook_contact_diff() */
+typedef enum
+{
+  OSSO_ABOOK_CONTACT_FIELD_NAME = 1 << 0,
+  OSSO_ABOOK_CONTACT_FIELD_TEL = 1 << 1,
+  OSSO_ABOOK_CONTACT_FIELD_EMAIL = 1 << 2,
+  OSSO_ABOOK_CONTACT_FIELD_IM_FIELDS = 1 << 3,
+  OSSO_ABOOK_CONTACT_FIELD_PHOTO = 1 << 4,
+  OSSO_ABOOK_CONTACT_FIELD_PRESENCE = 1 << 5,
+  OSSO_ABOOK_CONTACT_FIELD_OTHER = 1 << 6,
+  OSSO_ABOOK_CONTACT_FIELD_ALL = (1 << 7) - 1
+} OssoABookContactFields;
+
 gboolean _osso_abook_contact_reject_for_uid_full(
     OssoABookContact *contact, const gchar *master_uid,
     gboolean always_keep_roster_contact, GError **error);
 
+const gunichar *_osso_abook_contact_get_search_key(
+    OssoABookContact *contact, OssoABookNameOrder order);
+
+OssoABookContactFields _osso_abook_contact_diff(
+    OssoABookContact *contact, OssoABookContact *replacement);
+
+void _osso_abook_contact_reset_with_fields(
+    OssoABookContact *contact, OssoABookContact *replacement,
+    OssoABookContactFields fields);
+
+/* fields changed by the last osso_abook_contact_reset(), all if unknown.
+ * only meaningful while the contacts-changed signal for that reset is
+ * emitted, the emitter resets it with _osso_abook_contact_clear_changed_fields()
+ */
+OssoABookContactFields _osso_abook_contact_get_changed_fields(
+    OssoABookContact *contact);
+
+void _osso_abook_contact_clear_changed_fields(OssoABookContact *contact);
+
+/* walks the roster contacts of a master contact without allocating, the
+ * master contact must not be attached to or detached from meanwhile */
+typedef struct
+{
+  OssoABookContact *master_contact;
+  guint index;
+} OssoABookContactRosterIter;
+
+void _osso_abook_contact_roster_iter_init(
+    OssoABookContactRosterIter *iter, OssoABookContact *master_contact);
+
+gboolean _osso_abook_contact_roster_iter_next(
+    OssoABookContactRosterIter *iter, OssoABookContact **roster_contact);
+
+gboolean _osso_abook_contact_has_roster_contact(
+    OssoABookContact *master_contact, OssoABookContact *roster_contact);
+
+/* identifies the photo without decoding it, NULL if there is no photo. Valid
+ * until the photo changes. */
+const char *_osso_abook_contact_get_photo_checksum(OssoABookContact *contact);
+
 G_END_DECLS
 
 #endif /* __OSSO_ABOOK_CONTACT_PRIVATE_H__ */
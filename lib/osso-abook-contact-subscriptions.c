@@ -27,6 +27,10 @@
 struct _OssoABookContactSubscriptionsPrivate
 {
   GHashTable *uids;
+  /* UIDs added or removed since the last contact-filter-changed */
+  GHashTable *changed_uids;
+  /* valid while contact-filter-changed is emitted */
+  gchar **emitted_uids;
   guint emit_idle_id;
 };
 typedef struct _OssoABookContactSubscriptionsPrivate
@@ -79,12 +83,26 @@ osso_abook_contact_subscriptions_contact_filter_accept(
   return g_hash_table_lookup(priv->uids, uid) != NULL;
 }
 
+static const char * const *
+osso_abook_contact_subscriptions_contact_filter_get_changed_uids(
+  OssoABookContactFilter *filter)
+{
+  OssoABookContactSubscriptions *subscriptions =
+    OSSO_ABOOK_CONTACT_SUBSCRIPTIONS(filter);
+  OssoABookContactSubscriptionsPrivate *priv =
+    OSSO_ABOOK_CONTACT_SUBSCRIPTIONS_PRIVATE(subscriptions);
+
+  return (const char * const *)priv->emitted_uids;
+}
+
 static void
 osso_abook_contact_subscriptions_contact_filter_iface_init(
   OssoABookContactFilterIface *iface)
 {
   iface->get_flags = osso_abook_contact_subscriptions_contact_filter_get_flags;
   iface->accept = osso_abook_contact_subscriptions_contact_filter_accept;
+  iface->get_changed_uids =
+    osso_abook_contact_subscriptions_contact_filter_get_changed_uids;
 }
 
 static void
@@ -96,6 +114,7 @@ osso_abook_contact_subscriptions_finalize(GObject *object)
     OSSO_ABOOK_CONTACT_SUBSCRIPTIONS_PRIVATE(subscriptions);
 
   g_hash_table_destroy(priv->uids);
+  g_hash_table_destroy(priv->changed_uids);
 
   if (priv->emit_idle_id)
     g_source_remove(priv->emit_idle_id);
@@ -121,6 +140,8 @@ osso_abook_contact_subscriptions_init(OssoABookContactSubscriptions *self)
     OSSO_ABOOK_CONTACT_SUBSCRIPTIONS_PRIVATE(self);
 
   priv->uids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  priv->changed_uids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                             NULL);
 }
 
 static gboolean
@@ -130,18 +151,40 @@ emit_contact_filter_changed(gpointer user_data)
   OssoABookContactSubscriptionsPrivate *priv =
     OSSO_ABOOK_CONTACT_SUBSCRIPTIONS_PRIVATE(subscriptions);
 
+  GHashTableIter iter;
+  gpointer uid;
+  int i = 0;
+
   priv->emit_idle_id = 0;
+  priv->emitted_uids =
+    g_new(gchar *, g_hash_table_size(priv->changed_uids) + 1);
+  g_hash_table_iter_init(&iter, priv->changed_uids);
+
+  while (g_hash_table_iter_next(&iter, &uid, NULL))
+  {
+    priv->emitted_uids[i++] = uid;
+    g_hash_table_iter_steal(&iter);
+  }
+
+  priv->emitted_uids[i] = NULL;
+
   g_signal_emit(subscriptions, signals[CONTACT_FILTER_CHANGED], 0);
 
+  g_strfreev(priv->emitted_uids);
+  priv->emitted_uids = NULL;
+
   return FALSE;
 }
 
 static void
-idle_emit_contact_filter_changed(OssoABookContactSubscriptions *subscriptions)
+idle_emit_contact_filter_changed(OssoABookContactSubscriptions *subscriptions,
+                                 const char *uid)
 {
   OssoABookContactSubscriptionsPrivate *priv =
     OSSO_ABOOK_CONTACT_SUBSCRIPTIONS_PRIVATE(subscriptions);
 
+  g_hash_table_replace(priv->changed_uids, g_strdup(uid), NULL);
+
   if (!priv->emit_idle_id)
   {
     priv->emit_idle_id =
@@ -161,7 +204,7 @@ osso_abook_contact_subscriptions_add(
 
   priv = OSSO_ABOOK_CONTACT_SUBSCRIPTIONS_PRIVATE(subscriptions);
   g_hash_table_insert(priv->uids, g_strdup(uid), subscriptions);
-  idle_emit_contact_filter_changed(subscriptions);
+  idle_emit_contact_filter_changed(subscriptions, uid);
 }
 
 gboolean
@@ -179,7 +222,7 @@ osso_abook_contact_subscriptions_remove(
 
   if (g_hash_table_remove(priv->uids, uid))
   {
-    idle_emit_contact_filter_changed(subscriptions);
+    idle_emit_contact_filter_changed(subscriptions, uid);
     return TRUE;
   }
 
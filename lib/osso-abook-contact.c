@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <libedata-book/libedata-book.h>
 #include <telepathy-glib/enums.h>
 
@@ -50,11 +51,17 @@ struct _OssoABookContactPrivate
 {
   gchar *name[OSSO_ABOOK_NAME_ORDER_COUNT];
   char **collate_keys[OSSO_ABOOK_NAME_ORDER_COUNT];
+  gunichar *search_key[OSSO_ABOOK_NAME_ORDER_COUNT];
   OssoABookRoster *roster;
-  /** key - roster contact uid -> value - #roster_link */
-  GHashTable *roster_contacts;
+  /* #roster_link, most recently changed avatar first */
+  GPtrArray *roster_links;
+  /* roster contact providing the server image, if server_image_valid */
+  OssoABookContact *server_image_source;
   OssoABookStringList master_uids;
   GdkPixbuf *avatar_image;
+  GCancellable *avatar_cancellable;
+  /* identifies the photo avatar_image is decoded from, computed on demand */
+  gchar *photo_checksum;
   int field_30;
   OssoABookCapsFlags caps;
   OssoABookCapsFlags combined_caps;
@@ -63,6 +70,7 @@ struct _OssoABookContactPrivate
   gchar *presence_status_message;
   gchar *presence_location_string;
   OssoABookPresence *presence;
+  OssoABookContactFields changed_fields;
   gboolean resetting : 1;          /* priv->flags & 1 */
   gboolean updating_evc : 1;       /* priv->flags & 2 */
   gboolean caps_parsed : 1;        /* priv->flags & 4 */
@@ -70,6 +78,8 @@ struct _OssoABookContactPrivate
   gboolean presence_parsed : 1;    /* priv->flags & 0x10 */
   gboolean is_tel : 1;             /* priv->flags & 0x20 */
   gboolean disposed : 1;           /* priv->flags & 0x40 */
+  gboolean avatar_decoded : 1;
+  gboolean server_image_valid : 1;
 };
 
 typedef struct _OssoABookContactPrivate OssoABookContactPrivate;
@@ -103,6 +113,7 @@ struct roster_link
 {
   gpointer master_contact;
   gpointer roster_contact;
+  gchar *roster_uid;
   gushort avatar_id;
 };
 
@@ -177,7 +188,10 @@ osso_abook_contact_get_value_state(EContact *contact, const char *attr_name)
 static void
 osso_abook_contact_init(OssoABookContact *contact)
 {
-  OSSO_ABOOK_CONTACT_PRIVATE(contact)->field_30 = 0;
+  OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
+
+  priv->field_30 = 0;
+  priv->changed_fields = OSSO_ABOOK_CONTACT_FIELD_ALL;
 }
 
 static gboolean
@@ -244,6 +258,12 @@ free_names_and_collate_keys(OssoABookContactPrivate *priv)
     g_free(priv->name[i]);
     priv->name[i] = NULL;
   }
+
+  for (i = 0; i < G_N_ELEMENTS(priv->search_key); i++)
+  {
+    g_free(priv->search_key[i]);
+    priv->search_key[i] = NULL;
+  }
 }
 
 static void
@@ -461,6 +481,27 @@ parse_capabilities(OssoABookContact *contact, OssoABookContactPrivate *priv)
   priv->caps_parsed = TRUE;
 }
 
+static void
+avatar_image_reset(OssoABookContactPrivate *priv)
+{
+  if (priv->avatar_cancellable)
+  {
+    g_cancellable_cancel(priv->avatar_cancellable);
+    g_object_unref(priv->avatar_cancellable);
+    priv->avatar_cancellable = NULL;
+  }
+
+  if (priv->avatar_image)
+  {
+    g_object_unref(priv->avatar_image);
+    priv->avatar_image = NULL;
+  }
+
+  g_free(priv->photo_checksum);
+  priv->photo_checksum = NULL;
+  priv->avatar_decoded = FALSE;
+}
+
 static void
 osso_abook_contact_update_attributes(OssoABookContact *contact,
                                      const gchar *attribute_name)
@@ -485,13 +526,9 @@ osso_abook_contact_update_attributes(OssoABookContact *contact,
   }
   else if (quark == OSSO_ABOOK_QUARK_VCA_PHOTO)
   {
-    if (priv->avatar_image)
-    {
-      g_object_unref(priv->avatar_image);
-      priv->avatar_image = NULL;
-    }
-
+    avatar_image_reset(priv);
     osso_abook_contact_notify(contact, "avatar-image");
+    osso_abook_contact_notify(contact, "done-loading");
     osso_abook_contact_notify(contact, "photo");
   }
   else if (quark == OSSO_ABOOK_QUARK_VCA_TELEPATHY_PRESENCE)
@@ -551,13 +588,7 @@ avatar_image_cb(OssoABookPresence *presence, GParamSpec *pspec,
   OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
 
   if (!osso_abook_contact_photo_is_user_selected(contact))
-  {
-    if (priv->avatar_image)
-    {
-      g_object_unref(priv->avatar_image);
-      priv->avatar_image = 0;
-    }
-  }
+    avatar_image_reset(priv);
 
   presence_type_cb(presence, pspec, contact);
 }
@@ -621,12 +652,7 @@ osso_abook_contact_dispose(GObject *object)
   priv->disposed = TRUE;
   priv->resetting = TRUE;
   connect_signals(contact, NULL);
-
-  if (priv->avatar_image)
-  {
-    g_object_unref(priv->avatar_image);
-    priv->avatar_image = NULL;
-  }
+  avatar_image_reset(priv);
 
   if (priv->roster)
   {
@@ -635,58 +661,61 @@ osso_abook_contact_dispose(GObject *object)
     priv->roster = NULL;
   }
 
-  if (priv->roster_contacts)
-    g_hash_table_remove_all(priv->roster_contacts);
+  if (priv->roster_links)
+    g_ptr_array_set_size(priv->roster_links, 0);
+
+  priv->server_image_valid = FALSE;
 
   G_OBJECT_CLASS(osso_abook_contact_parent_class)->dispose(object);
 }
 
-static int
-compare_roster_contacts(gconstpointer a, gconstpointer b)
+static struct roster_link *
+find_roster_link(OssoABookContactPrivate *priv, const char *roster_uid)
 {
-  const struct roster_link *const *link_a = a;
-  const struct roster_link *const *link_b = b;
+  int i;
+
+  if (!priv->roster_links || !roster_uid)
+    return NULL;
+
+  for (i = 0; i < priv->roster_links->len; i++)
+  {
+    struct roster_link *link = priv->roster_links->pdata[i];
+
+    if (!strcmp(link->roster_uid, roster_uid))
+      return link;
+  }
 
-  return (*link_b)->avatar_id - (*link_a)->avatar_id;
+  return NULL;
 }
 
 static GdkPixbuf *
 get_server_image(OssoABookContact *contact)
 {
   OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
-  GdkPixbuf *pixbuf = NULL;
-  GPtrArray *arr;
-  struct roster_link *link;
-  GHashTableIter iter;
-
-  if (!priv->roster_contacts)
-    return NULL;
-
-  arr = g_ptr_array_new();
-  g_hash_table_iter_init(&iter, priv->roster_contacts);
-
-  while (g_hash_table_iter_next(&iter, 0, (gpointer *)&link))
-    g_ptr_array_add(arr, link);
+  int i;
 
-  if (arr->len)
+  if (!priv->server_image_valid)
   {
-    int i;
+    priv->server_image_source = NULL;
+    priv->server_image_valid = TRUE;
 
-    g_ptr_array_sort(arr, compare_roster_contacts);
-
-    for (i = 0; i < arr->len; i++)
+    for (i = 0; priv->roster_links && (i < priv->roster_links->len); i++)
     {
-      link = arr->pdata[i];
+      struct roster_link *link = priv->roster_links->pdata[i];
 
-      if ((pixbuf =
-             osso_abook_avatar_get_image(OSSO_ABOOK_AVATAR(link->roster_contact))))
+      if (osso_abook_avatar_get_image(OSSO_ABOOK_AVATAR(link->roster_contact)))
+      {
+        priv->server_image_source = link->roster_contact;
         break;
+      }
     }
   }
 
-  g_ptr_array_free(arr, TRUE);
+  if (!priv->server_image_source)
+    return NULL;
 
-  return pixbuf;
+  return osso_abook_avatar_get_image(
+    OSSO_ABOOK_AVATAR(priv->server_image_source));
 }
 
 static void
@@ -703,58 +732,180 @@ size_prepared_cb(GdkPixbufLoader *loader, gint width, gint height,
   gdk_pixbuf_loader_set_size(loader, (c * (double)width), (c * (double)height));
 }
 
+static GdkPixbuf *
+decode_photo(EContactPhoto *photo)
+{
+  GdkPixbufLoader *pixbuf_loader = gdk_pixbuf_loader_new();
+  GdkPixbuf *pixbuf = NULL;
+
+  OSSO_ABOOK_STAT_TIMER_START("avatar-decode");
+
+  g_signal_connect(pixbuf_loader, "size-prepared",
+                   G_CALLBACK(size_prepared_cb), NULL);
+
+  if (photo->type)
+  {
+    if (photo->type == E_CONTACT_PHOTO_TYPE_URI)
+    {
+      GFile *file = g_file_new_for_uri(photo->data.uri);
+      char *buf;
+      gsize count;
+
+      if (_osso_abook_avatar_read_file(file, &buf, &count, NULL))
+      {
+        gdk_pixbuf_loader_write(pixbuf_loader, (guchar *)buf, count, NULL);
+        g_free(buf);
+      }
+
+      g_object_unref((gpointer)file);
+    }
+  }
+  else
+  {
+    gdk_pixbuf_loader_write(pixbuf_loader, photo->data.inlined.data,
+                            photo->data.inlined.length, NULL);
+  }
+
+  if (gdk_pixbuf_loader_close(pixbuf_loader, NULL))
+    pixbuf = gdk_pixbuf_loader_get_pixbuf(pixbuf_loader);
+
+  if (pixbuf)
+    g_object_ref(pixbuf);
+
+  g_object_unref(pixbuf_loader);
+
+  OSSO_ABOOK_STAT_TIMER_END();
+
+  return pixbuf;
+}
+
 static GdkPixbuf *
 get_avatar_image(OssoABookContact *contact)
 {
   OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
+  gboolean was_loading = FALSE;
   EContactPhoto *photo;
 
-  if (priv->avatar_image)
+  if (priv->avatar_image || priv->avatar_decoded)
     return priv->avatar_image;
 
+  /* a synchronous request supersedes the pending asynchronous one */
+  if (priv->avatar_cancellable)
+  {
+    avatar_image_reset(priv);
+    was_loading = TRUE;
+  }
+
   photo = osso_abook_contact_get_contact_photo(E_CONTACT(contact));
 
   if (photo)
   {
-    GdkPixbufLoader *pixbuf_loader = gdk_pixbuf_loader_new();
+    priv->avatar_image = decode_photo(photo);
+    e_contact_photo_free(photo);
+  }
 
-    g_signal_connect(pixbuf_loader, "size-prepared",
-                     G_CALLBACK(size_prepared_cb), NULL);
+  priv->avatar_decoded = TRUE;
 
-    if (photo->type)
-    {
-      if (photo->type == E_CONTACT_PHOTO_TYPE_URI)
-      {
-        GFile *file = g_file_new_for_uri(photo->data.uri);
-        char *buf;
-        gsize count;
+  if (was_loading)
+  {
+    g_object_freeze_notify(G_OBJECT(contact));
+    osso_abook_contact_notify(contact, "avatar-image");
+    osso_abook_contact_notify(contact, "done-loading");
+    g_object_thaw_notify(G_OBJECT(contact));
+  }
 
-        if (_osso_abook_avatar_read_file(file, &buf, &count, NULL))
-        {
-          gdk_pixbuf_loader_write(pixbuf_loader, (guchar *)buf, count, NULL);
-          g_free(buf);
-        }
+  return priv->avatar_image;
+}
 
-        g_object_unref((gpointer)file);
-      }
-    }
-    else
-    {
-      gdk_pixbuf_loader_write(pixbuf_loader, photo->data.inlined.data,
-                              photo->data.inlined.length, NULL);
-    }
+static void
+decode_photo_thread(GTask *task, gpointer source_object, gpointer task_data,
+                    GCancellable *cancellable)
+{
+  GdkPixbuf *pixbuf = NULL;
 
-    if (gdk_pixbuf_loader_close(pixbuf_loader, NULL))
-    {
-      priv->avatar_image =
-        g_object_ref(gdk_pixbuf_loader_get_pixbuf(pixbuf_loader));
-    }
+  if (!g_cancellable_is_cancelled(cancellable))
+    pixbuf = decode_photo(task_data);
 
-    e_contact_photo_free(photo);
-    g_object_unref(pixbuf_loader);
+  g_task_return_pointer(task, pixbuf, g_object_unref);
+}
+
+static void
+decode_photo_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  OssoABookContact *contact;
+  OssoABookContactPrivate *priv;
+  GError *error = NULL;
+  GdkPixbuf *pixbuf = g_task_propagate_pointer(G_TASK(res), &error);
+
+  /* cancelled, the contact might be gone already */
+  if (error)
+  {
+    g_error_free(error);
+    return;
   }
 
-  return priv->avatar_image;
+  contact = user_data;
+  priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
+
+  g_object_unref(priv->avatar_cancellable);
+  priv->avatar_cancellable = NULL;
+  priv->avatar_image = pixbuf;
+  priv->avatar_decoded = TRUE;
+
+  OSSO_ABOOK_NOTE(AVATAR, "%s: avatar decoded: %s",
+                  e_contact_get_const(E_CONTACT(contact), E_CONTACT_UID),
+                  pixbuf ? "yes" : "no");
+
+  g_object_freeze_notify(G_OBJECT(contact));
+  osso_abook_contact_notify(contact, "avatar-image");
+  osso_abook_contact_notify(contact, "done-loading");
+  g_object_thaw_notify(G_OBJECT(contact));
+}
+
+/* returns the avatar if already decoded, otherwise starts decoding it in a
+ * worker thread and returns NULL */
+static GdkPixbuf *
+get_avatar_image_async(OssoABookContact *contact)
+{
+  OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
+  EContactPhoto *photo;
+  GTask *task;
+
+  if (priv->avatar_image || priv->avatar_decoded || priv->avatar_cancellable)
+    return priv->avatar_image;
+
+  photo = osso_abook_contact_get_contact_photo(E_CONTACT(contact));
+
+  if (!photo)
+  {
+    priv->avatar_decoded = TRUE;
+    return NULL;
+  }
+
+  priv->avatar_cancellable = g_cancellable_new();
+
+  /* no source object, a pending task must not keep the contact alive */
+  task = g_task_new(NULL, priv->avatar_cancellable, decode_photo_cb, contact);
+  g_task_set_task_data(task, photo, (GDestroyNotify)e_contact_photo_free);
+  g_task_run_in_thread(task, decode_photo_thread);
+  g_object_unref(task);
+
+  return NULL;
+}
+
+static gboolean
+avatar_is_done_loading(OssoABookContact *contact)
+{
+  OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
+
+  if (priv->avatar_image || priv->avatar_decoded)
+    return TRUE;
+
+  /* nobody asked for the avatar yet, start decoding it so whoever waits for
+   * done-loading gets notified */
+  get_avatar_image_async(contact);
+
+  return !priv->avatar_cancellable;
 }
 
 static void
@@ -766,7 +917,7 @@ osso_abook_contact_get_property(GObject *object, guint property_id,
     case PROP_AVATAR_IMAGE:
     {
       OssoABookContact *contact = OSSO_ABOOK_CONTACT(object);
-      GdkPixbuf *image = get_avatar_image(contact);
+      GdkPixbuf *image = get_avatar_image_async(contact);
 
       if (!image && !osso_abook_contact_is_roster_contact(contact))
         image = get_server_image(contact);
@@ -840,7 +991,8 @@ osso_abook_contact_get_property(GObject *object, guint property_id,
     }
     case PROP_DONE_LOADING:
     {
-      g_value_set_boolean(value, TRUE);
+      g_value_set_boolean(value,
+                          avatar_is_done_loading(OSSO_ABOOK_CONTACT(object)));
       break;
     }
     default:
@@ -857,8 +1009,8 @@ osso_abook_contact_finalize(GObject *object)
   OssoABookContact *contact = OSSO_ABOOK_CONTACT(object);
   OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
 
-  if (priv->roster_contacts)
-    g_hash_table_destroy(priv->roster_contacts);
+  if (priv->roster_links)
+    g_ptr_array_free(priv->roster_links, TRUE);
 
   osso_abook_string_list_free(priv->master_uids);
   g_free(priv->presence_status_message);
@@ -1030,14 +1182,17 @@ OssoABookContact *
 osso_abook_contact_new_from_template(EContact *templ)
 {
   OssoABookContact *contact;
-  char *vcard;
+  GList *l;
 
   g_return_val_if_fail(E_IS_CONTACT(templ), NULL);
 
-  vcard = e_vcard_to_string(E_VCARD(templ), EVC_FORMAT_VCARD_30);
-  contact = osso_abook_contact_new_from_vcard(
-    e_contact_get_const(templ, E_CONTACT_UID), vcard);
-  g_free(vcard);
+  contact = osso_abook_contact_new();
+
+  /* copy the already parsed attributes instead of serializing the template
+   * and parsing it again. adding prepends, so walk backwards to keep the
+   * attribute order */
+  for (l = g_list_last(e_vcard_get_attributes(E_VCARD(templ))); l; l = l->prev)
+    e_vcard_add_attribute(E_VCARD(contact), e_vcard_attribute_copy(l->data));
 
   return contact;
 }
@@ -1174,6 +1329,33 @@ osso_abook_contact_get_name_with_order(OssoABookContact *contact,
   return priv->name[order];
 }
 
+/* decomposed, lowercased and mark-stripped name used for live search, built
+ * on first use and dropped together with the names when they change */
+const gunichar *
+_osso_abook_contact_get_search_key(OssoABookContact *contact,
+                                   OssoABookNameOrder order)
+{
+  static const gunichar no_search_key[] = { 0 };
+  OssoABookContactPrivate *priv;
+
+  g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(contact), no_search_key);
+  g_return_val_if_fail(order < OSSO_ABOOK_NAME_ORDER_COUNT, no_search_key);
+
+  priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
+
+  if (!priv->search_key[order])
+  {
+    const char *name = osso_abook_contact_get_name_with_order(contact, order);
+
+    priv->search_key[order] = _osso_abook_utf8_strcasestrip(name);
+
+    if (!priv->search_key[order])
+      priv->search_key[order] = g_new0(gunichar, 1);
+  }
+
+  return priv->search_key[order];
+}
+
 OssoABookRoster *
 osso_abook_contact_get_roster(OssoABookContact *contact)
 {
@@ -1239,20 +1421,126 @@ osso_abook_contact_get_roster_contacts(OssoABookContact *master_contact)
 
   priv = OSSO_ABOOK_CONTACT_PRIVATE(master_contact);
 
-  if (priv->roster_contacts)
+  if (priv->roster_links)
   {
-    GHashTableIter iter;
-    struct roster_link *link;
+    int i;
 
-    g_hash_table_iter_init(&iter, priv->roster_contacts);
+    for (i = priv->roster_links->len - 1; i >= 0; i--)
+    {
+      struct roster_link *link = priv->roster_links->pdata[i];
 
-    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&link))
       contacts = g_list_prepend(contacts, link->roster_contact);
+    }
   }
 
   return contacts;
 }
 
+void
+_osso_abook_contact_roster_iter_init(OssoABookContactRosterIter *iter,
+                                     OssoABookContact *master_contact)
+{
+  g_return_if_fail(NULL != iter);
+  g_return_if_fail(OSSO_ABOOK_IS_CONTACT(master_contact));
+
+  iter->master_contact = master_contact;
+  iter->index = 0;
+}
+
+gboolean
+_osso_abook_contact_roster_iter_next(OssoABookContactRosterIter *iter,
+                                     OssoABookContact **roster_contact)
+{
+  OssoABookContactPrivate *priv;
+  struct roster_link *link;
+
+  g_return_val_if_fail(NULL != iter, FALSE);
+
+  priv = OSSO_ABOOK_CONTACT_PRIVATE(iter->master_contact);
+
+  if (!priv->roster_links || (iter->index >= priv->roster_links->len))
+    return FALSE;
+
+  link = priv->roster_links->pdata[iter->index++];
+
+  if (roster_contact)
+    *roster_contact = link->roster_contact;
+
+  return TRUE;
+}
+
+gboolean
+_osso_abook_contact_has_roster_contact(OssoABookContact *master_contact,
+                                       OssoABookContact *roster_contact)
+{
+  OssoABookContactPrivate *priv;
+  struct roster_link *link;
+  const char *roster_uid;
+
+  g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(master_contact), FALSE);
+  g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(roster_contact), FALSE);
+
+  priv = OSSO_ABOOK_CONTACT_PRIVATE(master_contact);
+  roster_uid = e_contact_get_const(E_CONTACT(roster_contact), E_CONTACT_UID);
+  link = find_roster_link(priv, roster_uid);
+
+  return link && link->roster_contact == roster_contact;
+}
+
+const char *
+_osso_abook_contact_get_photo_checksum(OssoABookContact *contact)
+{
+  OssoABookContactPrivate *priv;
+  EVCardAttribute *attr;
+  GChecksum *checksum;
+  GList *l;
+
+  g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(contact), NULL);
+
+  priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
+
+  if (priv->photo_checksum)
+    return priv->photo_checksum;
+
+  attr = e_vcard_get_attribute(E_VCARD(contact), EVC_PHOTO);
+
+  if (!attr)
+    return NULL;
+
+  checksum = g_checksum_new(G_CHECKSUM_SHA1);
+
+  for (l = e_vcard_attribute_get_values(attr); l; l = l->next)
+  {
+    const char *value = l->data;
+
+    if (!value)
+      continue;
+
+    g_checksum_update(checksum, (const guchar *)value, -1);
+
+    /* the file behind an URI might be replaced in place */
+    if (g_str_has_prefix(value, FILE_SCHEME))
+    {
+      gchar *filename = g_filename_from_uri(value, NULL, NULL);
+      struct stat st;
+
+      if (filename && !g_stat(filename, &st))
+      {
+        gint64 stamp[2] = { st.st_mtime, st.st_size };
+
+        g_checksum_update(checksum, (const guchar *)stamp, sizeof(stamp));
+      }
+
+      g_free(filename);
+    }
+  }
+
+  priv->photo_checksum = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+
+  return priv->photo_checksum;
+}
+
 gboolean
 osso_abook_contact_is_roster_contact(OssoABookContact *contact)
 {
@@ -1445,29 +1733,23 @@ osso_abook_contact_get_name_components(EContact *contact,
 
   if (OSSO_ABOOK_IS_CONTACT(contact))
   {
-    GHashTable *contacts =
-      OSSO_ABOOK_CONTACT_PRIVATE(OSSO_ABOOK_CONTACT(contact))->roster_contacts;
+    OssoABookContactRosterIter iter;
+    OssoABookContact *roster_contact;
 
-    if (contacts)
-    {
-      GHashTableIter iter;
-      struct roster_link *link;
-
-      g_hash_table_iter_init(&iter, contacts);
+    _osso_abook_contact_roster_iter_init(&iter, OSSO_ABOOK_CONTACT(contact));
 
-      while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&link))
-      {
-        osso_abook_contact_get_name_components(E_CONTACT(link->roster_contact),
-                                               order,
-                                               FALSE,
-                                               &primary,
-                                               &secondary);
+    while (_osso_abook_contact_roster_iter_next(&iter, &roster_contact))
+    {
+      osso_abook_contact_get_name_components(E_CONTACT(roster_contact),
+                                             order,
+                                             FALSE,
+                                             &primary,
+                                             &secondary);
 
-        if (primary && *primary)
-          break;
+      if (primary && *primary)
+        break;
 
-        g_free(secondary);
-      }
+      g_free(secondary);
     }
   }
 
@@ -1625,12 +1907,187 @@ osso_abook_contact_attribute_is_readonly(EVCardAttribute *attribute)
   return FALSE;
 }
 
+static OssoABookContactFields
+attribute_get_field(EVCardAttribute *attr)
+{
+  const char *name = e_vcard_attribute_get_name(attr);
+  OssoABookContactFields field = OSSO_ABOOK_CONTACT_FIELD_OTHER;
+  gchar *up;
+  GQuark quark;
+
+  if (!name)
+    return field;
+
+  up = g_ascii_strup(name, -1);
+  quark = g_quark_try_string(up);
+  g_free(up);
+
+  if ((quark == OSSO_ABOOK_QUARK_VCA_N) ||
+      (quark == OSSO_ABOOK_QUARK_VCA_FN) ||
+      (quark == OSSO_ABOOK_QUARK_VCA_ORG) ||
+      (quark == OSSO_ABOOK_QUARK_VCA_NICKNAME))
+  {
+    field = OSSO_ABOOK_CONTACT_FIELD_NAME;
+  }
+  else if (quark == OSSO_ABOOK_QUARK_VCA_TEL)
+    field = OSSO_ABOOK_CONTACT_FIELD_TEL;
+  else if (quark == OSSO_ABOOK_QUARK_VCA_EMAIL)
+    field = OSSO_ABOOK_CONTACT_FIELD_EMAIL;
+  else if (quark == OSSO_ABOOK_QUARK_VCA_PHOTO)
+    field = OSSO_ABOOK_CONTACT_FIELD_PHOTO;
+  else if ((quark == OSSO_ABOOK_QUARK_VCA_TELEPATHY_PRESENCE) ||
+           (quark == OSSO_ABOOK_QUARK_VCA_TELEPATHY_CAPABILITIES))
+  {
+    field = OSSO_ABOOK_CONTACT_FIELD_PRESENCE;
+  }
+  else if (is_vcard_field(quark, name))
+    field = OSSO_ABOOK_CONTACT_FIELD_IM_FIELDS;
+
+  return field;
+}
+
+static gboolean
+string_lists_equal(GList *a, GList *b)
+{
+  for (; a && b; a = a->next, b = b->next)
+  {
+    if (g_strcmp0(a->data, b->data))
+      return FALSE;
+  }
+
+  return !a && !b;
+}
+
+static gboolean
+attributes_equal(EVCardAttribute *a, EVCardAttribute *b)
+{
+  GList *pa = e_vcard_attribute_get_params(a);
+  GList *pb = e_vcard_attribute_get_params(b);
+
+  if (g_strcmp0(e_vcard_attribute_get_name(a), e_vcard_attribute_get_name(b)) ||
+      g_strcmp0(e_vcard_attribute_get_group(a), e_vcard_attribute_get_group(b)))
+  {
+    return FALSE;
+  }
+
+  for (; pa && pb; pa = pa->next, pb = pb->next)
+  {
+    if (g_strcmp0(e_vcard_attribute_param_get_name(pa->data),
+                  e_vcard_attribute_param_get_name(pb->data)) ||
+        !string_lists_equal(e_vcard_attribute_param_get_values(pa->data),
+                            e_vcard_attribute_param_get_values(pb->data)))
+    {
+      return FALSE;
+    }
+  }
+
+  if (pa || pb)
+    return FALSE;
+
+  return string_lists_equal(e_vcard_attribute_get_values(a),
+                            e_vcard_attribute_get_values(b));
+}
+
+#define FIELD_COUNT 7
+
+G_STATIC_ASSERT(OSSO_ABOOK_CONTACT_FIELD_ALL == (1 << FIELD_COUNT) - 1);
+
+/* Compares the attributes osso_abook_contact_reset() would replace in
+ * contact with the ones of replacement, field by field. */
+OssoABookContactFields
+_osso_abook_contact_diff(OssoABookContact *contact,
+                         OssoABookContact *replacement)
+{
+  OssoABookContactFields fields = 0;
+  GList *old_attrs[FIELD_COUNT];
+  GList *new_attrs[FIELD_COUNT];
+  GList *l;
+  int i;
+
+  g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(contact),
+                       OSSO_ABOOK_CONTACT_FIELD_ALL);
+  g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(replacement),
+                       OSSO_ABOOK_CONTACT_FIELD_ALL);
+
+  memset(old_attrs, 0, sizeof(old_attrs));
+  memset(new_attrs, 0, sizeof(new_attrs));
+
+  for (l = e_vcard_get_attributes(E_VCARD(contact)); l; l = l->next)
+  {
+    if (!osso_abook_contact_attribute_is_readonly(l->data))
+    {
+      i = g_bit_nth_lsf(attribute_get_field(l->data), -1);
+      old_attrs[i] = g_list_prepend(old_attrs[i], l->data);
+    }
+  }
+
+  for (l = e_vcard_get_attributes(E_VCARD(replacement)); l; l = l->next)
+  {
+    i = g_bit_nth_lsf(attribute_get_field(l->data), -1);
+    new_attrs[i] = g_list_prepend(new_attrs[i], l->data);
+  }
+
+  for (i = 0; i < FIELD_COUNT; i++)
+  {
+    GList *a = old_attrs[i];
+    GList *b = new_attrs[i];
+
+    while (a && b && attributes_equal(a->data, b->data))
+    {
+      a = a->next;
+      b = b->next;
+    }
+
+    if (a || b)
+      fields |= 1 << i;
+
+    g_list_free(old_attrs[i]);
+    g_list_free(new_attrs[i]);
+  }
+
+  return fields;
+}
+
+OssoABookContactFields
+_osso_abook_contact_get_changed_fields(OssoABookContact *contact)
+{
+  g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(contact),
+                       OSSO_ABOOK_CONTACT_FIELD_ALL);
+
+  return OSSO_ABOOK_CONTACT_PRIVATE(contact)->changed_fields;
+}
+
+void
+_osso_abook_contact_clear_changed_fields(OssoABookContact *contact)
+{
+  g_return_if_fail(OSSO_ABOOK_IS_CONTACT(contact));
+
+  OSSO_ABOOK_CONTACT_PRIVATE(contact)->changed_fields =
+    OSSO_ABOOK_CONTACT_FIELD_ALL;
+}
+
 void
 osso_abook_contact_reset(OssoABookContact *contact,
                          OssoABookContact *replacement)
+{
+  g_return_if_fail(OSSO_ABOOK_IS_CONTACT(contact));
+  g_return_if_fail(OSSO_ABOOK_IS_CONTACT(replacement));
+
+  _osso_abook_contact_reset_with_fields(
+    contact, replacement, _osso_abook_contact_diff(contact, replacement));
+}
+
+/* Like osso_abook_contact_reset(), with fields already computed by
+ * _osso_abook_contact_diff(). */
+void
+_osso_abook_contact_reset_with_fields(OssoABookContact *contact,
+                                      OssoABookContact *replacement,
+                                      OssoABookContactFields fields)
 {
   OssoABookContactPrivate *priv;
+  gchar *old_names[OSSO_ABOOK_NAME_ORDER_COUNT];
   GList *l;
+  int i;
 
   g_return_if_fail(OSSO_ABOOK_IS_CONTACT(contact));
   g_return_if_fail(OSSO_ABOOK_IS_CONTACT(replacement));
@@ -1639,6 +2096,20 @@ osso_abook_contact_reset(OssoABookContact *contact,
 
   g_return_if_fail(!priv->disposed);
 
+  /* the display name also falls back to email and IM fields, so compare
+   * the names themselves for all orders somebody already asked for */
+  for (i = 0; i < OSSO_ABOOK_NAME_ORDER_COUNT; i++)
+  {
+    if (!(fields & OSSO_ABOOK_CONTACT_FIELD_NAME) &&
+        (priv->name[i] || priv->collate_keys[i]))
+    {
+      old_names[i] = g_strdup(
+        osso_abook_contact_get_name_with_order(contact, i));
+    }
+    else
+      old_names[i] = NULL;
+  }
+
   g_object_freeze_notify(G_OBJECT(contact));
   priv->resetting = TRUE;
 
@@ -1661,6 +2132,22 @@ osso_abook_contact_reset(OssoABookContact *contact,
   priv->resetting = FALSE;
   parse_capabilities(contact, priv);
   parse_presence(contact, priv);
+
+  for (i = 0; i < OSSO_ABOOK_NAME_ORDER_COUNT; i++)
+  {
+    if (old_names[i])
+    {
+      if (g_strcmp0(old_names[i],
+                    osso_abook_contact_get_name_with_order(contact, i)))
+      {
+        fields |= OSSO_ABOOK_CONTACT_FIELD_NAME;
+      }
+
+      g_free(old_names[i]);
+    }
+  }
+
+  priv->changed_fields = fields;
   g_object_thaw_notify(G_OBJECT(contact));
   g_signal_emit(contact, signals[RESET], 0);
 }
@@ -1828,25 +2315,19 @@ update_combined_capabilities(OssoABookContact *master_contact)
 {
   OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(master_contact);
   OssoABookCapsFlags _caps = priv->caps;
+  int i;
 
-  if (priv->roster_contacts)
+  for (i = 0; priv->roster_links && (i < priv->roster_links->len); i++)
   {
-    struct roster_link *link;
-    GHashTableIter iter;
-
-    g_hash_table_iter_init(&iter, priv->roster_contacts);
-
-    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&link))
-    {
-      OssoABookContactPrivate *roster_priv =
-        OSSO_ABOOK_CONTACT_PRIVATE(link->roster_contact);
+    struct roster_link *link = priv->roster_links->pdata[i];
+    OssoABookContactPrivate *roster_priv =
+      OSSO_ABOOK_CONTACT_PRIVATE(link->roster_contact);
 
-      _caps |= osso_abook_caps_get_capabilities(
-        OSSO_ABOOK_CAPS(link->roster_contact));
+    _caps |= osso_abook_caps_get_capabilities(
+      OSSO_ABOOK_CAPS(link->roster_contact));
 
-      if (roster_priv->is_tel)
-        priv->is_tel = TRUE;
-    }
+    if (roster_priv->is_tel)
+      priv->is_tel = TRUE;
   }
 
   if (priv->combined_caps != _caps)
@@ -1864,24 +2345,27 @@ osso_abook_contact_detach(OssoABookContact *master_contact,
 {
   OssoABookContactPrivate *priv;
   OssoABookPresence *presence;
+  struct roster_link *link;
   const char *roster_uid;
   const char *master_uid;
 
   g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(master_contact), FALSE);
   g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(roster_contact), FALSE);
 
-  priv = OSSO_ABOOK_CONTACT_PRIVATE(roster_contact);
+  priv = OSSO_ABOOK_CONTACT_PRIVATE(master_contact);
   presence = OSSO_ABOOK_PRESENCE(roster_contact);
   roster_uid = e_contact_get_const(E_CONTACT(roster_contact), E_CONTACT_UID);
   master_uid = e_contact_get_const(E_CONTACT(master_contact), E_CONTACT_UID);
 
   osso_abook_contact_remove_master_uid(roster_contact, master_uid);
 
-  if (!priv->roster_contacts ||
-      !g_hash_table_remove(priv->roster_contacts, roster_uid))
-  {
+  link = find_roster_link(priv, roster_uid);
+
+  if (!link)
     return FALSE;
-  }
+
+  g_ptr_array_remove(priv->roster_links, link);
+  priv->server_image_valid = FALSE;
 
   if (priv->presence == presence)
     connect_signals(master_contact, NULL);
@@ -1952,12 +2436,13 @@ notify_avatar_image_cb(GObject *gobject, GParamSpec *pspec, gpointer user_data)
   OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
   const char *roster_uid;
   struct roster_link *link;
+  guint i;
 
   roster_uid = e_contact_get_const(E_CONTACT(gobject), E_CONTACT_UID);
 
   g_return_if_fail(NULL != roster_uid);
 
-  link = g_hash_table_lookup(priv->roster_contacts, roster_uid);
+  link = find_roster_link(priv, roster_uid);
 
   g_return_if_fail(NULL != link);
 
@@ -1965,6 +2450,16 @@ notify_avatar_image_cb(GObject *gobject, GParamSpec *pspec, gpointer user_data)
 
   if (avatar_id == G_MAXUSHORT)
     avatar_id = 1;
+
+  /* keep the most recently changed avatar first */
+  for (i = 0; priv->roster_links->pdata[i] != link; i++)
+    ;
+
+  memmove(&priv->roster_links->pdata[1], &priv->roster_links->pdata[0],
+          i * sizeof(gpointer));
+  priv->roster_links->pdata[0] = link;
+
+  priv->server_image_valid = FALSE;
 }
 
 static void
@@ -1980,15 +2475,13 @@ choose_presence_contact(OssoABookContact *master_contact)
   OssoABookContactPrivate *priv = OSSO_ABOOK_CONTACT_PRIVATE(master_contact);
   OssoABookPresence *presence = priv->presence;
 
-  if (!presence && priv->roster_contacts)
+  if (!presence && priv->roster_links)
   {
-    struct roster_link *link = NULL;
-    GHashTableIter iter;
-
-    g_hash_table_iter_init(&iter, priv->roster_contacts);
+    int i;
 
-    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&link))
+    for (i = 0; i < priv->roster_links->len; i++)
     {
+      struct roster_link *link = priv->roster_links->pdata[i];
       OssoABookPresence *roster_presence;
 
       g_assert(link->roster_contact != master_contact);
@@ -2046,6 +2539,7 @@ roster_contact_free(gpointer data)
     connect_signals(link->master_contact, NULL);
 
   g_object_unref(link->roster_contact);
+  g_free(link->roster_uid);
   g_slice_free(struct roster_link, link);
 }
 
@@ -2072,13 +2566,10 @@ osso_abook_contact_attach(OssoABookContact *master_contact,
   g_return_val_if_fail(NULL != master_uid, FALSE);
   g_return_val_if_fail(NULL != roster_uid, FALSE);
 
-  if (!priv->roster_contacts)
-  {
-    priv->roster_contacts = g_hash_table_new_full(
-      g_str_hash, g_str_equal, g_free, roster_contact_free);
-  }
+  if (!priv->roster_links)
+    priv->roster_links = g_ptr_array_new_with_free_func(roster_contact_free);
 
-  link = g_hash_table_lookup(priv->roster_contacts, roster_uid);
+  link = find_roster_link(priv, roster_uid);
   OSSO_ABOOK_NOTE(VCARD, "attaching %s(%p) on %s(%p)", roster_uid,
                   roster_contact, master_uid, master_contact);
 
@@ -2089,6 +2580,7 @@ osso_abook_contact_attach(OssoABookContact *master_contact,
     new_link->master_contact = master_contact;
     new_link->avatar_id = 0;
     new_link->roster_contact = g_object_ref(roster_contact);
+    new_link->roster_uid = g_strdup(roster_uid);
 
     g_signal_connect(roster_contact, "notify::avatar-image",
                      G_CALLBACK(notify_avatar_image_cb), master_contact);
@@ -2096,10 +2588,27 @@ osso_abook_contact_attach(OssoABookContact *master_contact,
                      G_CALLBACK(notify_capabilities_cb), master_contact);
     g_signal_connect(roster_contact, "notify::presence-type",
                      G_CALLBACK(notify_presence_type_cb), master_contact);
-    g_hash_table_insert(priv->roster_contacts, g_strdup(roster_uid), new_link);
 
-    if (!link && !osso_abook_is_temporary_uid(master_uid))
-      osso_abook_contact_add_master_uid(roster_contact, master_uid);
+    if (link)
+    {
+      guint i;
+
+      /* replace the link of the old instance in place */
+      for (i = 0; priv->roster_links->pdata[i] != link; i++)
+        ;
+
+      priv->roster_links->pdata[i] = new_link;
+      roster_contact_free(link);
+    }
+    else
+    {
+      g_ptr_array_add(priv->roster_links, new_link);
+
+      if (!osso_abook_is_temporary_uid(master_uid))
+        osso_abook_contact_add_master_uid(roster_contact, master_uid);
+    }
+
+    priv->server_image_valid = FALSE;
   }
 
   roster_presence = OSSO_ABOOK_PRESENCE(roster_contact);
@@ -2270,14 +2779,13 @@ osso_abook_contact_real_find_roster_contacts(OssoABookContact *master_contact,
   OssoABookContactPrivate *priv;
   gchar *vcard_field = NULL;
   GList *roster_contacts = NULL;
-  GHashTableIter iter;
-  struct roster_link *link;
+  int i;
 
   g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(master_contact), NULL);
 
   priv = OSSO_ABOOK_CONTACT_PRIVATE(master_contact);
 
-  if (!priv->roster_contacts)
+  if (!priv->roster_links || !priv->roster_links->len)
     return NULL;
 
   if (data->account_id)
@@ -2300,10 +2808,9 @@ osso_abook_contact_real_find_roster_contacts(OssoABookContact *master_contact,
       return NULL;
   }
 
-  g_hash_table_iter_init(&iter, priv->roster_contacts);
-
-  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&link))
+  for (i = 0; i < priv->roster_links->len; i++)
   {
+    struct roster_link *link = priv->roster_links->pdata[i];
     OssoABookRoster *roster =
       osso_abook_contact_get_roster(link->roster_contact);
     const char *roster_vcard_field = data->vcard_field;
@@ -2675,16 +3182,16 @@ osso_abook_contact_get_persistent_uid(OssoABookContact *contact)
 
   priv = OSSO_ABOOK_CONTACT_PRIVATE(contact);
 
-  if (priv->roster_contacts)
+  if (priv->roster_links)
   {
-    GHashTableIter iter;
-
-    g_hash_table_iter_init(&iter, priv->roster_contacts);
+    int i;
 
-    while (g_hash_table_iter_next(&iter, (gpointer *)&uid, NULL))
+    for (i = 0; i < priv->roster_links->len; i++)
     {
-      if (uid && *uid)
-        return uid;
+      struct roster_link *link = priv->roster_links->pdata[i];
+
+      if (*link->roster_uid)
+        return link->roster_uid;
     }
   }
 
@@ -2736,12 +3243,7 @@ osso_abook_contact_set_pixbuf(OssoABookContact *contact, GdkPixbuf *pixbuf,
   {
     append_last_photo_uri(contact);
     e_contact_set(E_CONTACT(contact), E_CONTACT_PHOTO, NULL);
-
-    if (priv->avatar_image)
-    {
-      g_object_unref(priv->avatar_image);
-      priv->avatar_image = NULL;
-    }
+    avatar_image_reset(priv);
   }
 
   if (!pixbuf || (priv->avatar_image == pixbuf))
@@ -2780,7 +3282,9 @@ osso_abook_contact_set_pixbuf(OssoABookContact *contact, GdkPixbuf *pixbuf,
       e_contact_set(E_CONTACT(contact), E_CONTACT_PHOTO, photo);
     }
 
+    avatar_image_reset(priv);
     priv->avatar_image = pixbuf;
+    priv->avatar_decoded = TRUE;
 
     if (book)
       osso_abook_contact_commit(contact, 0, book, window);
@@ -3368,14 +3872,14 @@ osso_abook_contact_fetch_roster_info(OssoABookContact *contact)
 gboolean
 osso_abook_contact_has_roster_contacts(OssoABookContact *master_contact)
 {
-  GHashTable *roster_contacts;
+  GPtrArray *roster_links;
 
   g_return_val_if_fail(OSSO_ABOOK_IS_CONTACT(master_contact), FALSE);
 
-  roster_contacts = OSSO_ABOOK_CONTACT_PRIVATE(master_contact)->roster_contacts;
+  roster_links = OSSO_ABOOK_CONTACT_PRIVATE(master_contact)->roster_links;
 
-  if (roster_contacts)
-    return g_hash_table_size(roster_contacts) != 0;
+  if (roster_links)
+    return roster_links->len != 0;
 
   return FALSE;
 }
@@ -3499,15 +4003,16 @@ osso_abook_contact_delete(OssoABookContact *contact, EBook *book,
   append_last_photo_uri(contact);
   delete_temporary_photo_files(contact);
 
-  if (priv->roster_contacts)
+  if (priv->roster_links)
   {
-    GHashTableIter iter;
-    struct roster_link *link;
-
-    g_hash_table_iter_init(&iter, priv->roster_contacts);
+    GList *l;
 
-    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&link))
-      osso_abook_contact_reject_for_uid(link->roster_contact, uid, window);
+    /* rejecting might detach, don't walk the links directly */
+    for (l = osso_abook_contact_get_roster_contacts(contact); l;
+         l = g_list_delete_link(l, l))
+    {
+      osso_abook_contact_reject_for_uid(l->data, uid, window);
+    }
   }
 
   if (!osso_abook_is_temporary_uid(uid))
@@ -3794,26 +4299,8 @@ osso_abook_contact_to_string(OssoABookContact *contact, EVCardFormat format,
       e_contact_photo_free(photo);
     }
 
-    if (!is_inlined && !data && priv->roster_contacts)
-    {
-      struct roster_link *link;
-      GPtrArray *links = g_ptr_array_new();
-      GHashTableIter iter;
-
-      g_hash_table_iter_init(&iter, priv->roster_contacts);
-
-      while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&link))
-        g_ptr_array_add(links, link);
-
-      if (links->len)
-      {
-        g_ptr_array_sort(links, compare_roster_contacts);
-
-        data = get_roster_avatar_data(links);
-
-        g_ptr_array_free(links, TRUE);
-      }
-    }
+    if (!is_inlined && !data && priv->roster_links)
+      data = get_roster_avatar_data(priv->roster_links);
 
     if (data)
     {
@@ -4161,11 +4648,8 @@ osso_abook_contact_shortcut_exists(OssoABookContact *contact, GSList **ret_list)
       if (!strcmp(applet_uid, uid))
         break;
 
-      if (priv->roster_contacts)
-      {
-        if (g_hash_table_lookup(priv->roster_contacts, applet_uid))
-          break;
-      }
+      if (find_roster_link(priv, applet_uid))
+        break;
     }
   }
 
@@ -4273,14 +4757,15 @@ osso_abook_contact_delete_many(GList *contacts, EBook *book, GtkWindow *window)
       append_last_photo_uri(contact);
       delete_temporary_photo_files(contact);
 
-      if (priv->roster_contacts)
+      if (priv->roster_links)
       {
-        struct roster_link *link;
-
-        g_hash_table_iter_init(&iter, priv->roster_contacts);
+        GList *l;
 
-        while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&link))
-          osso_abook_contact_reject_for_uid(link->roster_contact, uid, window);
+        for (l = osso_abook_contact_get_roster_contacts(contact); l;
+             l = g_list_delete_link(l, l))
+        {
+          osso_abook_contact_reject_for_uid(l->data, uid, window);
+        }
       }
 
       if (!osso_abook_is_temporary_uid(uid))
@@ -4359,8 +4844,8 @@ gboolean
 osso_abook_contact_can_request_auth(OssoABookContact *contact,
                                     const char **infoprint)
 {
-  GHashTableIter iter;
-  struct roster_link *rl;
+  OssoABookContactRosterIter iter;
+  OssoABookContact *rc;
   OssoABookContactPrivate *priv;
   TpConnectionPresenceType presence;
   OssoABookCapsFlags caps;
@@ -4383,8 +4868,8 @@ osso_abook_contact_can_request_auth(OssoABookContact *contact,
 
   caps = osso_abook_caps_get_capabilities(OSSO_ABOOK_CAPS(contact));
 
-  if(!priv->roster_contacts ||
-     (!g_hash_table_size(priv->roster_contacts) &&
+  if(!priv->roster_links ||
+     (!priv->roster_links->len &&
       !(caps & (OSSO_ABOOK_CAPS_CHAT | OSSO_ABOOK_CAPS_VOICE))))
   {
     if (infoprint)
@@ -4393,12 +4878,10 @@ osso_abook_contact_can_request_auth(OssoABookContact *contact,
     return FALSE;
   }
 
-  g_hash_table_iter_init(&iter, priv->roster_contacts);
+  _osso_abook_contact_roster_iter_init(&iter, contact);
 
-  while (g_hash_table_iter_next(&iter, 0, (gpointer *)&rl))
+  while (_osso_abook_contact_roster_iter_next(&iter, &rc))
   {
-    OssoABookContact *rc = rl->roster_contact;
-
     if (!(osso_abook_caps_get_capabilities(OSSO_ABOOK_CAPS(rc)) &
           OSSO_ABOOK_CAPS_ADDRESSBOOK))
     {
@@ -1,10 +1,48 @@
+#include <glib-unix.h>
+
+#include <signal.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "osso-abook-debug.h"
 
 #define PHOTO_ID "PHOTO"
 
+/* histogram buckets hold values below 2^i, the last one catches the rest */
+#define STAT_BUCKETS 32
+/* most recent timer spans kept for the trace export */
+#define MAX_TRACE_EVENTS 16384
+
 guint _osso_abook_debug_flags = 0;
+gboolean _osso_abook_stats_enabled = FALSE;
+
+struct _OssoABookStat
+{
+  const char *name;
+  gboolean histogram;
+  guint64 count;
+  gint64 sum;
+  gint64 min;
+  gint64 max;
+  guint64 buckets[STAT_BUCKETS];
+};
+
+typedef struct
+{
+  OssoABookStat *stat;
+  GThread *thread;
+  gint64 start;
+  gint64 duration;
+} TraceEvent;
+
+G_LOCK_DEFINE_STATIC(stats);
+static GHashTable *stats_by_name = NULL;
+static GPtrArray *stats_list = NULL;
+static TraceEvent *trace_events = NULL;
+static guint64 n_trace_events = 0;
+static gint64 stats_epoch = 0;
+static gchar *stats_filename = NULL;
 
 static GDebugKey debug_keys[] =
 {
@@ -40,15 +78,54 @@ _osso_abook_debug_timestamp()
   return g_timer_elapsed(_osso_debug_timer, NULL);
 }
 
+static gboolean
+dump_stats_cb(gpointer user_data)
+{
+  GError *error = NULL;
+
+  if (!_osso_abook_stats_dump(stats_filename, &error))
+  {
+    g_warning("%s: Cannot write statistics to %s: %s", __FUNCTION__,
+              stats_filename, error->message);
+    g_clear_error(&error);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+dump_stats_at_exit(void)
+{
+  dump_stats_cb(NULL);
+}
+
+/* OSSO_ABOOK_STATS names the file to dump to, on SIGUSR2 and at exit */
+static void
+init_stats(const gchar *filename)
+{
+  stats_filename = g_strdup(filename);
+  stats_epoch = g_get_monotonic_time();
+  stats_by_name = g_hash_table_new(g_str_hash, g_str_equal);
+  stats_list = g_ptr_array_new();
+  trace_events = g_new0(TraceEvent, MAX_TRACE_EVENTS);
+
+  g_unix_signal_add(SIGUSR2, dump_stats_cb, NULL);
+  atexit(dump_stats_at_exit);
+
+  _osso_abook_stats_enabled = TRUE;
+}
+
 void
 osso_abook_debug_init(void)
 {
   const gchar *env_debug;
+  const gchar *env_stats;
 
   if (_osso_debug_timer)
     return;
 
   env_debug = g_getenv("OSSO_ABOOK_DEBUG");
+  env_stats = g_getenv("OSSO_ABOOK_STATS");
   _osso_debug_timer_name = g_quark_from_static_string("osso-debug-timer-name");
   _osso_debug_timer_domain =
     g_quark_from_static_string("osso-debug-timer-domain");
@@ -68,6 +145,9 @@ osso_abook_debug_init(void)
 
     g_free(debug_string);
   }
+
+  if (env_stats && *env_stats)
+    init_stats(env_stats);
 }
 
 void
@@ -219,3 +299,216 @@ _osso_abook_timer_mark(const char *strloc, const char *strfunc, GTimer *timer)
     }
   }
 }
+
+OssoABookStat *
+_osso_abook_stat_lookup(const char *name, const char *strfunc,
+                        gboolean histogram)
+{
+  OssoABookStat *stat;
+
+  if (!name)
+    name = strfunc;
+
+  G_LOCK(stats);
+
+  stat = g_hash_table_lookup(stats_by_name, name);
+
+  if (!stat)
+  {
+    stat = g_new0(OssoABookStat, 1);
+    stat->name = g_intern_string(name);
+    stat->histogram = histogram;
+    stat->min = G_MAXINT64;
+    stat->max = G_MININT64;
+    g_hash_table_insert(stats_by_name, (gpointer)stat->name, stat);
+    g_ptr_array_add(stats_list, stat);
+  }
+
+  G_UNLOCK(stats);
+
+  return stat;
+}
+
+static void
+stat_add_unlocked(OssoABookStat *stat, gint64 value)
+{
+  stat->sum += value;
+
+  if (!stat->histogram)
+    return;
+
+  stat->count++;
+
+  if (value < stat->min)
+    stat->min = value;
+
+  if (value > stat->max)
+    stat->max = value;
+
+  if (value <= 0)
+    stat->buckets[0]++;
+  else
+  {
+    guint bucket = g_bit_storage((gulong)MIN(value, G_MAXUINT32));
+
+    stat->buckets[MIN(bucket, STAT_BUCKETS - 1)]++;
+  }
+}
+
+void
+_osso_abook_stat_add(OssoABookStat *stat, gint64 value)
+{
+  G_LOCK(stats);
+  stat_add_unlocked(stat, value);
+  G_UNLOCK(stats);
+}
+
+void
+_osso_abook_stat_span(OssoABookStat *stat, gint64 start)
+{
+  gint64 duration = g_get_monotonic_time() - start;
+  TraceEvent *event;
+
+  G_LOCK(stats);
+
+  stat_add_unlocked(stat, duration);
+
+  event = &trace_events[n_trace_events++ % MAX_TRACE_EVENTS];
+  event->stat = stat;
+  event->thread = g_thread_self();
+  event->start = start;
+  event->duration = duration;
+
+  G_UNLOCK(stats);
+}
+
+static void
+append_json_string(GString *json, const char *str)
+{
+  g_string_append_c(json, '"');
+
+  for (; *str; str++)
+  {
+    if (*str == '"' || *str == '\\')
+      g_string_append_printf(json, "\\%c", *str);
+    else if ((guchar)*str < 0x20)
+      g_string_append_printf(json, "\\u%04x", *str);
+    else
+      g_string_append_c(json, *str);
+  }
+
+  g_string_append_c(json, '"');
+}
+
+/* writes the counters, histograms and recent timer spans as JSON object that
+ * also is a valid trace file for chrome://tracing */
+gboolean
+_osso_abook_stats_dump(const char *filename, GError **error)
+{
+  GHashTable *thread_ids;
+  GString *json;
+  guint64 first;
+  guint64 i;
+  gint64 now;
+  gboolean rv;
+  int pid = getpid();
+
+  g_return_val_if_fail(_osso_abook_stats_enabled, FALSE);
+  g_return_val_if_fail(filename != NULL, FALSE);
+
+  json = g_string_new("{\n\"traceEvents\": [");
+  thread_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  G_LOCK(stats);
+
+  now = g_get_monotonic_time() - stats_epoch;
+
+  if (n_trace_events > MAX_TRACE_EVENTS)
+    first = n_trace_events - MAX_TRACE_EVENTS;
+  else
+    first = 0;
+
+  for (i = first; i < n_trace_events; i++)
+  {
+    TraceEvent *event = &trace_events[i % MAX_TRACE_EVENTS];
+    guint tid = GPOINTER_TO_UINT(g_hash_table_lookup(thread_ids,
+                                                     event->thread));
+
+    if (!tid)
+    {
+      tid = g_hash_table_size(thread_ids) + 1;
+      g_hash_table_insert(thread_ids, event->thread, GUINT_TO_POINTER(tid));
+    }
+
+    g_string_append(json, json->str[json->len - 1] == '[' ? "\n" : ",\n");
+    g_string_append(json, "{\"name\": ");
+    append_json_string(json, event->stat->name);
+    g_string_append_printf(
+      json, ", \"ph\": \"X\", \"ts\": %" G_GINT64_FORMAT
+      ", \"dur\": %" G_GINT64_FORMAT ", \"pid\": %d, \"tid\": %u}",
+      event->start - stats_epoch, event->duration, pid, tid);
+  }
+
+  for (i = 0; i < stats_list->len; i++)
+  {
+    OssoABookStat *stat = g_ptr_array_index(stats_list, i);
+
+    if (stat->histogram)
+      continue;
+
+    g_string_append(json, json->str[json->len - 1] == '[' ? "\n" : ",\n");
+    g_string_append(json, "{\"name\": ");
+    append_json_string(json, stat->name);
+    g_string_append_printf(
+      json, ", \"ph\": \"C\", \"ts\": %" G_GINT64_FORMAT
+      ", \"pid\": %d, \"args\": {\"value\": %" G_GINT64_FORMAT "}}",
+      now, pid, stat->sum);
+  }
+
+  g_string_append(json, "\n],\n\"displayTimeUnit\": \"ms\",\n");
+  g_string_append(json, "\"histograms\": {");
+
+  for (i = 0; i < stats_list->len; i++)
+  {
+    OssoABookStat *stat = g_ptr_array_index(stats_list, i);
+    guint last = 0;
+    guint j;
+
+    if (!stat->histogram)
+      continue;
+
+    for (j = 0; j < STAT_BUCKETS; j++)
+    {
+      if (stat->buckets[j])
+        last = j;
+    }
+
+    g_string_append(json, json->str[json->len - 1] == '{' ? "\n" : ",\n");
+    append_json_string(json, stat->name);
+    g_string_append_printf(
+      json, ": {\"count\": %" G_GUINT64_FORMAT
+      ", \"sum\": %" G_GINT64_FORMAT
+      ", \"min\": %" G_GINT64_FORMAT
+      ", \"max\": %" G_GINT64_FORMAT ", \"buckets\": [",
+      stat->count, stat->sum, stat->count ? stat->min : 0,
+      stat->count ? stat->max : 0);
+
+    for (j = 0; j <= last; j++)
+    {
+      g_string_append_printf(json, "%s%" G_GUINT64_FORMAT, j ? ", " : "",
+                             stat->buckets[j]);
+    }
+
+    g_string_append(json, "]}");
+  }
+
+  G_UNLOCK(stats);
+
+  g_string_append(json, "\n}\n}\n");
+  g_hash_table_destroy(thread_ids);
+
+  rv = g_file_set_contents(filename, json->str, json->len, error);
+  g_string_free(json, TRUE);
+
+  return rv;
+}
@@ -64,6 +64,7 @@ typedef enum {
 
 /* exported, but you should never use it */
 extern guint _osso_abook_debug_flags;
+extern gboolean _osso_abook_stats_enabled;
 
 void
 osso_abook_debug_init                (void);
@@ -122,6 +123,25 @@ _osso_abook_timer_mark               (const char         *strloc,
                                       const char         *strfunc,
                                       GTimer             *timer);
 
+typedef struct _OssoABookStat OssoABookStat;
+
+OssoABookStat *
+_osso_abook_stat_lookup              (const char         *name,
+                                      const char         *strfunc,
+                                      gboolean            histogram);
+
+void
+_osso_abook_stat_add                 (OssoABookStat      *stat,
+                                      gint64              value);
+
+void
+_osso_abook_stat_span                (OssoABookStat      *stat,
+                                      gint64              start);
+
+gboolean
+_osso_abook_stats_dump               (const char         *filename,
+                                      GError            **error);
+
 /**
  * OSSO_ABOOK_TIMER_START:
  * @timer: a #GTimer, or %NULL
@@ -147,6 +167,76 @@ _osso_abook_timer_mark               (const char         *strloc,
 #define OSSO_ABOOK_TIMER_MARK(timer)                                         \
         _osso_abook_timer_mark (G_STRLOC, G_STRFUNC, (timer))
 
+/**
+ * OSSO_ABOOK_COUNT:
+ * @name: the name of the counter, a string literal
+ * @value: the amount to add
+ *
+ * Adds @value to the monotonic counter @name when statistics are enabled
+ * with the OSSO_ABOOK_STATS environment variable.
+ */
+#define OSSO_ABOOK_COUNT(name, value)                   G_STMT_START {       \
+        if (G_UNLIKELY (_osso_abook_stats_enabled)) {                        \
+                static OssoABookStat *_osso_abook_stat = NULL;               \
+                                                                             \
+                if (G_UNLIKELY (!_osso_abook_stat))                          \
+                        _osso_abook_stat = _osso_abook_stat_lookup           \
+                                ((name), NULL, FALSE);                       \
+                                                                             \
+                _osso_abook_stat_add (_osso_abook_stat, (value));            \
+        }                                               } G_STMT_END
+
+/**
+ * OSSO_ABOOK_SAMPLE:
+ * @name: the name of the histogram, a string literal
+ * @value: the sample to record
+ *
+ * Records @value in the histogram @name when statistics are enabled.
+ */
+#define OSSO_ABOOK_SAMPLE(name, value)                  G_STMT_START {       \
+        if (G_UNLIKELY (_osso_abook_stats_enabled)) {                        \
+                static OssoABookStat *_osso_abook_stat = NULL;               \
+                                                                             \
+                if (G_UNLIKELY (!_osso_abook_stat))                          \
+                        _osso_abook_stat = _osso_abook_stat_lookup           \
+                                ((name), NULL, TRUE);                        \
+                                                                             \
+                _osso_abook_stat_add (_osso_abook_stat, (value));            \
+        }                                               } G_STMT_END
+
+/**
+ * OSSO_ABOOK_STAT_TIMER_START:
+ * @name: the name of the latency histogram, a string literal, or %NULL
+ *
+ * Starts measuring the latency of a code block when statistics are enabled.
+ * The measurement is recorded in the histogram @name, or G_STRFUNC when @name
+ * is %NULL, and as trace event.
+ *
+ * Requires a matching OSSO_ABOOK_STAT_TIMER_END() call within the same scope.
+ */
+#define OSSO_ABOOK_STAT_TIMER_START(name)               G_STMT_START {       \
+        static OssoABookStat *_osso_abook_stat_timer = NULL;                 \
+        gint64 _osso_abook_stat_start = 0;                                   \
+                                                                             \
+        if (G_UNLIKELY (_osso_abook_stats_enabled)) {                        \
+                if (G_UNLIKELY (!_osso_abook_stat_timer))                    \
+                        _osso_abook_stat_timer = _osso_abook_stat_lookup     \
+                                ((name), G_STRFUNC, TRUE);                   \
+                                                                             \
+                _osso_abook_stat_start = g_get_monotonic_time ();            \
+        }
+
+/**
+ * OSSO_ABOOK_STAT_TIMER_END:
+ *
+ * Records the latency measured since OSSO_ABOOK_STAT_TIMER_START().
+ */
+#define OSSO_ABOOK_STAT_TIMER_END()                                          \
+        if (G_UNLIKELY (_osso_abook_stat_start)) {                           \
+                _osso_abook_stat_span (_osso_abook_stat_timer,               \
+                                       _osso_abook_stat_start);              \
+        }                                               } G_STMT_END
+
 /**
  * OSSO_ABOOK_LOCAL_TIMER_START:
  * @type: the required debugging flag, see #OssoABookDebugFlags
@@ -154,7 +244,8 @@ _osso_abook_timer_mark               (const char         *strloc,
  *
  * Initializes a local timer object for debugging when the debugging flag
  * described by @type is set. Assigns @name for later reference,
- * or G_STRFUNC when @name is %NULL.
+ * or G_STRFUNC when @name is %NULL. The elapsed time also is recorded
+ * like with OSSO_ABOOK_STAT_TIMER_START().
  *
  * Requires a matching OSSO_ABOOK_LOCAL_TIMER_END() call within the same scope.
  */
@@ -163,7 +254,8 @@ _osso_abook_timer_mark               (const char         *strloc,
                 (_osso_abook_debug_flags & OSSO_ABOOK_DEBUG_##type) ?        \
                  g_timer_new () : NULL);                                     \
                                                                              \
-        OSSO_ABOOK_TIMER_START (_osso_abook_local_timer, type, (name));
+        OSSO_ABOOK_TIMER_START (_osso_abook_local_timer, type, (name));      \
+        OSSO_ABOOK_STAT_TIMER_START (name)
 
 /**
  * OSSO_ABOOK_LOCAL_TIMER_END:
@@ -174,7 +266,8 @@ _osso_abook_timer_mark               (const char         *strloc,
         if (G_UNLIKELY (_osso_abook_local_timer)) {                          \
                 OSSO_ABOOK_TIMER_MARK (_osso_abook_local_timer);             \
                 g_timer_destroy (_osso_abook_local_timer);                   \
-        }                                               } G_STMT_END
+        }                                                                    \
+        OSSO_ABOOK_STAT_TIMER_END ();                   } G_STMT_END
 
 /**
  * OSSO_ABOOK_NOTE:
@@ -250,6 +343,10 @@ _osso_abook_timer_mark               (const char         *strloc,
 #define OSSO_ABOOK_TIMER_MARK(...)
 #define OSSO_ABOOK_LOCAL_TIMER_START(...)
 #define OSSO_ABOOK_LOCAL_TIMER_END()
+#define OSSO_ABOOK_COUNT(...)
+#define OSSO_ABOOK_SAMPLE(...)
+#define OSSO_ABOOK_STAT_TIMER_START(...)
+#define OSSO_ABOOK_STAT_TIMER_END()
 #define OSSO_ABOOK_NOTE(type,format,...)
 #define OSSO_ABOOK_MARK(...)
 #define OSSO_ABOOK_DEBUG_FLAGS(...) (FALSE)
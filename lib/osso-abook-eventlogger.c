@@ -26,10 +26,18 @@
 #include "osso-abook-string-list.h"
 #include "osso-abook-utils-private.h"
 
+/* pending updates are flushed to rtcom in chunks of at most that many */
+#define FLUSH_CHUNK_SIZE 256
+/* bursts of updates within that many seconds end up in one flush */
+#define FLUSH_DELAY 1
+
 static RTComEl *el = NULL;
-static GList *el_uids = NULL;
-static GList *el_contacts = NULL;
+/* removed abook uids, a set */
+static GHashTable *el_uids = NULL;
+/* pending RTComElRemote, a set keyed by (local_uid, remote_uid) */
+static GHashTable *el_contacts = NULL;
 static GHashTable *vcf_attribute_uid = NULL;
+static guint flush_id = 0;
 
 static void
 rtcom_el_remote_destroy(RTComElRemote *remote)
@@ -44,85 +52,160 @@ rtcom_el_remote_destroy(RTComElRemote *remote)
   g_slice_free(RTComElRemote, remote);
 }
 
-void
-_osso_abook_eventlogger_apply()
+static guint
+rtcom_el_remote_hash(gconstpointer v)
 {
-  GList *uid;
-  GList *l;
+  const RTComElRemote *remote = v;
+  guint hash = 0;
 
-  if (!_osso_abook_is_addressbook())
-    return;
+  if (remote->local_uid)
+    hash = g_str_hash(remote->local_uid);
+
+  if (remote->remote_uid)
+    hash = hash * 31 + g_str_hash(remote->remote_uid);
+
+  return hash;
+}
+
+static gboolean
+rtcom_el_remote_equal(gconstpointer a, gconstpointer b)
+{
+  const RTComElRemote *remote_a = a;
+  const RTComElRemote *remote_b = b;
+
+  return !g_strcmp0(remote_a->local_uid, remote_b->local_uid) &&
+         !g_strcmp0(remote_a->remote_uid, remote_b->remote_uid);
+}
+
+/* takes the first FLUSH_CHUNK_SIZE keys out of table */
+static GList *
+steal_chunk(GHashTable *table)
+{
+  GList *chunk = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  int n = 0;
+
+  g_hash_table_iter_init(&iter, table);
+
+  while ((n++ < FLUSH_CHUNK_SIZE) && g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    g_hash_table_iter_steal(&iter);
+    chunk = g_list_prepend(chunk, key);
+  }
+
+  return chunk;
+}
+
+static void
+flush(void)
+{
+  if (flush_id)
+  {
+    g_source_remove(flush_id);
+    flush_id = 0;
+  }
 
   if (!el)
     el = rtcom_el_get_shared();
 
-  for (uid = el_uids; uid; uid = uid->next)
+  if (el_contacts && el_uids && g_hash_table_size(el_uids))
   {
-    for (l = el_contacts; l; l = l->next)
-    {
-      RTComElRemote *remote = l->data;
+    GHashTableIter iter;
+    RTComElRemote *remote;
+
+    /* no point in updating contacts that are gone */
+    g_hash_table_iter_init(&iter, el_contacts);
 
-      if (!g_strcmp0(uid->data, remote->abook_uid))
+    while (g_hash_table_iter_next(&iter, (gpointer *)&remote, NULL))
+    {
+      if (remote->abook_uid &&
+          g_hash_table_contains(el_uids, remote->abook_uid))
       {
-        rtcom_el_remote_destroy(remote);
-        el_contacts = g_list_delete_link(el_contacts, l);
-        break;
+        g_hash_table_iter_remove(&iter);
       }
     }
   }
 
-  if (el_contacts)
+  while (el_contacts && g_hash_table_size(el_contacts))
   {
-    rtcom_el_update_remote_contacts(el, el_contacts, NULL);
+    GList *chunk = steal_chunk(el_contacts);
 
-    for (l = el_contacts; l; el_contacts = l)
-    {
-      rtcom_el_remote_destroy(l->data);
-      l = g_list_delete_link(el_contacts, el_contacts);
-    }
+    rtcom_el_update_remote_contacts(el, chunk, NULL);
+    g_list_free_full(chunk, (GDestroyNotify)rtcom_el_remote_destroy);
   }
 
-  if (el_uids)
+  while (el_uids && g_hash_table_size(el_uids))
   {
-    rtcom_el_remove_abook_uids(el, el_uids, NULL);
-    g_list_free_full(el_uids, g_free);
-    el_uids = NULL;
+    GList *chunk = steal_chunk(el_uids);
+
+    rtcom_el_remove_abook_uids(el, chunk, NULL);
+    g_list_free_full(chunk, g_free);
   }
 }
 
+static gboolean
+flush_cb(gpointer user_data)
+{
+  flush_id = 0;
+  flush();
+
+  return FALSE;
+}
+
+static void
+schedule_flush(void)
+{
+  if (!flush_id)
+    flush_id = g_timeout_add_seconds(FLUSH_DELAY, flush_cb, NULL);
+}
+
+void
+_osso_abook_eventlogger_apply()
+{
+  if (!_osso_abook_is_addressbook())
+    return;
+
+  flush();
+}
+
 static void
 _osso_abook_eventlogger_append(const gchar *local_uid, const gchar *remote_uid,
                                const gchar *abook_uid, const gchar *remote_name)
 {
+  RTComElRemote key = { 0 };
   RTComElRemote *remote;
 
-  if (el_contacts)
+  if (!el_contacts)
   {
-    GList *l;
+    el_contacts = g_hash_table_new_full(
+      rtcom_el_remote_hash, rtcom_el_remote_equal,
+      (GDestroyNotify)rtcom_el_remote_destroy, NULL);
+  }
 
-    for (l = el_contacts; l; l = l->next)
-    {
-      remote = l->data;
+  key.local_uid = (gchar *)local_uid;
+  key.remote_uid = (gchar *)remote_uid;
+  remote = g_hash_table_lookup(el_contacts, &key);
 
-      if (!g_strcmp0(remote->local_uid, local_uid) &&
-          !g_strcmp0(remote->remote_uid, remote_uid))
-      {
-        g_free(remote->abook_uid);
-        g_free(remote->remote_name);
-        remote->abook_uid = g_strdup(abook_uid);
-        remote->remote_name = g_strdup(remote_name);
-        return;
-      }
-    }
+  if (remote)
+  {
+    g_free(remote->abook_uid);
+    g_free(remote->remote_name);
+    remote->abook_uid = g_strdup(abook_uid);
+    remote->remote_name = g_strdup(remote_name);
   }
+  else
+  {
+    remote = g_slice_new0(RTComElRemote);
+    remote->local_uid = g_strdup(local_uid);
+    remote->remote_uid = g_strdup(remote_uid);
+    remote->abook_uid = g_strdup(abook_uid);
+    remote->remote_name = g_strdup(remote_name);
 
-  remote = g_slice_new0(RTComElRemote);
-  remote->local_uid = g_strdup(local_uid);
-  remote->remote_uid = g_strdup(remote_uid);
-  remote->abook_uid = g_strdup(abook_uid);
-  remote->remote_name = g_strdup(remote_name);
+    g_hash_table_add(el_contacts, remote);
+  }
 
-  el_contacts = g_list_prepend(el_contacts, remote);
+  schedule_flush();
 }
 
 void
@@ -401,7 +484,11 @@ _osso_abook_eventlogger_remove(OssoABookContact *contact)
       }
     }
 
-    el_uids = g_list_prepend(el_uids, g_strdup(uid));
+    if (!el_uids)
+      el_uids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    g_hash_table_add(el_uids, g_strdup(uid));
+    schedule_flush();
   }
 }
 
@@ -5,6 +5,8 @@
 
 #include <string.h>
 
+#include "osso-abook-contact-private.h"
+#include "osso-abook-debug.h"
 #include "osso-abook-filter-model.h"
 #include "osso-abook-row-model.h"
 #include "osso-abook-utils-private.h"
@@ -22,8 +24,9 @@ struct _OssoABookFilterModelPrivate
   OssoABookListStore *base_model;
   gchar *text;
   GList *bits;
-  gboolean prefix : 1;
-  gboolean show_unnamed : 1;
+  guint prefix : 1;
+  guint show_unnamed : 1;
+  GHashTable *narrowed_rows;
   OssoABookGroup *group;
   gulong refilter_contact_id;
   gulong refilter_group_id;
@@ -317,7 +320,7 @@ osso_abook_filter_model_set_property(GObject *object, guint property_id,
       break;
     case PROP_PREFIX:
 
-      if (priv->prefix != g_value_get_boolean(value))
+      if (priv->prefix != (g_value_get_boolean(value) != FALSE))
       {
         priv->prefix = !priv->prefix;
         g_object_notify(G_OBJECT(model), "prefix");
@@ -378,66 +381,6 @@ osso_abook_filter_model_class_init(OssoABookFilterModelClass *klass)
       GTK_PARAM_READWRITE));
 }
 
-static gunichar *
-_osso_abook_utf8_strcasestrip(const char *text)
-{
-  gunichar *buf = NULL;
-  size_t bufsize;
-  size_t j = 0;
-  size_t len;
-  const char *p = text;
-  const char *text_end;
-
-  if (!text || !*text)
-    return NULL;
-
-  bufsize = len = strlen(text);
-  text_end = &text[len];
-
-  buf = g_new(gunichar, bufsize + 1);
-
-  while (p < text_end)
-  {
-    gsize i;
-    gunichar d[G_UNICHAR_MAX_DECOMPOSITION_LENGTH];
-    gsize l = g_unichar_fully_decompose(
-      g_utf8_get_char(p), FALSE, d, G_N_ELEMENTS(d));
-
-    for (i = 0; i < l; i++)
-    {
-      gunichar uch = d[i];
-
-      if (j == bufsize)
-      {
-        bufsize += G_UNICHAR_MAX_DECOMPOSITION_LENGTH;
-        buf = g_realloc(buf, (bufsize + 1) * sizeof(gunichar));
-      }
-
-      switch (g_unichar_type(uch))
-      {
-        case G_UNICODE_TITLECASE_LETTER:
-        case G_UNICODE_UPPERCASE_LETTER:
-          buf[j++] = g_unichar_tolower(uch);
-          break;
-        case G_UNICODE_COMBINING_MARK:
-        case G_UNICODE_ENCLOSING_MARK:
-        case G_UNICODE_NON_SPACING_MARK:
-          break;
-        default:
-          buf[j++] = uch;
-          break;
-      }
-    }
-
-    if (!(p = g_utf8_next_char(p)))
-      break;
-  }
-
-  buf[j] = 0;
-
-  return buf;
-}
-
 static const gchar *
 _osso_abook_utf8_strstrcasestrip(const char *str1, const gunichar *str2,
                                  gsize *bytes_read)
@@ -567,27 +510,178 @@ out:
   return rv;
 }
 
+static gboolean
+ucs4_has_prefix(const gunichar *str, const gunichar *prefix)
+{
+  while (*prefix)
+  {
+    if (*str++ != *prefix++)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static const gunichar *
+ucs4_strchr(const gunichar *str, gunichar c)
+{
+  for (; *str; str++)
+  {
+    if (*str == c)
+      return str;
+  }
+
+  return NULL;
+}
+
+static gboolean
+ucs4_contains(const gunichar *str, const gunichar *needle)
+{
+  for (; *str; str++)
+  {
+    if ((*str == *needle) && ucs4_has_prefix(str, needle))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
 static void
 osso_abook_filter_model_refilter(OssoABookFilterModel *model,
                                  OssoABookFilterModelPrivate *priv)
 {
   if (!priv->refilter_freezed)
+  {
+    OSSO_ABOOK_STAT_TIMER_START("filter-model-refilter");
     gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(model));
+    OSSO_ABOOK_STAT_TIMER_END();
+  }
   else
     priv->refilter_requested = TRUE;
 }
 
+static gboolean
+text_visible(OssoABookFilterModelPrivate *priv, OssoABookContact *contact)
+{
+  OssoABookNameOrder order;
+  const gunichar *key;
+  const char *name;
+  gboolean rv = TRUE;
+
+  order = osso_abook_list_store_get_name_order(priv->base_model);
+  name = osso_abook_contact_get_name_with_order(contact, order);
+
+  if (!name || !*name)
+    return priv->show_unnamed;
+
+  key = _osso_abook_contact_get_search_key(contact, order);
+
+  for (GList *l = priv->bits; l; l = l->next)
+  {
+    if (priv->prefix)
+    {
+      const gunichar *next = key;
+
+      while (!(rv = ucs4_has_prefix(next, l->data)))
+      {
+        if (!(next = ucs4_strchr(next, ' ')))
+          return rv;
+
+        next++;
+      }
+    }
+    else
+    {
+      rv = ucs4_contains(key, l->data);
+
+      if (!rv)
+        break;
+    }
+  }
+
+  return rv;
+}
+
+static gboolean
+bits_refine(GList *old_bits, GList *new_bits, gboolean prefix)
+{
+  for (GList *o = old_bits; o; o = o->next)
+  {
+    GList *n;
+
+    for (n = new_bits; n; n = n->next)
+    {
+      if (prefix ? ucs4_has_prefix(n->data, o->data) :
+          ucs4_contains(n->data, o->data))
+      {
+        break;
+      }
+    }
+
+    if (!n)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* When the new search text only narrows down the previous one, no hidden row
+ * can become visible again. So the currently visible rows are collected
+ * first, and the refilter hides all other rows without matching their names
+ * again. */
+static void
+osso_abook_filter_model_narrow(OssoABookFilterModel *model,
+                               OssoABookFilterModelPrivate *priv)
+{
+  GtkTreeModel *tree_model = GTK_TREE_MODEL(model);
+  GtkTreeIter child_iter;
+  GtkTreeIter iter;
+  gboolean valid;
+
+  OSSO_ABOOK_STAT_TIMER_START("filter-model-narrow");
+
+  priv->narrowed_rows = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  for (valid = gtk_tree_model_get_iter_first(tree_model, &iter); valid;
+       valid = gtk_tree_model_iter_next(tree_model, &iter))
+  {
+    OssoABookListStoreRow *row;
+
+    gtk_tree_model_filter_convert_iter_to_child_iter(
+      GTK_TREE_MODEL_FILTER(model), &child_iter, &iter);
+    row = osso_abook_list_store_iter_get_row(priv->base_model, &child_iter);
+
+    if (row)
+      g_hash_table_add(priv->narrowed_rows, row);
+  }
+
+  OSSO_ABOOK_COUNT("filter-model-rows-narrowed",
+                   g_hash_table_size(priv->narrowed_rows));
+  gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(model));
+
+  g_hash_table_destroy(priv->narrowed_rows);
+  priv->narrowed_rows = NULL;
+
+  OSSO_ABOOK_STAT_TIMER_END();
+}
+
 static void
 osso_abook_filter_model_real_set_text(OssoABookFilterModel *model,
                                       const char *text, gboolean prefix)
 {
   gboolean old_prefix;
+  gboolean old_show_unnamed;
+  gboolean narrow;
+  GList *old_bits;
   OssoABookFilterModelPrivate *priv =
     OSSO_ABOOK_TYPE_FILTER_MODEL_PRIVATE(model);
 
+  narrow = priv->text != NULL;
+  old_bits = priv->bits;
+  old_show_unnamed = priv->show_unnamed;
+  priv->bits = NULL;
   g_free(priv->text);
   priv->text = NULL;
-  clear_bits(priv);
 
   if (text && *text)
   {
@@ -612,7 +706,7 @@ osso_abook_filter_model_real_set_text(OssoABookFilterModel *model,
   }
 
   old_prefix = priv->prefix;
-  priv->prefix = prefix;
+  priv->prefix = prefix != FALSE;
 
   if (priv->text)
   {
@@ -626,9 +720,19 @@ osso_abook_filter_model_real_set_text(OssoABookFilterModel *model,
   else
     priv->show_unnamed = FALSE;
 
-  osso_abook_filter_model_refilter(model, priv);
+  narrow = narrow && priv->text && (priv->prefix == old_prefix) &&
+    (old_show_unnamed || !priv->show_unnamed) &&
+    !priv->refilter_freezed && bits_refine(old_bits, priv->bits, prefix);
+
+  for (GList *l = old_bits; l; l = g_list_delete_link(l, l))
+    g_free(l->data);
 
-  if (old_prefix != prefix)
+  if (narrow)
+    osso_abook_filter_model_narrow(model, priv);
+  else
+    osso_abook_filter_model_refilter(model, priv);
+
+  if (old_prefix != priv->prefix)
   {
     g_object_notify(G_OBJECT(model), "prefix");
   }
@@ -641,8 +745,6 @@ visible_func(GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
 {
   OssoABookFilterModelPrivate *priv = data;
   OssoABookListStoreRow *row;
-  const char *name;
-  gboolean rv = TRUE;
 
   if (priv->visible_cb && !priv->visible_cb(model, iter, priv->visible_data))
     return FALSE;
@@ -651,6 +753,9 @@ visible_func(GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
 
   g_return_val_if_fail(row != NULL, FALSE);
 
+  if (priv->narrowed_rows && !g_hash_table_contains(priv->narrowed_rows, row))
+    return FALSE;
+
   if (priv->group)
   {
     if (!osso_abook_group_includes_contact(priv->group, row->contact))
@@ -660,36 +765,7 @@ visible_func(GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
   if (!priv->text)
     return TRUE;
 
-  name = osso_abook_contact_get_name(row->contact);
-
-  if (!name || !*name)
-    return priv->show_unnamed;
-
-  for (GList *l = priv->bits; l; l = l->next)
-  {
-    if (priv->prefix)
-    {
-      const char *next = name;
-
-      while (!(rv = _osso_abook_utf8_strstartswithcasestrip(
-                 next, l->data, NULL)))
-      {
-        if (!(next = strchr(next, ' ')))
-          return rv;
-
-        next++;
-      }
-    }
-    else
-    {
-      rv = _osso_abook_utf8_strstrcasestrip(name, l->data, NULL) != NULL;
-
-      if (!rv)
-        break;
-    }
-  }
-
-  return rv;
+  return text_visible(priv, row->contact);
 }
 
 static void
@@ -703,6 +779,7 @@ osso_abook_filter_model_init(OssoABookFilterModel *model)
   priv->prefix = FALSE;
   priv->show_unnamed = FALSE;
   priv->bits = NULL;
+  priv->narrowed_rows = NULL;
   priv->group = NULL;
   priv->refilter_freezed = FALSE;
   priv->refilter_requested = FALSE;
@@ -801,7 +878,9 @@ osso_abook_filter_model_thaw_refilter(OssoABookFilterModel *model)
 
   if (priv->refilter_requested)
   {
+    OSSO_ABOOK_STAT_TIMER_START("filter-model-refilter");
     gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(model));
+    OSSO_ABOOK_STAT_TIMER_END();
     priv->refilter_requested = FALSE;
   }
 
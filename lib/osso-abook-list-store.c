@@ -3,8 +3,10 @@
 #include <gtk/gtkprivate.h>
 #include <hildon/hildon.h>
 #include <libosso.h>
+#include <string.h>
 
 #include "osso-abook-aggregator.h"
+#include "osso-abook-contact-private.h"
 #include "osso-abook-contact.h"
 #include "osso-abook-enums.h"
 #include "osso-abook-list-store.h"
@@ -23,6 +25,11 @@ struct _OssoABookListStorePrivate
   gulong notify_book_view_id;
   guint update_contacts_id;
   guint idle_sort_id;
+  /* rows received while loading, but not merged yet */
+  GPtrArray *bulk_rows;
+  guint bulk_load_id;
+  /* find_contacts() result when queued rows match */
+  GArray *found_rows;
   OssoABookListStoreRow **rows;
   gint stamp;
   gint count;
@@ -32,6 +39,8 @@ struct _OssoABookListStorePrivate
   gint balloon_offset;
   GHashTable *names;
   GHashTable *pending;
+  /* uid -> OssoABookContactFields changed since the last update */
+  GHashTable *pending_fields;
   OssoABookListStoreCompareFunc sort_func;
   gpointer sort_data;
   GDestroyNotify sort_destroy;
@@ -39,6 +48,7 @@ struct _OssoABookListStorePrivate
   gpointer group_sort_data;
   GDestroyNotify group_sort_destroy;
   OssoABookNameOrder name_order;
+  gdouble resort_threshold;
 };
 
 typedef struct _OssoABookListStorePrivate OssoABookListStorePrivate;
@@ -46,6 +56,14 @@ typedef struct _OssoABookListStorePrivate OssoABookListStorePrivate;
 #define OSSO_ABOOK_LIST_STORE_PRIVATE(store) \
   ((OssoABookListStorePrivate *)osso_abook_list_store_get_instance_private(store))
 
+/* fraction of rows that may change before incremental re-positioning gives up
+ * in favour of a full re-sort */
+#define DEFAULT_RESORT_THRESHOLD 0.1
+
+/* milliseconds rows received while loading are collected before they get
+ * merged into the model */
+#define BULK_LOAD_TIMEOUT 500
+
 static void
 osso_abook_list_store_gtk_tree_model_iface_init(GtkTreeModelIface *g_iface,
                                                 gpointer iface_data);
@@ -57,6 +75,10 @@ static void
 osso_abook_list_store_osso_abook_row_model_iface_init(
   OssoABookRowModelIface *g_iface,
   gpointer iface_data);
+static void
+osso_abook_list_store_contact_fields_changed(OssoABookListStore *store,
+                                             OssoABookContact *contact,
+                                             OssoABookContactFields fields);
 
 G_DEFINE_ABSTRACT_TYPE_WITH_CODE(
   OssoABookListStore,
@@ -377,12 +399,15 @@ osso_abook_list_store_init(OssoABookListStore *store)
   OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
 
   priv->balloon_offset = G_MAXINT;
+  priv->resort_threshold = DEFAULT_RESORT_THRESHOLD;
   priv->roster = NULL;
   priv->name_order = osso_abook_settings_get_name_order();
   priv->names =
     g_hash_table_new_full(g_str_hash, g_str_equal, g_free, destroy_array);
   priv->pending =
     g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  priv->pending_fields =
+    g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
   osso_abook_list_store_set_sort_func_by_order(
     store, osso_abook_settings_get_contact_order(), priv->name_order);
@@ -396,7 +421,9 @@ enum
   PROP_CONTACT_ORDER,
   PROP_NAME_ORDER,
   PROP_ROW_COUNT,
-  PROP_PRE_ALLOCATED_ROWS
+  PROP_PRE_ALLOCATED_ROWS,
+  PROP_RESORT_THRESHOLD,
+  PROP_LOADED_ROW_COUNT
 };
 
 static void
@@ -432,9 +459,13 @@ osso_abook_list_store_finalize(GObject *object)
     priv->group_sort_destroy(priv->group_sort_data);
 
   g_hash_table_unref(priv->pending);
+  g_hash_table_unref(priv->pending_fields);
   g_hash_table_unref(priv->names);
   g_free(priv->rows);
 
+  if (priv->found_rows)
+    g_array_free(priv->found_rows, TRUE);
+
   G_OBJECT_CLASS(osso_abook_list_store_parent_class)->finalize(object);
 }
 
@@ -468,6 +499,13 @@ osso_abook_list_store_get_property(GObject *object, guint property_id,
     case PROP_PRE_ALLOCATED_ROWS:
       g_value_set_uint(value, priv->extra);
       break;
+    case PROP_RESORT_THRESHOLD:
+      g_value_set_double(value, priv->resort_threshold);
+      break;
+    case PROP_LOADED_ROW_COUNT:
+      g_value_set_uint(value, priv->count +
+                       (priv->bulk_rows ? priv->bulk_rows->len : 0));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
       break;
@@ -479,6 +517,7 @@ osso_abook_list_store_set_property(GObject *object, guint property_id,
                                    const GValue *value, GParamSpec *pspec)
 {
   OssoABookListStore *store = OSSO_ABOOK_LIST_STORE(object);
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
 
   switch (property_id)
   {
@@ -494,6 +533,9 @@ osso_abook_list_store_set_property(GObject *object, guint property_id,
     case PROP_NAME_ORDER:
       osso_abook_list_store_set_name_order(store, g_value_get_enum(value));
       break;
+    case PROP_RESORT_THRESHOLD:
+      priv->resort_threshold = g_value_get_double(value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
       break;
@@ -504,7 +546,12 @@ static void
 row_notify_cb(OssoABookContact *contact, GParamSpec *arg1,
               OssoABookListStore *store)
 {
-  osso_abook_list_store_contact_changed(store, contact);
+  OssoABookContactFields fields = OSSO_ABOOK_CONTACT_FIELD_PRESENCE;
+
+  if (!strcmp(g_param_spec_get_name(arg1), "avatar-image"))
+    fields = OSSO_ABOOK_CONTACT_FIELD_PHOTO;
+
+  osso_abook_list_store_contact_fields_changed(store, contact, fields);
 }
 
 static void
@@ -525,6 +572,10 @@ osso_abook_list_store_row_added(OssoABookListStore *store,
   }
 
   g_array_append_vals(rows, &row, 1);
+
+  /* warm up the live search key, so filtering doesn't have to fold names */
+  _osso_abook_contact_get_search_key(row->contact, priv->name_order);
+
   g_signal_connect(row->contact, "notify::avatar-image",
                    G_CALLBACK(row_notify_cb), store);
   g_signal_connect(row->contact, "notify::capabilities",
@@ -698,6 +749,28 @@ osso_abook_list_store_class_init(OssoABookListStoreClass *klass)
       G_MAXUINT,
       0,
       GTK_PARAM_READABLE));
+
+  g_object_class_install_property(
+    object_class, PROP_RESORT_THRESHOLD,
+    g_param_spec_double(
+      "resort-threshold",
+      "Re-sort Threshold",
+      "Fraction of changed rows above which the whole model is re-sorted",
+      0.0,
+      1.0,
+      DEFAULT_RESORT_THRESHOLD,
+      GTK_PARAM_READWRITE));
+
+  g_object_class_install_property(
+    object_class, PROP_LOADED_ROW_COUNT,
+    g_param_spec_uint(
+      "loaded-row-count",
+      "Loaded Row Count",
+      "Number of contacts received so far, including the ones not shown yet",
+      0,
+      G_MAXUINT,
+      0,
+      GTK_PARAM_READABLE));
 }
 
 static void
@@ -806,15 +879,19 @@ idle_sort_cb(gpointer user_data)
 {
   OssoABookListStore *store = user_data;
   OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
-  gint new_order[priv->count];
+  gint *new_order = g_new(gint, priv->count);
   OssoABookListStoreRow **rows = priv->rows;
   GtkTreePath *path;
   int i;
 
   priv->idle_sort_id = 0;
   osso_abook_list_store_move_baloon(store);
+
+  OSSO_ABOOK_COUNT("list-store-rows-sorted", priv->count);
+  OSSO_ABOOK_STAT_TIMER_START("list-store-sort");
   g_qsort_with_data(rows, priv->count, sizeof(rows[0]),
                     osso_abook_list_store_sort, store);
+  OSSO_ABOOK_STAT_TIMER_END();
 
   for (i = 0; i < priv->count; i++)
   {
@@ -825,6 +902,7 @@ idle_sort_cb(gpointer user_data)
   path = gtk_tree_path_new();
   gtk_tree_model_rows_reordered((GtkTreeModel *)store, path, 0, new_order);
   gtk_tree_path_free(path);
+  g_free(new_order);
 
   return FALSE;
 }
@@ -1061,17 +1139,43 @@ osso_abook_list_store_row_new(OssoABookContact *contact)
 OssoABookListStoreRow **
 osso_abook_list_store_find_contacts(OssoABookListStore *store, const char *uid)
 {
+  OssoABookListStorePrivate *priv;
   GArray *array;
+  guint i;
 
   g_return_val_if_fail(OSSO_ABOOK_IS_LIST_STORE(store), NULL);
   g_return_val_if_fail(uid != NULL, NULL);
 
-  array = g_hash_table_lookup(OSSO_ABOOK_LIST_STORE_PRIVATE(store)->names, uid);
+  priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  array = g_hash_table_lookup(priv->names, uid);
+
+  if (!priv->bulk_rows)
+    return array ? (OssoABookListStoreRow **)array->data : NULL;
 
-  if (array)
-    return (OssoABookListStoreRow **)array->data;
+  /* rows queued while loading are not indexed yet, scan them without merging,
+   * as that would emit row signals from within a lookup */
+  if (priv->found_rows)
+    g_array_set_size(priv->found_rows, 0);
   else
+    priv->found_rows = g_array_new(TRUE, FALSE, sizeof(gpointer));
+
+  if (array)
+    g_array_append_vals(priv->found_rows, array->data, array->len);
+
+  for (i = 0; i < priv->bulk_rows->len; i++)
+  {
+    OssoABookListStoreRow *row = g_ptr_array_index(priv->bulk_rows, i);
+    const char *row_uid = e_contact_get_const(E_CONTACT(row->contact),
+                                              E_CONTACT_UID);
+
+    if (!g_strcmp0(row_uid, uid))
+      g_array_append_val(priv->found_rows, row);
+  }
+
+  if (!priv->found_rows->len)
     return NULL;
+
+  return (OssoABookListStoreRow **)priv->found_rows->data;
 }
 
 static inline const char *
@@ -1082,6 +1186,70 @@ get_store_book_uri(OssoABookListStore *store)
     osso_abook_list_store_get_roster(store)) : "<none>";
 }
 
+static void
+osso_abook_list_store_insert_rows(OssoABookListStore *store,
+                                  OssoABookListStoreRow **new_rows,
+                                  gint new_rows_count);
+
+static void
+osso_abook_list_store_flush_bulk_rows(OssoABookListStore *store)
+{
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  GPtrArray *rows = priv->bulk_rows;
+
+  if (priv->bulk_load_id)
+  {
+    g_source_remove(priv->bulk_load_id);
+    priv->bulk_load_id = 0;
+  }
+
+  if (!rows)
+    return;
+
+  priv->bulk_rows = NULL;
+
+  OSSO_ABOOK_NOTE(LIST_STORE, "%s@%p: merging %d queued row(s)",
+                  get_store_book_uri(store), store, rows->len);
+
+  osso_abook_list_store_insert_rows(
+    store, (OssoABookListStoreRow **)rows->pdata, rows->len);
+  g_ptr_array_free(rows, TRUE);
+}
+
+static void
+osso_abook_list_store_discard_bulk_rows(OssoABookListStore *store)
+{
+  OssoABookListStoreClass *klass = OSSO_ABOOK_LIST_STORE_GET_CLASS(store);
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  guint i;
+
+  if (priv->bulk_load_id)
+  {
+    g_source_remove(priv->bulk_load_id);
+    priv->bulk_load_id = 0;
+  }
+
+  if (!priv->bulk_rows)
+    return;
+
+  for (i = 0; i < priv->bulk_rows->len; i++)
+    g_boxed_free(klass->row_type, g_ptr_array_index(priv->bulk_rows, i));
+
+  g_ptr_array_free(priv->bulk_rows, TRUE);
+  priv->bulk_rows = NULL;
+}
+
+static gboolean
+bulk_load_cb(gpointer user_data)
+{
+  OssoABookListStore *store = user_data;
+
+  OSSO_ABOOK_LIST_STORE_PRIVATE(store)->bulk_load_id = 0;
+  osso_abook_list_store_flush_bulk_rows(store);
+
+  return FALSE;
+}
+
 static void
 contacts_added_cb(OssoABookRoster *roster, gpointer contacts,
                   OssoABookListStore *user_data)
@@ -1104,7 +1272,8 @@ contacts_changed_master_cb(OssoABookRoster *roster, gpointer contacts,
 
   while (*c)
   {
-    osso_abook_list_store_contact_changed(user_data, *c);
+    osso_abook_list_store_contact_fields_changed(
+      user_data, *c, _osso_abook_contact_get_changed_fields(*c));
     c++;
   }
 }
@@ -1116,6 +1285,8 @@ contacts_removed_cb(OssoABookRoster *roster, const char **uids,
   OssoABookListStore *store = user_data;
   GPtrArray *arr = g_ptr_array_new();
 
+  osso_abook_list_store_flush_bulk_rows(store);
+
   while (*uids)
   {
     OssoABookListStoreRow **rows =
@@ -1162,6 +1333,8 @@ sequence_complete_cb(OssoABookRoster *roster, guint status, gpointer user_data)
   OSSO_ABOOK_NOTE(LIST_STORE, "%s@%p: sequence-complete, status=%d",
                   get_store_book_uri(store), store, status);
 
+  osso_abook_list_store_flush_bulk_rows(store);
+
   g_signal_handler_disconnect(priv->roster, priv->sequence_complete_id);
   priv->sequence_complete_id = 0;
   g_object_notify(G_OBJECT(store), "loading");
@@ -1210,6 +1383,7 @@ osso_abook_list_store_set_roster(OssoABookListStore *store,
       priv->notify_book_view_id = 0;
     }
 
+    osso_abook_list_store_discard_bulk_rows(store);
     osso_abook_list_store_cancel_loading(store);
     g_object_unref(priv->roster);
     OSSO_ABOOK_LIST_STORE_GET_CLASS(store)->clear(store);
@@ -1363,19 +1537,194 @@ osso_abook_list_store_remove_rows(OssoABookListStore *store,
   }
 }
 
+static gboolean
+osso_abook_list_store_row_in_order(OssoABookListStore *store, gint idx)
+{
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  OssoABookListStoreRow **rows = priv->rows;
+
+  if ((idx > 0) &&
+      (osso_abook_list_store_sort(&rows[idx - 1], &rows[idx], store) > 0))
+  {
+    return FALSE;
+  }
+
+  if ((idx < priv->count - 1) &&
+      (osso_abook_list_store_sort(&rows[idx], &rows[idx + 1], store) > 0))
+  {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+osso_abook_list_store_detach_row(OssoABookListStore *store,
+                                 OssoABookListStoreRow *row)
+{
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  OssoABookListStoreRow **rows = priv->rows;
+  gint idx = row->offset;
+  GtkTreePath *path;
+  gint i;
+
+  memmove(&rows[idx], &rows[idx + 1],
+          (priv->count - idx - 1) * sizeof(rows[0]));
+  priv->count--;
+  rows[priv->count] = NULL;
+
+  for (i = idx; i < priv->count; i++)
+    rows[i]->offset = i;
+
+  row->offset = -1;
+  priv->stamp++;
+
+  path = gtk_tree_path_new_from_indices(idx, -1);
+  gtk_tree_model_row_deleted(GTK_TREE_MODEL(store), path);
+  gtk_tree_path_free(path);
+}
+
+static void
+osso_abook_list_store_attach_row(OssoABookListStore *store,
+                                 OssoABookListStoreRow *row)
+{
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  OssoABookListStoreRow **rows = priv->rows;
+  gint lo = 0;
+  gint hi = priv->count;
+  GtkTreePath *path;
+  GtkTreeIter iter;
+  gint i;
+
+  while (lo < hi)
+  {
+    gint mid = lo + (hi - lo) / 2;
+
+    if (osso_abook_list_store_sort(&row, &rows[mid], store) < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  memmove(&rows[lo + 1], &rows[lo], (priv->count - lo) * sizeof(rows[0]));
+  rows[lo] = row;
+  priv->count++;
+
+  for (i = lo; i < priv->count; i++)
+    rows[i]->offset = i;
+
+  priv->stamp++;
+  iter.stamp = priv->stamp;
+  iter.user_data = store;
+  iter.user_data2 = GINT_TO_POINTER(lo);
+
+  path = gtk_tree_path_new_from_indices(lo, -1);
+  gtk_tree_model_row_inserted(GTK_TREE_MODEL(store), path, &iter);
+  gtk_tree_path_free(path);
+}
+
+/* the fields the current sort functions look at */
+static OssoABookContactFields
+osso_abook_list_store_get_sort_fields(OssoABookListStore *store)
+{
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+
+  if (priv->group_sort_func)
+    return OSSO_ABOOK_CONTACT_FIELD_ALL;
+
+  if (priv->sort_func == osso_abook_list_store_sort_name)
+    return OSSO_ABOOK_CONTACT_FIELD_NAME;
+
+  if (priv->sort_func == osso_abook_list_store_sort_presence)
+  {
+    return OSSO_ABOOK_CONTACT_FIELD_NAME |
+           OSSO_ABOOK_CONTACT_FIELD_PRESENCE;
+  }
+
+  return OSSO_ABOOK_CONTACT_FIELD_ALL;
+}
+
+/* Moves changed rows to their new sort position without re-sorting the whole
+ * model. This relies on the rows being sorted before the change, so it backs
+ * off whenever a full sort is pending anyway or too many rows changed. */
+static void
+osso_abook_list_store_reposition_rows(OssoABookListStore *store,
+                                      GPtrArray *changed)
+{
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  GPtrArray *moved;
+  guint n_moved;
+  guint i;
+
+  if (!changed->len || (!priv->sort_func && !priv->group_sort_func))
+    return;
+
+  if (priv->idle_sort_id)
+    return;
+
+  if (changed->len > priv->count * priv->resort_threshold)
+  {
+    OSSO_ABOOK_NOTE(LIST_STORE, "%s@%p: %d of %d rows changed, re-sorting",
+                    get_store_book_uri(store), store, changed->len,
+                    priv->count);
+    osso_abook_list_store_idle_sort(store);
+    return;
+  }
+
+  osso_abook_list_store_move_baloon(store);
+  moved = g_ptr_array_new();
+
+  /* removing a row makes its neighbours adjacent, which can put another
+   * changed row out of order, so repeat until nothing moves anymore */
+  do
+  {
+    n_moved = moved->len;
+
+    for (i = 0; i < changed->len;)
+    {
+      OssoABookListStoreRow *row = g_ptr_array_index(changed, i);
+
+      if (!osso_abook_list_store_row_in_order(store, row->offset))
+      {
+        osso_abook_list_store_detach_row(store, row);
+        g_ptr_array_add(moved, row);
+        g_ptr_array_remove_index_fast(changed, i);
+      }
+      else
+        i++;
+    }
+  }
+  while (moved->len != n_moved);
+
+  OSSO_ABOOK_NOTE(LIST_STORE, "%s@%p: re-positioning %d row(s)",
+                  get_store_book_uri(store), store, moved->len);
+
+  for (i = 0; i < moved->len; i++)
+    osso_abook_list_store_attach_row(store, g_ptr_array_index(moved, i));
+
+  g_ptr_array_free(moved, TRUE);
+}
+
 static gboolean
 update_contacts_cb(gpointer user_data)
 {
   OssoABookListStore *store = user_data;
   OssoABookListStoreClass *klass = OSSO_ABOOK_LIST_STORE_GET_CLASS(store);
   OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  OssoABookContactFields sort_fields;
   GHashTableIter iter;
   OssoABookContact *contact;
+  GPtrArray *changed;
 
   priv->update_contacts_id = 0;
 
   g_return_val_if_fail(klass->contact_changed, FALSE);
 
+  /* changed contacts might still be queued */
+  osso_abook_list_store_flush_bulk_rows(store);
+
+  sort_fields = osso_abook_list_store_get_sort_fields(store);
+  changed = g_ptr_array_new();
   g_hash_table_iter_init(&iter, priv->pending);
 
   while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&contact))
@@ -1383,46 +1732,72 @@ update_contacts_cb(gpointer user_data)
     const char *uid = e_contact_get_const(E_CONTACT(contact), E_CONTACT_UID);
     OssoABookListStoreRow **contacts =
       osso_abook_list_store_find_contacts(store, uid);
+    OssoABookContactFields fields =
+      GPOINTER_TO_UINT(g_hash_table_lookup(priv->pending_fields, uid));
 
     OSSO_ABOOK_NOTE(LIST_STORE,
-                    "%s@%p: contact %s(%s) changed, %d matching row(s)",
+                    "%s@%p: contact %s(%s) changed, fields %x, "
+                    "%d matching row(s)",
                     get_store_book_uri(store), store,
-                    osso_abook_contact_get_display_name(contact), uid,
+                    osso_abook_contact_get_display_name(contact), uid, fields,
                     contacts ? g_strv_length((gchar **)contacts) : 0);
 
     if (contacts)
+    {
+      OssoABookListStoreRow **row;
+
       klass->contact_changed(store, contacts);
 
+      /* a note only edit must not move the row */
+      if (fields & sort_fields)
+      {
+        for (row = contacts; *row; row++)
+          g_ptr_array_add(changed, *row);
+      }
+    }
+
     g_hash_table_iter_remove(&iter);
   }
 
-  osso_abook_list_store_idle_sort(store);
+  g_hash_table_remove_all(priv->pending_fields);
+
+  osso_abook_list_store_reposition_rows(store, changed);
+  g_ptr_array_free(changed, TRUE);
 
   return FALSE;
 }
 
-void
-osso_abook_list_store_contact_changed(OssoABookListStore *store,
-                                      OssoABookContact *contact)
+static void
+osso_abook_list_store_contact_fields_changed(OssoABookListStore *store,
+                                             OssoABookContact *contact,
+                                             OssoABookContactFields fields)
 {
-  OssoABookListStorePrivate *priv;
-  const gchar *uid;
-
-  g_return_if_fail(OSSO_ABOOK_IS_LIST_STORE(store));
-  g_return_if_fail(OSSO_ABOOK_IS_CONTACT(contact));
-
-  priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
-  uid = e_contact_get_const(E_CONTACT(contact), E_CONTACT_UID);
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  const gchar *uid = e_contact_get_const(E_CONTACT(contact), E_CONTACT_UID);
 
-  OSSO_ABOOK_NOTE(LIST_STORE, "%s@%p: contact changed: %s@%p",
-                  get_store_book_uri(store), store, uid, contact);
+  OSSO_ABOOK_NOTE(LIST_STORE, "%s@%p: contact changed: %s@%p, fields %x",
+                  get_store_book_uri(store), store, uid, contact, fields);
 
+  fields |= GPOINTER_TO_UINT(g_hash_table_lookup(priv->pending_fields, uid));
+  g_hash_table_insert(priv->pending_fields, g_strdup(uid),
+                      GUINT_TO_POINTER(fields));
   g_hash_table_insert(priv->pending, g_strdup(uid), g_object_ref(contact));
 
   if (!priv->update_contacts_id)
     priv->update_contacts_id = gdk_threads_add_idle(update_contacts_cb, store);
 }
 
+void
+osso_abook_list_store_contact_changed(OssoABookListStore *store,
+                                      OssoABookContact *contact)
+{
+  g_return_if_fail(OSSO_ABOOK_IS_LIST_STORE(store));
+  g_return_if_fail(OSSO_ABOOK_IS_CONTACT(contact));
+
+  osso_abook_list_store_contact_fields_changed(store, contact,
+                                               OSSO_ABOOK_CONTACT_FIELD_ALL);
+}
+
 void
 osso_abook_list_store_cancel_loading(OssoABookListStore *store)
 {
@@ -1457,31 +1832,25 @@ osso_abook_list_store_cancel_loading(OssoABookListStore *store)
   }
 
   priv->roster_is_running = FALSE;
+  osso_abook_list_store_flush_bulk_rows(store);
 }
 
-void
-osso_abook_list_store_merge_rows(OssoABookListStore *store, GList *rows)
+/* Sorts new_rows in place and merges them into the model in one pass. */
+static void
+osso_abook_list_store_insert_rows(OssoABookListStore *store,
+                                  OssoABookListStoreRow **new_rows,
+                                  gint new_rows_count)
 {
-  OssoABookListStorePrivate *priv;
+  OssoABookListStorePrivate *priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+  OssoABookListStoreClass *klass = OSSO_ABOOK_LIST_STORE_GET_CLASS(store);
   gint size;
-  gint *new_order;
-  gint new_rows_count;
+  gint *new_order = NULL;
   int new_count;
   int new_order_count;
   GtkTreePath *path_reordered = NULL;
   GtkTreePath *path_changed;
-  OssoABookListStoreClass *klass;
   GtkTreeIter iter;
 
-  g_return_if_fail(OSSO_ABOOK_IS_LIST_STORE(store));
-
-  klass = OSSO_ABOOK_LIST_STORE_GET_CLASS(store);
-
-  g_return_if_fail(NULL != klass->row_added);
-
-  priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
-  new_rows_count = g_list_length(rows);
-
   if (!new_rows_count)
     return;
 
@@ -1507,7 +1876,9 @@ osso_abook_list_store_merge_rows(OssoABookListStore *store, GList *rows)
   if (new_order_count < new_count)
     new_order_count = new_count;
 
-  new_order = g_alloca(new_order_count * sizeof(new_order[0]));
+  /* only needed to replace pre-allocated rows */
+  if (priv->extra > 0)
+    new_order = g_new(gint, new_order_count);
 
   priv->stamp++;
   iter.user_data = store;
@@ -1515,15 +1886,17 @@ osso_abook_list_store_merge_rows(OssoABookListStore *store, GList *rows)
 
   if (!priv->sort_func && !priv->group_sort_func)
   {
+    gint i;
+
     path_changed = gtk_tree_path_new_from_indices(priv->count, -1);
 
-    for (priv->balloon_size = 0; rows; rows = rows->next)
+    for (priv->balloon_size = 0, i = 0; i < new_rows_count; i++)
     {
       void (*f)(GtkTreeModel *, GtkTreePath *, GtkTreeIter *);
       gint idx = priv->count;
 
-      priv->rows[idx] = rows->data;
-      ((OssoABookListStoreRow *)(rows->data))->offset = idx;
+      priv->rows[idx] = new_rows[i];
+      new_rows[i]->offset = idx;
 
       priv->count++;
 
@@ -1543,19 +1916,12 @@ osso_abook_list_store_merge_rows(OssoABookListStore *store, GList *rows)
   }
   else
   {
-    GList *l;
-    OssoABookListStoreRow **sorted;
-    OssoABookListStoreRow **p;
+    OssoABookListStoreRow **sorted = new_rows;
     OssoABookListStoreRow **b;
     OssoABookListStoreRow **a;
     OssoABookListStoreRow **dst_iter;
     gboolean order_changed;
 
-    p = sorted = g_alloca(new_rows_count * sizeof(sorted[0]));
-
-    for (l = rows; l; l = l->next)
-      *p++ = l->data;
-
     g_qsort_with_data(sorted, new_rows_count, sizeof(sorted[0]),
                       osso_abook_list_store_sort, store);
     path_changed = gtk_tree_path_new_from_indices(priv->count, -1);
@@ -1668,8 +2034,56 @@ osso_abook_list_store_merge_rows(OssoABookListStore *store, GList *rows)
   }
 
   gtk_tree_path_free(path_changed);
+  g_free(new_order);
   g_warn_if_fail(priv->count <= priv->size);
   g_warn_if_fail(0 == priv->balloon_size);
   g_warn_if_fail(NULL != priv->rows);
   priv->balloon_offset = G_MAXINT;
 }
+
+void
+osso_abook_list_store_merge_rows(OssoABookListStore *store, GList *rows)
+{
+  OssoABookListStorePrivate *priv;
+  OssoABookListStoreRow **new_rows;
+  gint new_rows_count;
+  GList *l;
+  gint i;
+
+  g_return_if_fail(OSSO_ABOOK_IS_LIST_STORE(store));
+  g_return_if_fail(NULL != OSSO_ABOOK_LIST_STORE_GET_CLASS(store)->row_added);
+
+  priv = OSSO_ABOOK_LIST_STORE_PRIVATE(store);
+
+  if (!rows)
+    return;
+
+  /* while loading, collect the rows and merge them all at once later, that is
+   * after BULK_LOAD_TIMEOUT or when the roster emits sequence-complete */
+  if (priv->roster_is_running)
+  {
+    if (!priv->bulk_rows)
+      priv->bulk_rows = g_ptr_array_new();
+
+    for (l = rows; l; l = l->next)
+      g_ptr_array_add(priv->bulk_rows, l->data);
+
+    if (!priv->bulk_load_id)
+    {
+      priv->bulk_load_id =
+        gdk_threads_add_timeout(BULK_LOAD_TIMEOUT, bulk_load_cb, store);
+    }
+
+    g_object_notify(G_OBJECT(store), "loaded-row-count");
+    return;
+  }
+
+  new_rows_count = g_list_length(rows);
+  new_rows = g_new(OssoABookListStoreRow *, new_rows_count);
+
+  for (l = rows, i = 0; l; l = l->next)
+    new_rows[i++] = l->data;
+
+  osso_abook_list_store_insert_rows(store, new_rows, new_rows_count);
+  g_free(new_rows);
+}
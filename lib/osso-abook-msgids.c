@@ -20,7 +20,6 @@
 
 #include <libintl.h>
 #include <locale.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -49,12 +48,28 @@ struct _mo_string_desc
 };
 typedef struct _mo_string_desc mo_string_desc;
 
+/* reverse (msgstr -> msgid) lookup table over a mmapped .mo file */
+struct _mo_table
+{
+  GMappedFile *mapped;
+  const gchar *data;
+  gsize len;
+  gboolean swapped;
+  const mo_string_desc *orig_tab;
+  const mo_string_desc *trans_tab;
+  /* open addressing, string index + 1 per slot, 0 for empty ones */
+  guint32 *slots;
+  guint32 mask;
+};
+typedef struct _mo_table mo_table;
+
 static GHashTable *msgids_table = NULL;
+static GHashTable *locations = NULL;
 static const char *mo_magic1 = "\xDE\x12\x04\x95";
 static const char *mo_magic2 = "\x95\x04\x12\xDE";
 
-gchar *
-osso_abook_msgids_locate(const char *locale, const char *domain)
+static gchar *
+locate(const char *locale, const char *domain)
 {
   gchar *loc;
   gchar *p;
@@ -62,11 +77,6 @@ osso_abook_msgids_locate(const char *locale, const char *domain)
   gchar *path = NULL;
   char *loc_dir;
 
-  g_return_val_if_fail(NULL != domain, NULL);
-
-  if (!locale)
-    locale = setlocale(LC_MESSAGES, NULL);
-
   loc = g_strdup(locale);
   p = &loc[strlen(loc) - 1];
   mo_file = g_strconcat(domain, ".mo", NULL);
@@ -95,6 +105,46 @@ osso_abook_msgids_locate(const char *locale, const char *domain)
   return path;
 }
 
+gchar *
+osso_abook_msgids_locate(const char *locale, const char *domain)
+{
+  gchar *key;
+  gchar *path;
+
+  g_return_val_if_fail(NULL != domain, NULL);
+
+  if (!locale)
+    locale = setlocale(LC_MESSAGES, NULL);
+
+  if (!locations)
+  {
+    locations = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                      g_free, g_free);
+  }
+
+  /* a missing .mo file is cached as NULL too */
+  key = g_strconcat(locale, "\n", domain, NULL);
+
+  if (g_hash_table_lookup_extended(locations, key, NULL, (gpointer *)&path))
+  {
+    g_free(key);
+    return g_strdup(path);
+  }
+
+  path = locate(locale, domain);
+  g_hash_table_insert(locations, key, g_strdup(path));
+
+  return path;
+}
+
+static void
+mo_table_free(mo_table *table)
+{
+  g_free(table->slots);
+  g_mapped_file_unref(table->mapped);
+  g_slice_free(mo_table, table);
+}
+
 __attribute__((destructor)) static void
 osso_abook_msgids_at_exit(void)
 {
@@ -103,111 +153,195 @@ osso_abook_msgids_at_exit(void)
     g_hash_table_unref(msgids_table);
     msgids_table = NULL;
   }
+
+  if (locations)
+  {
+    g_hash_table_unref(locations);
+    locations = NULL;
+  }
 }
 
-static GHashTable *
-osso_abook_msgids_get_table(const char *locale, const char *domain)
+static guint32
+mo_table_uint32(const mo_table *table, guint32 val)
 {
-  gchar *mo_file_path;
-  GHashTable *mo_strings = NULL;
-  FILE *fp;
-  guint32 i;
-  mo_file_header mo_hdr;
+  return table->swapped ? GUINT32_SWAP_LE_BE(val) : val;
+}
 
-  g_return_val_if_fail(NULL != domain, NULL);
+/* returns the NUL terminated string described by desc, NULL if invalid */
+static const gchar *
+mo_table_string(const mo_table *table, const mo_string_desc *desc)
+{
+  guint32 length = mo_table_uint32(table, desc->length);
+  guint32 offset = mo_table_uint32(table, desc->offset);
 
-  mo_file_path = osso_abook_msgids_locate(locale, domain);
+  if ((offset >= table->len) || (length >= table->len - offset) ||
+      table->data[offset + length])
+  {
+    return NULL;
+  }
 
-  if (!mo_file_path)
+  return table->data + offset;
+}
+
+static mo_table *
+mo_table_new(const gchar *path)
+{
+  GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+  const mo_file_header *mo_hdr;
+  mo_table *table;
+  guint32 nstrings;
+  guint32 orig_tab_offset;
+  guint32 trans_tab_offset;
+  guint32 size;
+  guint32 i;
+
+  if (!mapped)
     return NULL;
 
-  if (msgids_table)
-    mo_strings = g_hash_table_lookup(msgids_table, mo_file_path);
+  table = g_slice_new0(mo_table);
+  table->mapped = mapped;
+  table->data = g_mapped_file_get_contents(mapped);
+  table->len = g_mapped_file_get_length(mapped);
 
-  if (mo_strings)
+  if (table->len < sizeof(*mo_hdr))
+    goto error;
+
+  mo_hdr = (const mo_file_header *)table->data;
+
+  if (!memcmp(&mo_hdr->magic, mo_magic1, sizeof(mo_hdr->magic)))
+    table->swapped = FALSE;
+  else if (!memcmp(&mo_hdr->magic, mo_magic2, sizeof(mo_hdr->magic)))
+    table->swapped = TRUE;
+  else
+    goto error;
+
+  nstrings = mo_table_uint32(table, mo_hdr->nstrings);
+  orig_tab_offset = mo_table_uint32(table, mo_hdr->orig_tab_offset);
+  trans_tab_offset = mo_table_uint32(table, mo_hdr->trans_tab_offset);
+
+  if ((nstrings > G_MAXUINT32 / 4 / sizeof(mo_string_desc)) ||
+      (orig_tab_offset % 4) || (trans_tab_offset % 4) ||
+      (orig_tab_offset > table->len) || (trans_tab_offset > table->len) ||
+      (nstrings * sizeof(mo_string_desc) > table->len - orig_tab_offset) ||
+      (nstrings * sizeof(mo_string_desc) > table->len - trans_tab_offset))
   {
-    g_free(mo_file_path);
-    return mo_strings;
+    goto error;
   }
 
-  fp = fopen(mo_file_path, "rb");
+  table->orig_tab = (const mo_string_desc *)(table->data + orig_tab_offset);
+  table->trans_tab = (const mo_string_desc *)(table->data + trans_tab_offset);
+
+  /* keep the load factor at or below 1/2 */
+  for (size = 2; size < nstrings * 2; size <<= 1)
+    ;
+
+  table->slots = g_new0(guint32, size);
+  table->mask = size - 1;
 
-  if (fp)
+  for (i = 0; i < nstrings; i++)
   {
-    if ((fread(&mo_hdr, sizeof(mo_hdr), 1, fp) == 1) &&
-        (!memcmp(&mo_hdr.magic, mo_magic1, sizeof(mo_hdr.magic)) ||
-         !memcmp(&mo_hdr.magic, mo_magic2, sizeof(mo_hdr.magic))) &&
-        (fseek(fp, mo_hdr.orig_tab_offset, SEEK_SET) != -1))
+    const gchar *trans;
+    guint32 slot;
+
+    if (!table->orig_tab[i].length ||
+        !mo_table_string(table, &table->orig_tab[i]))
     {
-      mo_string_desc *orig_tab = g_newa(mo_string_desc, mo_hdr.nstrings);
-      mo_string_desc *trans_tab = g_newa(mo_string_desc, mo_hdr.nstrings);
-      guint32 ns = mo_hdr.nstrings;
+      continue;
+    }
+
+    if (!(trans = mo_table_string(table, &table->trans_tab[i])))
+      continue;
 
-      if ((fread(orig_tab, sizeof(orig_tab[0]), ns, fp) == ns) &&
-          (fseek(fp, mo_hdr.trans_tab_offset, 0) != -1) &&
-          (fread(trans_tab, sizeof(trans_tab[0]), ns, fp) == ns))
+    for (slot = g_str_hash(trans) & table->mask; table->slots[slot];
+         slot = (slot + 1) & table->mask)
+    {
+      /* later entries win, like they did with a hash table */
+      if (!strcmp(table->data +
+                  mo_table_uint32(
+                    table, table->trans_tab[table->slots[slot] - 1].offset),
+                  trans))
       {
-        if (!msgids_table)
-        {
-          msgids_table = g_hash_table_new_full(
-            g_str_hash, g_str_equal, g_free,
-            (GDestroyNotify)g_hash_table_unref);
-        }
-
-        mo_strings = g_hash_table_new_full(
-          g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_free);
-
-        g_hash_table_insert(msgids_table, g_strdup(mo_file_path), mo_strings);
-
-        for (i = 0; i < mo_hdr.nstrings; i++)
-        {
-          if (orig_tab[i].length)
-          {
-            guint32 orig_len = orig_tab[i].length;
-            guint32 trans_len = trans_tab[i].length;
-            gchar *orig = g_malloc(orig_len + 1);
-            gchar *trans = g_malloc(trans_len + 1);
-
-            if ((fseek(fp, orig_tab[i].offset, SEEK_SET) != -1) &&
-                (fread(orig, 1, orig_len, fp) == orig_len) &&
-                (fseek(fp, trans_tab[i].offset, SEEK_SET) != -1) &&
-                (fread(trans, 1, trans_len, fp) == trans_len))
-            {
-              orig[orig_len] = 0;
-              trans[trans_len] = 0;
-              g_hash_table_insert(mo_strings, trans, orig);
-            }
-            else
-            {
-              g_free(orig);
-              g_free(trans);
-            }
-          }
-        }
+        break;
       }
     }
 
-    fclose(fp);
+    table->slots[slot] = i + 1;
+  }
+
+  return table;
+
+error:
+  g_mapped_file_unref(mapped);
+  g_slice_free(mo_table, table);
+
+  return NULL;
+}
+
+static const char *
+mo_table_lookup(const mo_table *table, const char *msgstr)
+{
+  guint32 slot;
+
+  for (slot = g_str_hash(msgstr) & table->mask; table->slots[slot];
+       slot = (slot + 1) & table->mask)
+  {
+    guint32 i = table->slots[slot] - 1;
+    const gchar *trans =
+      table->data + mo_table_uint32(table, table->trans_tab[i].offset);
+
+    if (!strcmp(trans, msgstr))
+      return table->data + mo_table_uint32(table, table->orig_tab[i].offset);
+  }
+
+  return NULL;
+}
+
+static mo_table *
+osso_abook_msgids_get_table(const char *locale, const char *domain)
+{
+  gchar *mo_file_path;
+  mo_table *table = NULL;
+
+  g_return_val_if_fail(NULL != domain, NULL);
+
+  mo_file_path = osso_abook_msgids_locate(locale, domain);
+
+  if (!mo_file_path)
+    return NULL;
+
+  if (msgids_table)
+    table = g_hash_table_lookup(msgids_table, mo_file_path);
+
+  if (!table && (table = mo_table_new(mo_file_path)))
+  {
+    if (!msgids_table)
+    {
+      msgids_table = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify)mo_table_free);
+    }
+
+    g_hash_table_insert(msgids_table, mo_file_path, table);
+    mo_file_path = NULL;
   }
 
   g_free(mo_file_path);
 
-  return mo_strings;
+  return table;
 }
 
 const char *
 osso_abook_msgids_rfind(const char *locale, const char *domain,
                         const char *msgstr)
 {
-  GHashTable *hashtable;
+  mo_table *table;
 
   g_return_val_if_fail(NULL != domain, NULL);
   g_return_val_if_fail(NULL != msgstr, NULL);
 
-  hashtable = osso_abook_msgids_get_table(locale, domain);
+  table = osso_abook_msgids_get_table(locale, domain);
 
-  if (hashtable)
-    return g_hash_table_lookup(hashtable, msgstr);
+  if (table)
+    return mo_table_lookup(table, msgstr);
 
   return NULL;
 }
@@ -4,6 +4,7 @@
 
 #include "eds.h"
 #include "osso-abook-account-manager.h"
+#include "osso-abook-contact-private.h"
 #include "osso-abook-debug.h"
 #include "osso-abook-enums.h"
 #include "osso-abook-roster.h"
@@ -476,8 +477,15 @@ contacts_added_or_changed(OssoABookRoster *roster, guint sig, GQuark detail,
 {
   if (contacts->len)
   {
+    OssoABookContact **c;
+
     g_ptr_array_add(contacts, NULL);
     g_signal_emit(roster, sig, detail, contacts->pdata);
+
+    /* handlers may have replaced the contacts with reset master contacts,
+     * whose changed fields must not leak into later emissions */
+    for (c = (OssoABookContact **)contacts->pdata; *c; c++)
+      _osso_abook_contact_clear_changed_fields(*c);
   }
 
   g_ptr_array_free(contacts, FALSE);
@@ -491,12 +499,9 @@ contacts_added_cb(EBookView *view, GList *vcards, OssoABookRoster *roster)
 
   for (l = vcards; l; l = l->next)
   {
-    gchar *vcs = e_vcard_to_string(E_VCARD(l->data), EVC_FORMAT_VCARD_30);
-    OssoABookContact *contact = osso_abook_contact_new_from_vcard(
-      e_contact_get_const(l->data, E_CONTACT_UID), vcs);
+    OssoABookContact *contact = osso_abook_contact_new_from_template(l->data);
 
-    OSSO_ABOOK_DUMP_VCARD_STRING(EDS, vcs, "adding");
-    g_free(vcs);
+    OSSO_ABOOK_DUMP_VCARD(EDS, l->data, "adding");
 
     if (contact)
     {
@@ -505,6 +510,7 @@ contacts_added_cb(EBookView *view, GList *vcards, OssoABookRoster *roster)
     }
   }
 
+  OSSO_ABOOK_COUNT("roster-contacts-parsed", contacts->len);
   contacts_added_or_changed(roster, signals[CONTACTS_ADDED], 0, contacts);
 }
 
@@ -516,11 +522,7 @@ contacts_changed_cb(EBookView *view, GList *vcards, OssoABookRoster *roster)
 
   for (l = vcards; l; l = l->next)
   {
-    gchar *vcard = e_vcard_to_string(E_VCARD(l->data), EVC_FORMAT_VCARD_30);
-    OssoABookContact *contact = osso_abook_contact_new_from_vcard(
-      e_contact_get_const(l->data, E_CONTACT_UID), vcard);
-
-    g_free(vcard);
+    OssoABookContact *contact = osso_abook_contact_new_from_template(l->data);
 
     if (contact)
     {
@@ -529,6 +531,7 @@ contacts_changed_cb(EBookView *view, GList *vcards, OssoABookRoster *roster)
     }
   }
 
+  OSSO_ABOOK_COUNT("roster-contacts-parsed", contacts->len);
   contacts_added_or_changed(roster, signals[CONTACTS_CHANGED], master,
                             contacts);
 }
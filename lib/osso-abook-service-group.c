@@ -22,6 +22,7 @@
 #include <gtk/gtkprivate.h>
 
 #include "osso-abook-account-manager.h"
+#include "osso-abook-contact-private.h"
 #include "osso-abook-log.h"
 #include "osso-abook-roster-manager.h"
 #include "osso-abook-roster.h"
@@ -179,9 +180,8 @@ osso_abook_service_group_includes_contact(OssoABookGroup *grp,
 {
   OssoABookServiceGroup *group;
   OssoABookServiceGroupPrivate *priv;
-  GList *contacts;
-  GList *l;
-  gboolean rv = FALSE;
+  OssoABookContactRosterIter iter;
+  OssoABookContact *roster_contact;
 
   g_return_val_if_fail(OSSO_ABOOK_IS_SERVICE_GROUP(grp), FALSE);
 
@@ -194,20 +194,15 @@ osso_abook_service_group_includes_contact(OssoABookGroup *grp,
   if (osso_abook_contact_is_roster_contact(contact))
     return osso_abook_contact_get_account(contact) == priv->account;
 
-  contacts = osso_abook_contact_get_roster_contacts(contact);
+  _osso_abook_contact_roster_iter_init(&iter, contact);
 
-  for (l = contacts; l; l = l->next)
+  while (_osso_abook_contact_roster_iter_next(&iter, &roster_contact))
   {
-    if (osso_abook_contact_get_account(l->data) == priv->account)
-    {
-      rv = TRUE;
-      break;
-    }
+    if (osso_abook_contact_get_account(roster_contact) == priv->account)
+      return TRUE;
   }
 
-  g_list_free(contacts);
-
-  return rv;
+  return FALSE;
 }
 
 static int
@@ -28,13 +28,78 @@
 
 #include "config.h"
 
+#include "osso-abook-debug.h"
 #include "osso-abook-errors.h"
 #include "osso-abook-log.h"
 #include "osso-abook-settings.h"
 #include "osso-abook-utils-private.h"
 
+/* frequently read keys, cached to keep GConf out of the hot paths */
+typedef enum
+{
+  SETTING_NAME_ORDER,
+  SETTING_CONTACT_ORDER,
+  SETTING_SMS_BUTTON,
+  SETTING_VIDEO_BUTTON,
+  SETTING_COUNT
+} OssoABookSetting;
+
+static const struct
+{
+  const char *key;
+  GConfValueType type;
+  gint default_value;
+} settings[SETTING_COUNT] =
+{
+  {
+    OSSO_ABOOK_SETTINGS_KEY_NAME_ORDER, GCONF_VALUE_INT,
+    OSSO_ABOOK_NAME_ORDER_FIRST
+  },
+  {
+    OSSO_ABOOK_SETTINGS_KEY_CONTACT_ORDER, GCONF_VALUE_INT,
+    OSSO_ABOOK_CONTACT_ORDER_NAME
+  },
+  { OSSO_ABOOK_SETTINGS_KEY_SMS_BUTTON, GCONF_VALUE_BOOL, FALSE },
+  { OSSO_ABOOK_SETTINGS_KEY_VIDEO_BUTTON, GCONF_VALUE_BOOL, FALSE }
+};
+
 static GConfClient *gconf = NULL;
 
+static volatile gint setting_values[SETTING_COUNT];
+static volatile gint setting_valid[SETTING_COUNT];
+
+static gint
+setting_value_from_gconf(OssoABookSetting setting, const GConfValue *val)
+{
+  if (!val || (val->type != settings[setting].type))
+    return settings[setting].default_value;
+
+  if (val->type == GCONF_VALUE_BOOL)
+    return gconf_value_get_bool(val);
+
+  return gconf_value_get_int(val);
+}
+
+static void
+settings_notify_cb(GConfClient *client, guint cnxn_id, GConfEntry *entry,
+                   gpointer user_data)
+{
+  const char *key = gconf_entry_get_key(entry);
+  int i;
+
+  for (i = 0; i < SETTING_COUNT; i++)
+  {
+    if (g_str_equal(key, settings[i].key))
+    {
+      g_atomic_int_set(&setting_values[i],
+                       setting_value_from_gconf(i,
+                                                gconf_entry_get_value(entry)));
+      g_atomic_int_set(&setting_valid[i], TRUE);
+      break;
+    }
+  }
+}
+
 GConfClient *
 osso_abook_get_gconf_client(void)
 {
@@ -43,56 +108,71 @@ osso_abook_get_gconf_client(void)
     gconf = gconf_client_get_default();
     gconf_client_add_dir(gconf, "/apps/osso-addressbook",
                          GCONF_CLIENT_PRELOAD_RECURSIVE, NULL);
+
+    /* registered first and on the directory, so the cache is updated before
+     * any per-key listener gets to read it */
+    gconf_client_notify_add(gconf, "/apps/osso-addressbook",
+                            settings_notify_cb, NULL, NULL, NULL);
   }
 
   return gconf;
 }
 
-OssoABookNameOrder
-osso_abook_settings_get_name_order(void)
+static gint
+settings_get(OssoABookSetting setting)
 {
-  GConfValue *val = gconf_client_get(osso_abook_get_gconf_client(),
-                                     OSSO_ABOOK_SETTINGS_KEY_NAME_ORDER, NULL);
-  OssoABookNameOrder order = OSSO_ABOOK_NAME_ORDER_FIRST;
+  GConfClient *client = osso_abook_get_gconf_client();
+  GConfValue *val;
+  gint value;
+
+  if (g_atomic_int_get(&setting_valid[setting]))
+    return g_atomic_int_get(&setting_values[setting]);
+
+  val = gconf_client_get(client, settings[setting].key, NULL);
+  value = setting_value_from_gconf(setting, val);
 
   if (val)
-  {
-    order = gconf_value_get_int(val);
     gconf_value_free(val);
-  }
 
-  return order;
+  OSSO_ABOOK_COUNT("settings-gconf-reads", 1);
+  OSSO_ABOOK_NOTE(GENERIC, "read %s from GConf", settings[setting].key);
+
+  g_atomic_int_set(&setting_values[setting], value);
+  g_atomic_int_set(&setting_valid[setting], TRUE);
+
+  return value;
 }
 
-OssoABookContactOrder
-osso_abook_settings_get_contact_order(void)
+static void
+settings_set(OssoABookSetting setting, gint value)
 {
-  GConfValue *val = gconf_client_get(osso_abook_get_gconf_client(),
-                                     OSSO_ABOOK_SETTINGS_KEY_CONTACT_ORDER,
-                                     NULL);
-  OssoABookContactOrder order = OSSO_ABOOK_CONTACT_ORDER_NAME;
+  /* don't wait for the notification, the next read must see the new value */
+  g_atomic_int_set(&setting_values[setting], value);
+  g_atomic_int_set(&setting_valid[setting], TRUE);
+}
 
-  if (val)
-  {
-    order = gconf_value_get_int(val);
-    gconf_value_free(val);
-  }
+OssoABookNameOrder
+osso_abook_settings_get_name_order(void)
+{
+  return settings_get(SETTING_NAME_ORDER);
+}
 
-  return order;
+OssoABookContactOrder
+osso_abook_settings_get_contact_order(void)
+{
+  return settings_get(SETTING_CONTACT_ORDER);
 }
 
 gboolean
 osso_abook_settings_get_sms_button()
 {
-  return gconf_client_get_bool(osso_abook_get_gconf_client(),
-                               OSSO_ABOOK_SETTINGS_KEY_SMS_BUTTON, FALSE);
+  return settings_get(SETTING_SMS_BUTTON);
 }
 
 gboolean
 osso_abook_settings_get_video_button()
 {
-  return gconf_client_get_bool(osso_abook_get_gconf_client(),
-                               OSSO_ABOOK_SETTINGS_KEY_VIDEO_BUTTON, FALSE);
+  return settings_get(SETTING_VIDEO_BUTTON);
 }
 
 const char *
@@ -281,6 +361,9 @@ osso_abook_settings_set_name_order(OssoABookNameOrder order)
 
   osso_abook_handle_gerror(NULL, error);
 
+  if (rv)
+    settings_set(SETTING_NAME_ORDER, order);
+
   return rv;
 }
 
@@ -295,6 +378,9 @@ osso_abook_settings_set_contact_order(OssoABookContactOrder order)
                             &error);
   osso_abook_handle_gerror(NULL, error);
 
+  if (rv)
+    settings_set(SETTING_CONTACT_ORDER, order);
+
   return rv;
 }
 
@@ -309,6 +395,9 @@ osso_abook_settings_set_video_button(gboolean enabled)
                              &error);
   osso_abook_handle_gerror(NULL, error);
 
+  if (rv)
+    settings_set(SETTING_VIDEO_BUTTON, enabled != FALSE);
+
   return rv;
 }
 
@@ -323,5 +412,8 @@ osso_abook_settings_set_sms_button(gboolean enabled)
                              &error);
   osso_abook_handle_gerror(NULL, error);
 
+  if (rv)
+    settings_set(SETTING_SMS_BUTTON, enabled != FALSE);
+
   return rv;
 }
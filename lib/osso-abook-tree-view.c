@@ -50,8 +50,9 @@ struct _OssoABookTreeViewPrivate
   guint8 border_color[4];
   GHashTable *contact_data;
   guint sync_avatar_images_id;
-  GQueue *row_queue1;
-  GQueue *row_queue2;
+  guint avatar_prefetch_rows;
+  gint avatar_first_visible;
+  gint avatar_pan_direction;
   guint show_tree_id;
   int index;
 };
@@ -72,9 +73,14 @@ enum
   PARAM_SENSITIVE_CAPS,
   PARAM_EMPTY_TEXT,
   PARAM_HILDON_UI_MODE,
-  PARAM_AGGREGATION_ACCOUNT
+  PARAM_AGGREGATION_ACCOUNT,
+  PARAM_AVATAR_PREFETCH_ROWS
 };
 
+/* time an idle callback may spend on creating avatars, in usecs */
+#define AVATAR_BATCH_BUDGET 4000
+#define DEFAULT_AVATAR_PREFETCH_ROWS 10
+
 struct _OssoABookTreeViewContact
 {
   OssoABookTreeView *view;
@@ -164,14 +170,12 @@ osso_abook_tree_view_init(OssoABookTreeView *view)
   priv->show_contact_name = TRUE;
   priv->aggregation_account = NULL;
   priv->avatar_radius = -1;
-  priv->row_queue1 = g_queue_new();
-  priv->row_queue2 = g_queue_new();
   priv->contact_data = g_hash_table_new_full(
     g_direct_hash, g_direct_equal, NULL, destroy_contact_data);
 }
 
 static void
-free_row_references(OssoABookTreeView *view)
+stop_avatar_loading(OssoABookTreeView *view)
 {
   OssoABookTreeViewPrivate *priv = OSSO_ABOOK_TREE_VIEW_PRIVATE(view);
 
@@ -180,11 +184,6 @@ free_row_references(OssoABookTreeView *view)
     g_source_remove(priv->sync_avatar_images_id);
     priv->sync_avatar_images_id = 0;
   }
-
-  g_queue_foreach(priv->row_queue1, (GFunc)gtk_tree_row_reference_free, NULL);
-  g_queue_clear(priv->row_queue1);
-  g_queue_foreach(priv->row_queue2, (GFunc)gtk_tree_row_reference_free, NULL);
-  g_queue_clear(priv->row_queue2);
 }
 
 static gboolean
@@ -362,7 +361,7 @@ sync_tree(OssoABookTreeView *view)
 {
   OssoABookTreeViewPrivate *priv = OSSO_ABOOK_TREE_VIEW_PRIVATE(view);
 
-  free_row_references(view);
+  stop_avatar_loading(view);
 
   if (!priv->show_tree_id)
   {
@@ -610,82 +609,111 @@ get_path_index(GtkTreePath *path)
   return index;
 }
 
+/* returns TRUE if the row at index had no avatar yet */
 static gboolean
-sync_avatar_images_idle(gpointer user_data)
+sync_avatar_image(OssoABookTreeView *view, GtkTreeModel *tree_model,
+                  gint index)
 {
-  OssoABookTreeView *view = user_data;
-  OssoABookTreeViewPrivate *priv = OSSO_ABOOK_TREE_VIEW_PRIVATE(view);
-  GQueue *queue = priv->row_queue1;
-  GtkTreeModel *tree_model;
-  gint start_index = 0;
-  gint end_index = G_MAXINT;
+  OssoABookListStoreRow *row;
   GtkTreeIter iter;
-  GtkTreePath *end_path;
-  GtkTreePath *start_path;
-  gboolean processing_q2 = FALSE;
 
-  if (!queue->length)
+  if ((index < 0) ||
+      !gtk_tree_model_iter_nth_child(tree_model, &iter, NULL, index))
   {
-    processing_q2 = TRUE;
-    queue = priv->row_queue2;
+    return FALSE;
   }
 
-  if (gtk_tree_view_get_visible_range(GTK_TREE_VIEW(priv->tree_view),
-                                      &start_path, &end_path))
+  row = osso_abook_row_model_iter_get_row(OSSO_ABOOK_ROW_MODEL(tree_model),
+                                          &iter);
+
+  if (!row || !row->contact ||
+      get_cached_avatar_image(view, row->contact, NULL))
   {
-    start_index = get_path_index(start_path);
-    end_index = get_path_index(end_path);
-    gtk_tree_path_free(start_path);
-    gtk_tree_path_free(end_path);
+    return FALSE;
   }
 
-  while (queue->length)
+  if (create_avatar_image(view, row->contact))
   {
-    GtkTreeRowReference *row_ref = g_queue_pop_head(queue);
-    GtkTreePath *path = gtk_tree_row_reference_get_path(row_ref);
+    GtkTreePath *path = gtk_tree_path_new_from_indices(index, -1);
 
-    if (path)
-    {
-      tree_model = gtk_tree_row_reference_get_model(row_ref);
+    gtk_tree_model_row_changed(tree_model, path, &iter);
+    gtk_tree_path_free(path);
+  }
 
-      if (gtk_tree_model_get_iter(tree_model, &iter, path))
-      {
-        OssoABookListStoreRow *row = osso_abook_row_model_iter_get_row(
-          OSSO_ABOOK_ROW_MODEL(tree_model), &iter);
+  return TRUE;
+}
 
-        if (row && row->contact &&
-            !get_cached_avatar_image(view, row->contact, NULL))
-        {
-          gint index = processing_q2 ? 0 : get_path_index(path);
+static gboolean
+sync_avatar_images_idle(gpointer user_data)
+{
+  OssoABookTreeView *view = user_data;
+  OssoABookTreeViewPrivate *priv = OSSO_ABOOK_TREE_VIEW_PRIVATE(view);
+  GtkTreeModel *tree_model =
+    gtk_tree_view_get_model(GTK_TREE_VIEW(priv->tree_view));
+  gint64 deadline = g_get_monotonic_time() + AVATAR_BATCH_BUDGET;
+  GtkTreePath *start_path;
+  GtkTreePath *end_path;
+  gint start_index;
+  gint n_visible;
+  gint i;
 
-          if (processing_q2 || ((index >= start_index) && (index <= end_index)))
-          {
-            if (create_avatar_image(view, row->contact))
-              gtk_tree_model_row_changed(tree_model, path, &iter);
+  if (!tree_model ||
+      !gtk_tree_view_get_visible_range(GTK_TREE_VIEW(priv->tree_view),
+                                       &start_path, &end_path))
+  {
+    priv->sync_avatar_images_id = 0;
+    return FALSE;
+  }
 
-            gtk_tree_path_free(path);
-            gtk_tree_row_reference_free(row_ref);
-            break;
-          }
+  start_index = get_path_index(start_path);
+  n_visible = get_path_index(end_path) - start_index + 1;
+  gtk_tree_path_free(start_path);
+  gtk_tree_path_free(end_path);
 
-          g_queue_push_head(priv->row_queue2, row_ref);
-          row_ref = NULL;
-        }
-      }
-    }
+  if (start_index > priv->avatar_first_visible)
+    priv->avatar_pan_direction = 1;
+  else if (start_index < priv->avatar_first_visible)
+    priv->avatar_pan_direction = -1;
 
-    gtk_tree_path_free(path);
-    gtk_tree_row_reference_free(row_ref);
-  }
+  priv->avatar_first_visible = start_index;
 
-  if (priv->row_queue1->length || priv->row_queue2->length)
-    return TRUE;
+  /* visible rows first, then the rows we are panning towards. rows that
+   * scrolled out of that window are simply not visited anymore */
+  for (i = 0; i < n_visible + (gint)priv->avatar_prefetch_rows; i++)
+  {
+    gint index;
+
+    if (i < n_visible)
+      index = start_index + i;
+    else if (priv->avatar_pan_direction < 0)
+      index = start_index - (i - n_visible + 1);
+    else
+      index = start_index + i;
+
+    if (sync_avatar_image(view, tree_model, index) &&
+        (g_get_monotonic_time() >= deadline))
+    {
+      return TRUE;
+    }
+  }
 
   priv->sync_avatar_images_id = 0;
 
   return FALSE;
 }
 
+static void
+schedule_avatar_loading(OssoABookTreeView *view)
+{
+  OssoABookTreeViewPrivate *priv = OSSO_ABOOK_TREE_VIEW_PRIVATE(view);
+
+  if (!priv->sync_avatar_images_id)
+  {
+    priv->sync_avatar_images_id = gdk_threads_add_idle_full(
+      300, sync_avatar_images_idle, view, NULL);
+  }
+}
+
 static void
 contact_avatar_cell_data(GtkTreeViewColumn *tree_column, GtkCellRenderer *cell,
                          GtkTreeModel *tree_model, GtkTreeIter *iter,
@@ -724,18 +752,7 @@ contact_avatar_cell_data(GtkTreeViewColumn *tree_column, GtkCellRenderer *cell,
       {
         if (get_path_index(path) > 9)
         {
-          OssoABookTreeViewPrivate *priv = OSSO_ABOOK_TREE_VIEW_PRIVATE(view);
-          GtkTreeRowReference *row_ref =
-            gtk_tree_row_reference_new(tree_model, path);
-
-          g_queue_push_tail(priv->row_queue1, row_ref);
-
-          if (!priv->sync_avatar_images_id)
-          {
-            priv->sync_avatar_images_id = gdk_threads_add_idle_full(
-              300, sync_avatar_images_idle, view, NULL);
-          }
-
+          schedule_avatar_loading(view);
           avatar_image = get_avatar_fallback_image(
             view, OSSO_ABOOK_AVATAR(row->contact));
         }
@@ -831,6 +848,9 @@ osso_abook_tree_view_get_property(GObject *object, guint property_id,
     case PARAM_AGGREGATION_ACCOUNT:
       g_value_set_object(value, priv->aggregation_account);
       break;
+    case PARAM_AVATAR_PREFETCH_ROWS:
+      g_value_set_uint(value, priv->avatar_prefetch_rows);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
       break;
@@ -942,6 +962,9 @@ osso_abook_tree_view_set_property(GObject *object, guint property_id,
       osso_abook_tree_view_set_aggregation_account(view,
                                                    g_value_get_object(value));
       break;
+    case PARAM_AVATAR_PREFETCH_ROWS:
+      priv->avatar_prefetch_rows = g_value_get_uint(value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
       break;
@@ -1479,7 +1502,7 @@ osso_abook_tree_view_dispose(GObject *object)
   }
 
   g_hash_table_remove_all(priv->contact_data);
-  free_row_references(view);
+  stop_avatar_loading(view);
 
   if (priv->show_tree_id)
     g_source_remove(priv->show_tree_id);
@@ -1495,8 +1518,6 @@ osso_abook_tree_view_finalize(GObject *object)
 
   g_free(priv->empty_text);
   g_hash_table_unref(priv->contact_data);
-  g_queue_free(priv->row_queue1);
-  g_queue_free(priv->row_queue2);
 
   G_OBJECT_CLASS(osso_abook_tree_view_parent_class)->finalize(object);
 }
@@ -1660,6 +1681,14 @@ osso_abook_tree_view_class_init(OssoABookTreeViewClass *klass)
       "A single MC Account to aggregate presence and avatar from (as opposed to all accounts).",
       TP_TYPE_ACCOUNT,
       GTK_PARAM_READWRITE));
+  g_object_class_install_property(
+    object_class, PARAM_AVATAR_PREFETCH_ROWS,
+    g_param_spec_uint(
+      "avatar-prefetch-rows",
+      "Avatar Prefetch Rows",
+      "Number of rows beyond the visible ones to load avatars for, in the direction of panning",
+      0, G_MAXUINT, DEFAULT_AVATAR_PREFETCH_ROWS,
+      GTK_PARAM_READWRITE | G_PARAM_CONSTRUCT));
   gtk_widget_class_install_style_property(
     widget_class,
     g_param_spec_int(
@@ -446,6 +446,40 @@ e_normalize_phone_number (const char *phone_number)
   return g_string_free(result, FALSE);
 }
 
+/* The key phone numbers are indexed by: the last 7 characters of the
+ * normalized number, which is what fuzzy matching compares. */
+gchar *
+_osso_abook_phone_number_get_index_key(const char *phone_number,
+                                       gboolean strip_dtmf)
+{
+  gchar *number;
+  gchar *normalized;
+  size_t len;
+
+  g_return_val_if_fail(NULL != phone_number, NULL);
+
+  if (strip_dtmf)
+  {
+    number = g_strndup(phone_number,
+                       strcspn(phone_number, OSSO_ABOOK_DTMF_CHARS));
+  }
+  else
+    number = g_strdup(phone_number);
+
+  normalized = e_normalize_phone_number(number);
+  len = strlen(normalized);
+
+  if (len > 7)
+    memmove(normalized, &normalized[len - 7], 8);
+
+  g_free(number);
+
+  for (number = normalized; *number; number++)
+    *number = g_ascii_toupper(*number);
+
+  return normalized;
+}
+
 EBookQuery *
 osso_abook_query_phone_number(const char *phone_number, gboolean fuzzy_match)
 {
@@ -666,54 +700,26 @@ _size_prepared_cb(GdkPixbufLoader *loader, gint width, gint height,
                   gpointer user_data)
 {
   struct OssoABookAsyncPixbufData *data = user_data;
-  int req_width = data->width;
-  int req_height = data->height;
+  GdkPixbufFormat *format = gdk_pixbuf_loader_get_format(data->pixbuf_loader);
 
-  if ((req_width > 0) && (req_height > 0))
+  if (_osso_abook_get_decode_size(&width, &height, data->width, data->height,
+                                  data->preserve_aspect_ratio,
+                                  data->maximum_size,
+                                  format &&
+                                  gdk_pixbuf_format_is_scalable(format)))
   {
-    if (data->preserve_aspect_ratio)
-    {
-      double ratio = MIN((double)req_width / (double)width,
-                         (double)req_height / (double)height);
-
-      height = ratio * (double)height;
-      width = ratio * (double)width;
-    }
-    else
-    {
-      width = req_width;
-      width = req_height;
-    }
-
     gdk_pixbuf_loader_set_size(loader, width, height);
   }
-
-  if (!data->maximum_size)
-    return;
-
-  if (width * height > data->maximum_size)
+  else
   {
-    GdkPixbufFormat *format = gdk_pixbuf_loader_get_format(data->pixbuf_loader);
-
-    if (format && gdk_pixbuf_format_is_scalable(format))
-    {
-      double coeff =
-        sqrt((double)(width * height) / (double)data->maximum_size);
-
-      gdk_pixbuf_loader_set_size(loader, coeff * (double)width,
-                                 coeff * (double)height);
-    }
-    else
-    {
-      g_simple_async_result_set_handle_cancellation(data->async_result, FALSE);
-      g_simple_async_result_set_error(
-        data->async_result,
-        gdk_pixbuf_error_quark(),
-        gdk_pixbuf_error_quark(),
-        "Image exceeds arbitary size limit of %.1f mebipixels",
-        (((double)data->maximum_size) / 1024.f) / 1024.f);
-      g_cancellable_cancel(data->cancellable);
-    }
+    g_simple_async_result_set_handle_cancellation(data->async_result, FALSE);
+    g_simple_async_result_set_error(
+      data->async_result,
+      gdk_pixbuf_error_quark(),
+      gdk_pixbuf_error_quark(),
+      "Image exceeds arbitary size limit of %.1f mebipixels",
+      (((double)data->maximum_size) / 1024.f) / 1024.f);
+    g_cancellable_cancel(data->cancellable);
   }
 }
 
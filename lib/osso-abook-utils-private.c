@@ -90,6 +90,21 @@ osso_abook_list_pop(GList **list, gpointer data)
   return data;
 }
 
+static void
+fill_area(GdkPixbuf *pixbuf, int x, int y, int width, int height)
+{
+  GdkPixbuf *area;
+
+  if ((width <= 0) || (height <= 0))
+    return;
+
+  area = gdk_pixbuf_new_subpixbuf(pixbuf, x, y, width, height);
+  gdk_pixbuf_fill(area, 0x7F7F7F00);
+  g_object_unref(area);
+}
+
+/* Scales straight into the visible part of the result, so only the padding
+ * and the border are cleared and no intermediate pixbuf is needed. */
 GdkPixbuf *
 _osso_abook_scale_pixbuf_and_crop(const GdkPixbuf *image, int width, int height,
                                   int crop, int border_size)
@@ -105,8 +120,15 @@ _osso_abook_scale_pixbuf_and_crop(const GdkPixbuf *image, int width, int height,
   int cx;
   int pix_x;
   int pix_y;
+  int src_x;
+  int src_y;
+  int dest_x;
+  int dest_y;
+  int dest_w;
+  int dest_h;
+  int scaled_w;
+  int scaled_h;
   GdkPixbuf *scaled;
-  GdkPixbuf *src_pixbuf;
 
   in_w = gdk_pixbuf_get_width(image);
   in_h = gdk_pixbuf_get_height(image);
@@ -142,35 +164,229 @@ _osso_abook_scale_pixbuf_and_crop(const GdkPixbuf *image, int width, int height,
   pix_x = (width - cx) / 2;
   pix_y = (height - cy) / 2;
 
-  src_pixbuf = gdk_pixbuf_scale_simple(image, cx, cy, GDK_INTERP_BILINEAR);
+  src_x = width > cx ? 0 : (width - cx) / -2;
+  src_y = height > cy ? 0 : (height - cy) / -2;
+  dest_x = pix_x < 0 ? border_size : border_size + pix_x;
+  dest_y = pix_y < 0 ? border_size : border_size + pix_y;
+  dest_w = cx >= width ? width : cx;
+  dest_h = cy >= height ? height : cy;
 
-  scaled = gdk_pixbuf_new(0, 1, 8, width + 2 * border_size,
-                          height + 2 * border_size);
+  scaled_w = width + 2 * border_size;
+  scaled_h = height + 2 * border_size;
+  scaled = gdk_pixbuf_new(0, 1, 8, scaled_w, scaled_h);
 
-  gdk_pixbuf_fill(scaled, 0x7F7F7F00);
+  if ((dest_w <= 0) || (dest_h <= 0))
+  {
+    gdk_pixbuf_fill(scaled, 0x7F7F7F00);
+    return scaled;
+  }
 
-  gdk_pixbuf_copy_area(src_pixbuf,
-                       width > cx ? 0 : (width - cx) / -2,
-                       height > cy ? 0 : (height - cy) / -2,
-                       cx >= width ? width : cx,
-                       cy >= height ? height : cy, scaled,
-                       pix_x < 0 ? border_size : border_size + pix_x,
-                       pix_y < 0 ? border_size : border_size + pix_y);
+  fill_area(scaled, 0, 0, scaled_w, dest_y);
+  fill_area(scaled, 0, dest_y + dest_h, scaled_w, scaled_h - dest_y - dest_h);
+  fill_area(scaled, 0, dest_y, dest_x, dest_h);
+  fill_area(scaled, dest_x + dest_w, dest_y, scaled_w - dest_x - dest_w,
+            dest_h);
 
-  g_object_unref(src_pixbuf);
+  /* same sampling as gdk_pixbuf_scale_simple() to cx x cy followed by
+   * copying the visible area */
+  gdk_pixbuf_scale(image, scaled, dest_x, dest_y, dest_w, dest_h,
+                   dest_x - src_x, dest_y - src_y,
+                   (double)cx / (double)in_w, (double)cy / (double)in_h,
+                   GDK_INTERP_BILINEAR);
 
   return scaled;
 }
 
+gboolean
+_osso_abook_get_decode_size(int *width, int *height, int req_width,
+                            int req_height, gboolean preserve_aspect_ratio,
+                            gsize maximum_size, gboolean scalable)
+{
+  if ((req_width > 0) && (req_height > 0))
+  {
+    if (preserve_aspect_ratio)
+    {
+      double ratio = MIN((double)req_width / (double)*width,
+                         (double)req_height / (double)*height);
+
+      *height = ratio * (double)*height;
+      *width = ratio * (double)*width;
+    }
+    else
+    {
+      *width = req_width;
+      *height = req_height;
+    }
+  }
+
+  if (!maximum_size || (*width * *height <= maximum_size))
+    return TRUE;
+
+  if (!scalable)
+    return FALSE;
+
+  {
+    double coeff = sqrt((double)maximum_size / (double)(*width * *height));
+
+    *width = coeff * (double)*width;
+    *height = coeff * (double)*height;
+  }
+
+  return TRUE;
+}
+
+/* how a pixel of the r x r corner square is affected, see corner_mask_new() */
+typedef enum
+{
+  CORNER_CLEAR,
+  CORNER_FADE,
+  CORNER_BLEND
+} CornerOp;
+
+typedef struct
+{
+  CornerOp op;
+  /* fixed point 16.16 weight of the pixel, exact if weight_exact */
+  guint32 weight;
+  gboolean weight_exact;
+  /* floating point weight of the pixel and, for CORNER_BLEND, of the border
+   * color */
+  double c;
+  double border_c;
+} CornerWeight;
+
+typedef struct
+{
+  int radius;
+  /* number of pixels to touch on each row, pixels after are left alone */
+  int *row_len;
+  /* radius x radius weights, starting from the corner */
+  CornerWeight *weights;
+} CornerMask;
+
+G_LOCK_DEFINE_STATIC(corner_masks);
+static GHashTable *corner_masks = NULL;
+
+/* Finds a weight for which (a * weight) >> 16 truncates the same way as
+ * (guchar)(a * c) does, so the integer path matches the floating point one
+ * for every 8 bit value. */
+static gboolean
+corner_weight_init(CornerWeight *weight, double c)
+{
+  guint32 w = c * 65536.0;
+  guint32 candidates[] = { w, w + 1, w - 1, w + 2 };
+  int i;
+
+  weight->c = c;
+
+  for (i = 0; i < G_N_ELEMENTS(candidates); i++)
+  {
+    guint32 a;
+
+    for (a = 0; a < 256; a++)
+    {
+      if (((a * candidates[i]) >> 16) != (guchar)(a * c))
+        break;
+    }
+
+    if (a == 256)
+    {
+      weight->weight = candidates[i];
+      weight->weight_exact = TRUE;
+
+      return TRUE;
+    }
+  }
+
+  weight->weight_exact = FALSE;
+
+  return FALSE;
+}
+
+static CornerMask *
+corner_mask_new(int r)
+{
+  CornerMask *mask = g_new(CornerMask, 1);
+  int i;
+
+  mask->radius = r;
+  mask->row_len = g_new0(int, r);
+  mask->weights = g_new0(CornerWeight, r * r);
+
+  for (i = r; i; i--)
+  {
+    int i2 = i * i;
+    int j;
+
+    for (j = r; j; j--)
+    {
+      CornerWeight *weight = &mask->weights[(r - i) * r + r - j];
+      double r1 = sqrt(i2 + j * j) - r;
+
+      /* pixels closer to the center are left alone, and so are all of the
+       * remaining pixels of the row */
+      if (r1 < -1.0)
+        break;
+
+      mask->row_len[r - i] = r - j + 1;
+
+      if (r1 >= 1.0)
+        weight->op = CORNER_CLEAR;
+      else if (r1 > 0.0)
+      {
+        weight->op = CORNER_FADE;
+        corner_weight_init(weight, 1.0 - r1);
+      }
+      else
+      {
+        weight->op = CORNER_BLEND;
+        weight->border_c = r1 + 1.0;
+        corner_weight_init(weight, -r1);
+      }
+    }
+  }
+
+  return mask;
+}
+
+static const CornerMask *
+get_corner_mask(int r)
+{
+  CornerMask *mask;
+
+  G_LOCK(corner_masks);
+
+  if (!corner_masks)
+    corner_masks = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  mask = g_hash_table_lookup(corner_masks, GINT_TO_POINTER(r));
+
+  if (!mask)
+  {
+    mask = corner_mask_new(r);
+    g_hash_table_insert(corner_masks, GINT_TO_POINTER(r), mask);
+  }
+
+  G_UNLOCK(corner_masks);
+
+  return mask;
+}
+
+static inline guchar
+corner_weight_apply(const CornerWeight *weight, guchar v)
+{
+  if (G_LIKELY(weight->weight_exact))
+    return (v * weight->weight) >> 16;
+
+  return v * weight->c;
+}
+
 void
 _osso_abook_pixbuf_cut_corners(GdkPixbuf *pixbuf, const int radius,
                                const guint8 border_color[4])
 {
+  const CornerMask *mask;
   int r;
-  guchar *pq3;
-  guchar *pq2;
-  guchar *pq1;
-  guchar *pq4;
   guchar *quad2;
   guchar *quad1;
   guchar *quad3;
@@ -205,88 +421,83 @@ _osso_abook_pixbuf_cut_corners(GdkPixbuf *pixbuf, const int radius,
   quad4 = &quad3[row_pixels - 4];
   quad2 = pixels;
 
-  pq1 = quad1;
-  pq2 = quad2;
-  pq3 = quad3;
-  pq4 = quad4;
+  mask = r > 0 ? get_corner_mask(r) : NULL;
 
-  for (i = r; i; i--)
+  for (i = 0; i < r; i++)
   {
-    int i2 = i * i;
+    const CornerWeight *weight = &mask->weights[i * r];
+    guchar *pq1 = quad1;
+    guchar *pq2 = quad2;
+    guchar *pq3 = quad3;
+    guchar *pq4 = quad4;
     int j;
 
-    for (j = r; j; j--)
+    for (j = mask->row_len[i]; j; j--, weight++)
     {
-      double r1 = sqrt(i2 + j * j) - r;
+      switch (weight->op)
+      {
+        case CORNER_CLEAR:
+        {
+          pq4[3] = 0;
+          pq3[3] = 0;
+          pq1[3] = 0;
+          pq2[3] = 0;
+          break;
+        }
+        case CORNER_FADE:
+        {
+          if (!border_color)
+          {
+            pq1[3] = corner_weight_apply(weight, pq1[3]);
+            pq2[3] = corner_weight_apply(weight, pq2[3]);
+            pq3[3] = corner_weight_apply(weight, pq3[3]);
+            pq4[3] = corner_weight_apply(weight, pq4[3]);
+          }
+          else
+          {
+            guchar a = border_color[3] * weight->c;
 
-      if (r1 < -1.0)
-        continue;
+            memcpy(pq1, border_color, 3);
+            memcpy(pq2, border_color, 3);
+            memcpy(pq3, border_color, 3);
+            memcpy(pq4, border_color, 3);
 
-      if (r1 >= 1.0)
-      {
-        pq4[3] = 0;
-        pq3[3] = 0;
-        pq1[3] = 0;
-        pq2[3] = 0;
-      }
-      else if (r1 > 0.0)
-      {
-        double c = 1.0 - r1;
+            pq1[3] = a;
+            pq2[3] = a;
+            pq3[3] = a;
+            pq4[3] = a;
+          }
 
-        if (!border_color)
-        {
-          pq1[3] = pq1[3] * c;
-          pq2[3] = pq2[3] * c;
-          pq3[3] = pq3[3] * c;
-          pq4[3] = pq4[3] * c;
+          break;
         }
-        else
+        case CORNER_BLEND:
         {
-          guchar a = border_color[3] * c;
+          guchar b[4];
+          int k;
+
+          if (!border_color)
+            break;
 
-          memcpy(pq1, border_color, 3);
-          memcpy(pq2, border_color, 3);
-          memcpy(pq3, border_color, 3);
-          memcpy(pq4, border_color, 3);
+          b[0] = weight->border_c * border_color[0];
+          b[1] = weight->border_c * border_color[1];
+          b[2] = weight->border_c * border_color[2];
+          b[3] = weight->border_c * border_color[3];
 
-          pq1[3] = a;
-          pq2[3] = a;
-          pq3[3] = a;
-          pq4[3] = a;
+          for (k = 0; k < 3; k++)
+          {
+            pq1[k] = b[k] + corner_weight_apply(weight, pq1[k]);
+            pq2[k] = b[k] + corner_weight_apply(weight, pq2[k]);
+            pq3[k] = b[k] + corner_weight_apply(weight, pq3[k]);
+            pq4[k] = b[k] + corner_weight_apply(weight, pq4[k]);
+          }
+
+          pq1[3] = MAX(pq1[3], b[3]);
+          pq2[3] = MAX(pq2[3], b[3]);
+          pq3[3] = MAX(pq3[3], b[3]);
+          pq4[3] = MAX(pq4[3], b[3]);
+          break;
         }
       }
-      else if (border_color)
-      {
-        guchar b[4];
-        double c1 = r1 + 1.0;
-
-        r1 = -r1;
-
-        b[0] = c1 * border_color[0];
-        b[1] = c1 * border_color[1];
-        b[2] = c1 * border_color[2];
-        b[3] = c1 * border_color[3];
-
-        pq1[0] = b[0] + pq1[0] * r1;
-        pq1[1] = b[1] + pq1[1] * r1;
-        pq1[2] = b[2] + pq1[2] * r1;
-        pq1[3] = MAX(pq1[3], b[3]);
-
-        pq2[0] = b[0] + pq2[0] * r1;
-        pq2[1] = b[1] + pq2[1] * r1;
-        pq2[2] = b[2] + pq2[2] * r1;
-        pq2[3] = MAX(pq2[3], b[3]);
-
-        pq3[0] = b[0] + pq3[0] * r1;
-        pq3[1] = b[1] + pq3[1] * r1;
-        pq3[2] = b[2] + pq3[2] * r1;
-        pq3[3] = MAX(pq3[3], b[3]);
-
-        pq4[0] = b[0] + pq4[0] * r1;
-        pq4[1] = b[1] + pq4[1] * r1;
-        pq4[2] = b[2] + pq4[2] * r1;
-        pq4[3] = MAX(pq4[3], b[3]);
-      }
 
       pq1 -= 4;
       pq2 += 4;
@@ -298,11 +509,6 @@ _osso_abook_pixbuf_cut_corners(GdkPixbuf *pixbuf, const int radius,
     quad2 += rowstride;
     quad1 += rowstride;
     quad3 -= rowstride;
-
-    pq4 = quad4;
-    pq2 = quad2;
-    pq3 = quad3;
-    pq1 = quad1;
   }
 
   if (border_color)
@@ -331,6 +537,66 @@ _osso_abook_pixbuf_cut_corners(GdkPixbuf *pixbuf, const int radius,
   }
 }
 
+gunichar *
+_osso_abook_utf8_strcasestrip(const char *text)
+{
+  gunichar *buf = NULL;
+  size_t bufsize;
+  size_t j = 0;
+  size_t len;
+  const char *p = text;
+  const char *text_end;
+
+  if (!text || !*text)
+    return NULL;
+
+  bufsize = len = strlen(text);
+  text_end = &text[len];
+
+  buf = g_new(gunichar, bufsize + 1);
+
+  while (p < text_end)
+  {
+    gsize i;
+    gunichar d[G_UNICHAR_MAX_DECOMPOSITION_LENGTH];
+    gsize l = g_unichar_fully_decompose(
+      g_utf8_get_char(p), FALSE, d, G_N_ELEMENTS(d));
+
+    for (i = 0; i < l; i++)
+    {
+      gunichar uch = d[i];
+
+      if (j == bufsize)
+      {
+        bufsize += G_UNICHAR_MAX_DECOMPOSITION_LENGTH;
+        buf = g_realloc(buf, (bufsize + 1) * sizeof(gunichar));
+      }
+
+      switch (g_unichar_type(uch))
+      {
+        case G_UNICODE_TITLECASE_LETTER:
+        case G_UNICODE_UPPERCASE_LETTER:
+          buf[j++] = g_unichar_tolower(uch);
+          break;
+        case G_UNICODE_COMBINING_MARK:
+        case G_UNICODE_ENCLOSING_MARK:
+        case G_UNICODE_NON_SPACING_MARK:
+          break;
+        default:
+          buf[j++] = uch;
+          break;
+      }
+    }
+
+    if (!(p = g_utf8_next_char(p)))
+      break;
+  }
+
+  buf[j] = 0;
+
+  return buf;
+}
+
 gchar *
 _osso_abook_flags_to_string(GType flags_type, guint value)
 {
@@ -7,6 +7,9 @@
 #include <libebook/libebook.h>
 #include <hildon/hildon.h>
 
+#include "osso-abook-address-format.h"
+#include "osso-abook-types.h"
+
 G_BEGIN_DECLS
 
 #define IS_EMPTY(s) (!((s) && (((const char *)(s))[0])))
@@ -19,10 +22,27 @@ G_BEGIN_DECLS
 void
 disconnect_signal_if_connected(gpointer instance, gulong handler);
 
+/* formats with fmt instead of the format for the user's language, NULL if fmt
+ * is invalid */
+char *
+_osso_abook_address_format_with_format(OssoABookAddress *address,
+                                       const char *fmt);
+
 gchar *
 _osso_abook_avatar_get_cache_name(int width, int height, gboolean crop,
                                   int radius, const guint8 border_color[4]);
 
+/* entries are validated by comparing key, which identifies the source image,
+ * so lookups don't need the avatar's image */
+void
+_osso_abook_avatar_cache_add_for_key(OssoABookAvatarCache *cache,
+                                     OssoABookAvatar *avatar,
+                                     GdkPixbuf *pixbuf, const char *key);
+GdkPixbuf *
+_osso_abook_avatar_cache_lookup_for_key(OssoABookAvatarCache *cache,
+                                        OssoABookAvatar *avatar,
+                                        const char *key);
+
 void
 osso_abook_list_push(GList **list, gpointer data);
 gpointer
@@ -35,6 +55,20 @@ void
 _osso_abook_pixbuf_cut_corners(GdkPixbuf *pixbuf, const int radius,
                                const guint8 border_color[4]);
 
+/* fits width x height to the requested size, then shrinks it to at most
+ * maximum_size pixels if scalable. FALSE if it is still too large */
+gboolean
+_osso_abook_get_decode_size(int *width, int *height, int req_width,
+                            int req_height, gboolean preserve_aspect_ratio,
+                            gsize maximum_size, gboolean scalable);
+
+gunichar *
+_osso_abook_utf8_strcasestrip(const char *text);
+
+gchar *
+_osso_abook_phone_number_get_index_key(const char *phone_number,
+                                       gboolean strip_dtmf);
+
 gchar *
 _osso_abook_flags_to_string(GType flags_type, guint value);
 
@@ -0,0 +1,414 @@
+#include "config.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#include "osso-abook-address-format.h"
+#include "osso-abook-utils-private.h"
+
+#define BENCHMARK_ROUNDS 200
+
+static const char *values[] =
+{
+  "555", "ACME", "Some Street 1", "Some Town", "Some Region", "12345",
+  "Some Country"
+};
+
+/* old formatter, kept as the reference for full addresses */
+static gchar *
+format_address_old(OssoABookAddress *address, const char *fmt)
+{
+  const char *start;
+  const char *end;
+  const char *last_sep = NULL;
+  gchar *sep;
+  GString *formatted_address;
+  int bracket_count = 1;
+
+  g_return_val_if_fail(address, NULL);
+  g_return_val_if_fail(fmt, NULL);
+
+  start = strchr(fmt, '[');
+
+  if (!start)
+  {
+    g_warning("Group did not start with [ in: '%s'", fmt);
+    return NULL;
+  }
+
+  if (start[strlen(start) - 1] != ']')
+  {
+    g_warning("Group did not end with ] in: '%s'", fmt);
+    return NULL;
+  }
+
+  sep = g_strndup(fmt, start - fmt);
+  formatted_address = g_string_new("");
+  start++;
+  end = start;
+
+  do
+  {
+    gchar *token = NULL;
+
+    while (*end)
+    {
+      char c = *end;
+
+      if ((c == '[') || (c == ']') || (c == '|') || (c == '%'))
+        break;
+
+      end++;
+    }
+
+    if (end - start && (*end != '['))
+    {
+      token = g_strndup(start, end - start);
+
+      g_string_append(formatted_address, token);
+      g_free(token);
+      token = NULL;
+    }
+    else
+    {
+      switch (*end)
+      {
+        case '[':
+        {
+          end = strchr(end, ']');
+
+          if (end)
+          {
+            gchar *group;
+
+            if (last_sep)
+            {
+              group = g_strndup(last_sep + 1, end - last_sep);
+              last_sep = NULL;
+            }
+            else
+              group = g_strndup(start, end - start + 1);
+
+            token = format_address_old(address, group);
+            g_free(group);
+          }
+
+          break;
+        }
+        case ']':
+        {
+          token = g_strndup(start, end - start);
+          bracket_count--;
+
+          break;
+        }
+        case '|':
+        {
+          token = g_strdup(sep);
+          last_sep = end;
+          break;
+        }
+        case '%':
+        {
+          char *data = "";
+
+          switch (*(end + 1))
+          {
+            case 'B':
+            {
+              data = address->p_o_box;
+              break;
+            }
+            case 'C':
+            {
+              data = address->country;
+              break;
+            }
+            case 'E':
+            {
+              data = address->extension;
+              break;
+            }
+            case 'L':
+            {
+              data = address->city;
+              break;
+            }
+            case 'P':
+            {
+              data = address->postal;
+              break;
+            }
+            case 'R':
+            {
+              data = address->region;
+              break;
+            }
+            case 'S':
+            {
+              data = address->street;
+              break;
+            }
+            default:
+            {
+              g_warning("Unsupported format '%c'",
+                        g_utf8_get_char(g_utf8_next_char(end)));
+            }
+          }
+
+          token = g_strdup_printf("%s", data);
+          end++;
+          last_sep = end;
+        }
+      }
+
+      end++;
+    }
+
+    if (token)
+    {
+      g_string_append(formatted_address, token);
+      g_free(token);
+      token = NULL;
+    }
+
+    start = end;
+  }
+  while (*start);
+
+  g_free(sep);
+
+  if (bracket_count < 0)
+    g_warning("unmatched ]");
+
+  if (formatted_address->len)
+    return g_string_free(formatted_address, FALSE);
+
+  g_string_free(formatted_address, TRUE);
+
+  return NULL;
+}
+
+/* bit i of mask set means the i-th field of values is filled in */
+static void
+address_init(OssoABookAddress *address, guint mask)
+{
+  char **fields[] =
+  {
+    &address->p_o_box, &address->extension, &address->street, &address->city,
+    &address->region, &address->postal, &address->country
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(fields); i++)
+    *fields[i] = (mask & (1 << i)) ? (char *)values[i] : NULL;
+}
+
+/* empty fields leave out their items, literal text and separator included */
+static gboolean
+check_partial(const char *key, const char *fmt, guint mask, const char *s)
+{
+  const char *sep_end = strchr(fmt, '[');
+  gchar *sep = g_strndup(fmt, sep_end - fmt);
+  gchar *double_sep = g_strconcat(sep, sep, NULL);
+  gboolean ok = TRUE;
+  guint i;
+
+  if (!mask)
+    ok = s == NULL;
+  else if (!s || strstr(s, "(null)") || strstr(s, double_sep) ||
+           g_str_has_prefix(s, sep) || g_str_has_suffix(s, sep) ||
+           g_ascii_isspace(*s) || g_ascii_isspace(s[strlen(s) - 1]))
+  {
+    ok = FALSE;
+  }
+  else
+  {
+    for (i = 0; ok && i < G_N_ELEMENTS(values); i++)
+    {
+      if ((mask & (1 << i)) && !strstr(s, values[i]))
+        ok = FALSE;
+    }
+
+    /* the default format's only literal besides separators */
+    if (!(mask & 1) && g_str_has_prefix(fmt, ", [%E|%S|PB %B|"))
+      ok = ok && !strstr(s, "PB");
+  }
+
+  if (!ok)
+    g_printerr("%s, fields 0x%02x: unexpected \"%s\"\n", key, mask, s);
+
+  g_free(double_sep);
+  g_free(sep);
+
+  return ok;
+}
+
+static gboolean
+check_format(const char *key, const char *fmt)
+{
+  OssoABookAddress address;
+  gboolean ok = TRUE;
+  guint full = (1 << G_N_ELEMENTS(values)) - 1;
+  guint mask;
+
+  for (mask = 0; mask <= full; mask++)
+  {
+    gchar *s;
+
+    address_init(&address, mask);
+    s = _osso_abook_address_format_with_format(&address, fmt);
+
+    if (mask == full)
+    {
+      gchar *old = format_address_old(&address, fmt);
+
+      if (g_strcmp0(s, old))
+      {
+        g_printerr("%s: \"%s\", the old formatter gave \"%s\"\n", key, s, old);
+        ok = FALSE;
+      }
+
+      g_free(old);
+    }
+    else
+      ok = check_partial(key, fmt, mask, s) && ok;
+
+    g_free(s);
+  }
+
+  return ok;
+}
+
+static gboolean
+check_examples(void)
+{
+  static const struct
+  {
+    guint mask;
+    const char *expected;
+  }
+  examples[] =
+  {
+    { 0x7f, "ACME, Some Street 1, PB 555, 12345 Some Town, Some Region, "
+      "Some Country" },
+    /* the old formatter gave "ACME, Some Street 1, PB (null), ..." */
+    { 0x7e, "ACME, Some Street 1, 12345 Some Town, Some Region, "
+      "Some Country" },
+    { 0x0c, "Some Street 1, Some Town" },
+    { 0x20, "12345" },
+    { 0x48, "Some Town, Some Country" },
+    { 0x00, NULL }
+  };
+  const char *fmt = ", [%E|%S|PB %B| [%P|%L]|%R|%C]";
+  gboolean ok = TRUE;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(examples); i++)
+  {
+    OssoABookAddress address;
+    gchar *s;
+
+    address_init(&address, examples[i].mask);
+    s = _osso_abook_address_format_with_format(&address, fmt);
+
+    if (g_strcmp0(s, examples[i].expected))
+    {
+      g_printerr("fields 0x%02x: \"%s\", expected \"%s\"\n", examples[i].mask,
+                 s, examples[i].expected);
+      ok = FALSE;
+    }
+
+    g_free(s);
+  }
+
+  return ok;
+}
+
+static void
+benchmark(gchar **formats)
+{
+  OssoABookAddress address;
+  gint64 old_time = 0;
+  gint64 new_time = 0;
+  guint calls = 0;
+  guint round;
+  guint mask;
+  gchar **fmt;
+
+  for (fmt = formats; *fmt; fmt++)
+  {
+    for (mask = 0; mask < (1 << G_N_ELEMENTS(values)); mask++)
+    {
+      gint64 start;
+
+      address_init(&address, mask);
+
+      start = g_get_monotonic_time();
+
+      for (round = 0; round < BENCHMARK_ROUNDS; round++)
+        g_free(format_address_old(&address, *fmt));
+
+      old_time += g_get_monotonic_time() - start;
+      start = g_get_monotonic_time();
+
+      for (round = 0; round < BENCHMARK_ROUNDS; round++)
+        g_free(_osso_abook_address_format_with_format(&address, *fmt));
+
+      new_time += g_get_monotonic_time() - start;
+      calls += BENCHMARK_ROUNDS;
+    }
+  }
+
+  g_print("%u calls: old %.0f ns/call, new %.0f ns/call\n", calls,
+          old_time * 1000.0 / calls, new_time * 1000.0 / calls);
+}
+
+int
+main(int argc, char **argv)
+{
+  const char *path = ADDRESS_FORMATS_FILE;
+  gboolean run_benchmark = FALSE;
+  GKeyFile *key_file = g_key_file_new();
+  GError *error = NULL;
+  gchar **formats;
+  gchar **keys;
+  gboolean ok;
+  guint i;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--benchmark"))
+      run_benchmark = TRUE;
+    else
+      path = argv[i];
+  }
+
+  if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_KEEP_TRANSLATIONS,
+                                 &error))
+  {
+    g_printerr("cannot load %s: %s\n", path, error->message);
+    return 1;
+  }
+
+  keys = g_key_file_get_keys(key_file, "Address Formats", NULL, NULL);
+  formats = g_new0(gchar *, g_strv_length(keys) + 1);
+  ok = check_examples();
+
+  for (i = 0; keys[i]; i++)
+  {
+    formats[i] = g_key_file_get_value(key_file, "Address Formats", keys[i],
+                                      NULL);
+    ok = check_format(keys[i], formats[i]) && ok;
+  }
+
+  if (run_benchmark)
+    benchmark(formats);
+
+  g_strfreev(formats);
+  g_strfreev(keys);
+  g_key_file_free(key_file);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+#include "config.h"
+
+#include <glib-object.h>
+#include <glib.h>
+#include <hildon/hildon.h>
+#include <libebook/libebook.h>
+
+#include "osso-abook-account-manager.h"
+#include "osso-abook-contact.h"
+#include "osso-abook-debug.h"
+#include "osso-abook-roster.h"
+#include "osso-abook-waitable.h"
+
+static void
+contact_detached_cb(OssoABookContact *master_contact,
+                    OssoABookContact *roster_contact, gpointer user_data)
+{
+  (*(guint *)user_data)++;
+}
+
+static OssoABookContact *
+contact_new(const char *uid)
+{
+  OssoABookContact *contact = osso_abook_contact_new();
+
+  e_contact_set(E_CONTACT(contact), E_CONTACT_UID, (gpointer)uid);
+
+  return contact;
+}
+
+int
+main(int argc, char **argv)
+{
+  OssoABookAccountManager *manager;
+  OssoABookRoster *roster;
+  OssoABookContact *master;
+  OssoABookContact *roster_contact;
+  GList *accounts;
+  GList *attached;
+  GError *error = NULL;
+  guint detached = 0;
+  gboolean ok = TRUE;
+
+  hildon_gtk_init(&argc, &argv);
+  osso_abook_debug_init();
+
+  manager = osso_abook_account_manager_get_default();
+  osso_abook_waitable_run(OSSO_ABOOK_WAITABLE(manager), NULL, &error);
+
+  if (error)
+  {
+    g_printerr("account manager failed: %s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  accounts = osso_abook_account_manager_list_accounts(manager, NULL, NULL);
+
+  if (!accounts)
+  {
+    /* a roster contact needs a roster backed by an existing account */
+    g_printerr("no accounts, skipping\n");
+    return 0;
+  }
+
+  roster = osso_abook_roster_new(tp_account_get_path_suffix(accounts->data),
+                                 NULL, "x-jabber");
+  g_list_free(accounts);
+
+  master = contact_new("1");
+  roster_contact = contact_new("roster-1");
+  osso_abook_contact_set_roster(roster_contact, roster);
+
+  g_signal_connect(master, "contact-detached",
+                   G_CALLBACK(contact_detached_cb), &detached);
+
+  if (!osso_abook_contact_attach(master, roster_contact))
+  {
+    g_printerr("attach failed\n");
+    ok = FALSE;
+  }
+
+  if (!osso_abook_contact_detach(master, roster_contact) || detached != 1)
+  {
+    g_printerr("detach: \"contact-detached\" emitted %u time(s)\n", detached);
+    ok = FALSE;
+  }
+
+  attached = osso_abook_contact_get_roster_contacts(master);
+
+  if (attached)
+  {
+    g_printerr("roster contact still attached\n");
+    g_list_free(attached);
+    ok = FALSE;
+  }
+
+  /* detaching twice must fail and not emit again */
+  if (osso_abook_contact_detach(master, roster_contact) || detached != 1)
+  {
+    g_printerr("second detach succeeded\n");
+    ok = FALSE;
+  }
+
+  g_object_unref(roster_contact);
+  g_object_unref(master);
+  g_object_unref(roster);
+
+  return ok ? 0 : 1;
+}
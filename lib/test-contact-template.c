@@ -0,0 +1,132 @@
+#include "config.h"
+
+#include <glib-object.h>
+#include <glib.h>
+#include <libebook/libebook.h>
+
+#include <string.h>
+
+#include "osso-abook-contact.h"
+
+#define BENCHMARK_ROUNDS 2000
+
+static const char *vcards[] =
+{
+  "BEGIN:VCARD\r\n"
+  "VERSION:3.0\r\n"
+  "UID:1\r\n"
+  "N:Doe;John;;;\r\n"
+  "TEL;TYPE=CELL:+358401234567\r\n"
+  "END:VCARD",
+
+  "BEGIN:VCARD\r\n"
+  "VERSION:3.0\r\n"
+  "UID:2\r\n"
+  "N:Mustermann;Erika;;Dr.;\r\n"
+  "NICKNAME:erika\r\n"
+  "TEL;TYPE=HOME,VOICE:+49 30 1234567\r\n"
+  "TEL;TYPE=CELL:+49 170 7654321\r\n"
+  "TEL;TYPE=WORK:+49 30 7654321\r\n"
+  "EMAIL;TYPE=HOME:erika@example.org\r\n"
+  "EMAIL;TYPE=WORK:erika.mustermann@example.com\r\n"
+  "ADR;TYPE=HOME:;;Heidestrasse 17;Koeln;;51147;Germany\r\n"
+  "BDAY:1964-08-12\r\n"
+  "X-JABBER;TYPE=HOME:erika@jabber.example.org\r\n"
+  "X-SIP:erika@sip.example.org\r\n"
+  "NOTE:first line\\nsecond line\\, with a comma\r\n"
+  "END:VCARD",
+
+  "BEGIN:VCARD\r\n"
+  "VERSION:3.0\r\n"
+  "UID:3\r\n"
+  "FN:Only Formatted\r\n"
+  "X-OSSO-CONTACT-STATE:DELETED\r\n"
+  "X-TELEPATHY-PRESENCE:available;\r\n"
+  "END:VCARD"
+};
+
+/* the roster used to reparse the serialized vCard */
+static OssoABookContact *
+contact_new_reparsed(EContact *templ)
+{
+  gchar *vcs = e_vcard_to_string(E_VCARD(templ), EVC_FORMAT_VCARD_30);
+  OssoABookContact *contact = osso_abook_contact_new_from_vcard(
+    e_contact_get_const(templ, E_CONTACT_UID), vcs);
+
+  g_free(vcs);
+
+  return contact;
+}
+
+static gboolean
+check(EContact *templ)
+{
+  OssoABookContact *expected = contact_new_reparsed(templ);
+  OssoABookContact *actual = osso_abook_contact_new_from_template(templ);
+  gchar *expected_vcs = e_vcard_to_string(E_VCARD(expected),
+                                          EVC_FORMAT_VCARD_30);
+  gchar *actual_vcs = e_vcard_to_string(E_VCARD(actual), EVC_FORMAT_VCARD_30);
+  gboolean ok = !strcmp(expected_vcs, actual_vcs);
+
+  if (!ok)
+  {
+    g_printerr("copied contact differs:\n%s\nreparsed contact:\n%s\n",
+               actual_vcs, expected_vcs);
+  }
+
+  g_free(actual_vcs);
+  g_free(expected_vcs);
+  g_object_unref(actual);
+  g_object_unref(expected);
+
+  return ok;
+}
+
+static void
+benchmark(EContact *templ)
+{
+  gint64 old_time;
+  gint64 new_time;
+  gint64 start;
+  int round;
+
+  start = g_get_monotonic_time();
+
+  for (round = 0; round < BENCHMARK_ROUNDS; round++)
+    g_object_unref(contact_new_reparsed(templ));
+
+  old_time = g_get_monotonic_time() - start;
+  start = g_get_monotonic_time();
+
+  for (round = 0; round < BENCHMARK_ROUNDS; round++)
+    g_object_unref(osso_abook_contact_new_from_template(templ));
+
+  new_time = g_get_monotonic_time() - start;
+
+  g_print("%2u attributes: reparse %.0f ns/contact, copy %.0f ns/contact\n",
+          g_list_length(e_vcard_get_attributes(E_VCARD(templ))),
+          old_time * 1000.0 / BENCHMARK_ROUNDS,
+          new_time * 1000.0 / BENCHMARK_ROUNDS);
+}
+
+int
+main(int argc, char **argv)
+{
+  gboolean run_benchmark = argc > 1 && !strcmp(argv[1], "--benchmark");
+  gboolean ok = TRUE;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(vcards); i++)
+  {
+    EContact *templ = e_contact_new_from_vcard(vcards[i]);
+
+    ok = check(templ) && ok;
+
+    if (run_benchmark)
+      benchmark(templ);
+
+    g_object_unref(templ);
+  }
+
+  return ok ? 0 : 1;
+}
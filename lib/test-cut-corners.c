@@ -0,0 +1,299 @@
+#include "config.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "osso-abook-utils-private.h"
+
+#define BENCHMARK_ROUNDS 20000
+
+static const int sizes[] = { 47, 48, 64, 96, 144 };
+static const int radii[] = { -1, 0, 1, 2, 3, 5, 8, 12, 24, 72, 200 };
+
+/* old implementation, kept as the reference */
+static void
+cut_corners_old(GdkPixbuf *pixbuf, const int radius,
+                const guint8 border_color[4])
+{
+  int r;
+  guchar *pq3;
+  guchar *pq2;
+  guchar *pq1;
+  guchar *pq4;
+  guchar *quad2;
+  guchar *quad1;
+  guchar *quad3;
+  guchar *quad4;
+  int i;
+  int width;
+  int height;
+  int rowstride;
+  int row_pixels;
+  int total_pixels;
+  guchar *pixels;
+
+  width = gdk_pixbuf_get_width(pixbuf);
+  height = gdk_pixbuf_get_height(pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  pixels = gdk_pixbuf_get_pixels(pixbuf);
+
+  if (radius < 0)
+    r = (MIN(width, height) + 9) / 10;
+  else
+    r = MIN((MIN(width, height) + 1) / 2, radius);
+
+  row_pixels = 4 * width;
+  total_pixels = height * rowstride;
+
+  quad3 = &pixels[(height - 1) * rowstride];
+  quad1 = &pixels[row_pixels - 4];
+  quad4 = &quad3[row_pixels - 4];
+  quad2 = pixels;
+
+  pq1 = quad1;
+  pq2 = quad2;
+  pq3 = quad3;
+  pq4 = quad4;
+
+  for (i = r; i; i--)
+  {
+    int i2 = i * i;
+    int j;
+
+    for (j = r; j; j--)
+    {
+      double r1 = sqrt(i2 + j * j) - r;
+
+      if (r1 < -1.0)
+        continue;
+
+      if (r1 >= 1.0)
+      {
+        pq4[3] = 0;
+        pq3[3] = 0;
+        pq1[3] = 0;
+        pq2[3] = 0;
+      }
+      else if (r1 > 0.0)
+      {
+        double c = 1.0 - r1;
+
+        if (!border_color)
+        {
+          pq1[3] = pq1[3] * c;
+          pq2[3] = pq2[3] * c;
+          pq3[3] = pq3[3] * c;
+          pq4[3] = pq4[3] * c;
+        }
+        else
+        {
+          guchar a = border_color[3] * c;
+
+          memcpy(pq1, border_color, 3);
+          memcpy(pq2, border_color, 3);
+          memcpy(pq3, border_color, 3);
+          memcpy(pq4, border_color, 3);
+
+          pq1[3] = a;
+          pq2[3] = a;
+          pq3[3] = a;
+          pq4[3] = a;
+        }
+      }
+      else if (border_color)
+      {
+        guchar b[4];
+        double c1 = r1 + 1.0;
+
+        r1 = -r1;
+
+        b[0] = c1 * border_color[0];
+        b[1] = c1 * border_color[1];
+        b[2] = c1 * border_color[2];
+        b[3] = c1 * border_color[3];
+
+        pq1[0] = b[0] + pq1[0] * r1;
+        pq1[1] = b[1] + pq1[1] * r1;
+        pq1[2] = b[2] + pq1[2] * r1;
+        pq1[3] = MAX(pq1[3], b[3]);
+
+        pq2[0] = b[0] + pq2[0] * r1;
+        pq2[1] = b[1] + pq2[1] * r1;
+        pq2[2] = b[2] + pq2[2] * r1;
+        pq2[3] = MAX(pq2[3], b[3]);
+
+        pq3[0] = b[0] + pq3[0] * r1;
+        pq3[1] = b[1] + pq3[1] * r1;
+        pq3[2] = b[2] + pq3[2] * r1;
+        pq3[3] = MAX(pq3[3], b[3]);
+
+        pq4[0] = b[0] + pq4[0] * r1;
+        pq4[1] = b[1] + pq4[1] * r1;
+        pq4[2] = b[2] + pq4[2] * r1;
+        pq4[3] = MAX(pq4[3], b[3]);
+      }
+
+      pq1 -= 4;
+      pq2 += 4;
+      pq3 += 4;
+      pq4 -= 4;
+    }
+
+    quad4 -= rowstride;
+    quad2 += rowstride;
+    quad1 += rowstride;
+    quad3 -= rowstride;
+
+    pq4 = quad4;
+    pq2 = quad2;
+    pq3 = quad3;
+    pq1 = quad1;
+  }
+
+  if (border_color)
+  {
+    guchar *p = &pixels[4 * r + total_pixels - rowstride];
+    guchar *q = &pixels[4 * r];
+
+    for (i = width - r; i > r; i--)
+    {
+      memcpy(q, border_color, 4);
+      memcpy(p, border_color, 4);
+      q += 4;
+      p += 4;
+    }
+
+    p = &pixels[rowstride * r - 4 + row_pixels];
+    q = &pixels[rowstride * r];
+
+    for (i = height - r; i > r; i--)
+    {
+      memcpy(p, border_color, 4);
+      memcpy(q, border_color, 4);
+      q += rowstride;
+      p += rowstride;
+    }
+  }
+}
+
+static GdkPixbuf *
+random_pixbuf(GRand *rand, int size)
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, size, size);
+  guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+  gsize len = (gsize)gdk_pixbuf_get_rowstride(pixbuf) * size;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    pixels[i] = g_rand_int_range(rand, 0, 256);
+
+  return pixbuf;
+}
+
+static gboolean
+check(GdkPixbuf *source, int radius, const guint8 *border_color)
+{
+  GdkPixbuf *expected = gdk_pixbuf_copy(source);
+  GdkPixbuf *actual = gdk_pixbuf_copy(source);
+  int size = gdk_pixbuf_get_width(source);
+  int rowstride = gdk_pixbuf_get_rowstride(source);
+  gboolean ok;
+
+  cut_corners_old(expected, radius, border_color);
+  _osso_abook_pixbuf_cut_corners(actual, radius, border_color);
+
+  ok = !memcmp(gdk_pixbuf_get_pixels(expected), gdk_pixbuf_get_pixels(actual),
+               (gsize)rowstride * size);
+
+  if (!ok)
+  {
+    g_printerr("%dx%d, radius %d, %s border: pixels differ\n", size, size,
+               radius, border_color ? "with" : "no");
+  }
+
+  g_object_unref(actual);
+  g_object_unref(expected);
+
+  return ok;
+}
+
+static void
+benchmark(GRand *rand, const guint8 *border_color)
+{
+  guint i;
+
+  for (i = 1; i < G_N_ELEMENTS(sizes); i++)
+  {
+    GdkPixbuf *pixbuf = random_pixbuf(rand, sizes[i]);
+    gint64 old_time;
+    gint64 new_time;
+    gint64 start;
+    int round;
+
+    /* builds the corner mask, it is cached afterwards */
+    _osso_abook_pixbuf_cut_corners(pixbuf, -1, border_color);
+
+    start = g_get_monotonic_time();
+
+    for (round = 0; round < BENCHMARK_ROUNDS; round++)
+      cut_corners_old(pixbuf, -1, border_color);
+
+    old_time = g_get_monotonic_time() - start;
+    start = g_get_monotonic_time();
+
+    for (round = 0; round < BENCHMARK_ROUNDS; round++)
+      _osso_abook_pixbuf_cut_corners(pixbuf, -1, border_color);
+
+    new_time = g_get_monotonic_time() - start;
+
+    g_print("%3dx%-3d %s border: old %.0f ns/call, new %.0f ns/call\n",
+            sizes[i], sizes[i], border_color ? "with" : "  no",
+            old_time * 1000.0 / BENCHMARK_ROUNDS,
+            new_time * 1000.0 / BENCHMARK_ROUNDS);
+
+    g_object_unref(pixbuf);
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  static const guint8 border_colors[][4] =
+  {
+    { 0xff, 0x80, 0x10, 0xff },
+    { 0x20, 0x40, 0x60, 0x80 }
+  };
+  GRand *rand = g_rand_new_with_seed(0x0abc);
+  gboolean ok = TRUE;
+  guint i;
+  guint j;
+  guint k;
+
+  for (i = 0; i < G_N_ELEMENTS(sizes); i++)
+  {
+    GdkPixbuf *source = random_pixbuf(rand, sizes[i]);
+
+    for (j = 0; j < G_N_ELEMENTS(radii); j++)
+    {
+      ok = check(source, radii[j], NULL) && ok;
+
+      for (k = 0; k < G_N_ELEMENTS(border_colors); k++)
+        ok = check(source, radii[j], border_colors[k]) && ok;
+    }
+
+    g_object_unref(source);
+  }
+
+  if (argc > 1 && !strcmp(argv[1], "--benchmark"))
+  {
+    benchmark(rand, NULL);
+    benchmark(rand, border_colors[0]);
+  }
+
+  g_rand_free(rand);
+
+  return ok ? 0 : 1;
+}
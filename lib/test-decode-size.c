@@ -0,0 +1,68 @@
+#include "config.h"
+
+#include <glib.h>
+
+#include "osso-abook-utils-private.h"
+
+static const struct
+{
+  int width;
+  int height;
+  int req_width;
+  int req_height;
+  gboolean preserve_aspect_ratio;
+  gsize maximum_size;
+  gboolean scalable;
+  gboolean rv;
+  int expected_width;
+  int expected_height;
+}
+cases[] =
+{
+  /* nothing requested */
+  { 400, 300, 0, 0, TRUE, 0, FALSE, TRUE, 400, 300 },
+  { 400, 300, 100, 0, FALSE, 0, FALSE, TRUE, 400, 300 },
+  /* fit into the requested size */
+  { 400, 300, 100, 100, TRUE, 0, FALSE, TRUE, 100, 75 },
+  { 300, 400, 100, 100, TRUE, 0, FALSE, TRUE, 75, 100 },
+  /* the height used to be left at the source height */
+  { 400, 300, 100, 50, FALSE, 0, FALSE, TRUE, 100, 50 },
+  { 300, 400, 50, 100, FALSE, 0, FALSE, TRUE, 50, 100 },
+  /* within the limit */
+  { 1000, 1000, 0, 0, TRUE, 1000000, FALSE, TRUE, 1000, 1000 },
+  /* over the limit, the size used to be enlarged instead of reduced */
+  { 4000, 3000, 0, 0, TRUE, 1000000, TRUE, TRUE, 1154, 866 },
+  { 400, 300, 200, 200, FALSE, 10000, TRUE, TRUE, 100, 100 },
+  /* over the limit and not scalable */
+  { 4000, 3000, 0, 0, TRUE, 1000000, FALSE, FALSE, 4000, 3000 },
+  { 400, 300, 200, 200, FALSE, 10000, FALSE, FALSE, 200, 200 }
+};
+
+int
+main(int argc, char **argv)
+{
+  gboolean ok = TRUE;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(cases); i++)
+  {
+    int width = cases[i].width;
+    int height = cases[i].height;
+    gboolean rv = _osso_abook_get_decode_size(
+      &width, &height, cases[i].req_width, cases[i].req_height,
+      cases[i].preserve_aspect_ratio, cases[i].maximum_size,
+      cases[i].scalable);
+
+    if ((rv != cases[i].rv) || (width != cases[i].expected_width) ||
+        (height != cases[i].expected_height))
+    {
+      g_printerr("case %u: %s %dx%d, expected %s %dx%d\n", i,
+                 rv ? "TRUE" : "FALSE", width, height,
+                 cases[i].rv ? "TRUE" : "FALSE", cases[i].expected_width,
+                 cases[i].expected_height);
+      ok = FALSE;
+    }
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#include "config.h"
+
+#include <glib-object.h>
+#include <glib.h>
+#include <hildon/hildon.h>
+#include <libebook/libebook.h>
+
+#include "osso-abook-contact-model.h"
+#include "osso-abook-debug.h"
+#include "osso-abook-filter-model.h"
+
+static const char *names[] = { "Anna", "Andrew", "Bob" };
+
+static void
+row_changed_cb(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter,
+               gpointer user_data)
+{
+  (*(guint *)user_data)++;
+}
+
+static void
+row_deleted_cb(GtkTreeModel *model, GtkTreePath *path, gpointer user_data)
+{
+  (*(guint *)user_data)++;
+}
+
+static void
+notify_cb(GObject *object, GParamSpec *pspec, gpointer user_data)
+{
+  (*(guint *)user_data)++;
+}
+
+static gboolean
+check_visible(OssoABookFilterModel *filter, const char *prefix, gint expected,
+              guint deleted, guint expected_deleted, guint changed)
+{
+  gint visible = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(filter), NULL);
+
+  if (visible != expected || deleted != expected_deleted)
+  {
+    g_printerr("\"%s\": %d visible, %u hidden, expected %d and %u\n",
+               prefix, visible, deleted, expected, expected_deleted);
+    return FALSE;
+  }
+
+  if (changed)
+  {
+    g_printerr("\"%s\": base model emitted row-changed %u time(s)\n",
+               prefix, changed);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int
+main(int argc, char **argv)
+{
+  OssoABookContactModel *store;
+  OssoABookFilterModel *filter;
+  GList *rows = NULL;
+  guint changed = 0;
+  guint deleted = 0;
+  guint prefix_notified = 0;
+  gboolean ok = TRUE;
+  int i;
+
+  hildon_gtk_init(&argc, &argv);
+  osso_abook_debug_init();
+
+  store = osso_abook_contact_model_new();
+
+  for (i = G_N_ELEMENTS(names) - 1; i >= 0; i--)
+  {
+    OssoABookContact *contact = osso_abook_contact_new();
+
+    e_contact_set(E_CONTACT(contact), E_CONTACT_UID, (gpointer)names[i]);
+    e_contact_set(E_CONTACT(contact), E_CONTACT_GIVEN_NAME, (gpointer)names[i]);
+    rows = g_list_prepend(rows, osso_abook_list_store_row_new(contact));
+    g_object_unref(contact);
+  }
+
+  osso_abook_list_store_merge_rows(OSSO_ABOOK_LIST_STORE(store), rows);
+  g_list_free(rows);
+
+  filter = osso_abook_filter_model_new(OSSO_ABOOK_LIST_STORE(store));
+
+  /* a growing prefix must hide the rows in the filter model only, without
+   * emitting anything on the shared base model */
+  g_signal_connect(store, "row-changed", G_CALLBACK(row_changed_cb), &changed);
+
+  osso_abook_filter_model_set_prefix(filter, "a");
+  ok = check_visible(filter, "a", 2, deleted, 0, changed) && ok;
+
+  g_signal_connect(filter, "row-deleted", G_CALLBACK(row_deleted_cb),
+                   &deleted);
+  g_signal_connect(filter, "notify::prefix", G_CALLBACK(notify_cb),
+                   &prefix_notified);
+
+  osso_abook_filter_model_set_prefix(filter, "an");
+  ok = check_visible(filter, "an", 2, deleted, 0, changed) && ok;
+
+  osso_abook_filter_model_set_prefix(filter, "and");
+  ok = check_visible(filter, "and", 1, deleted, 1, changed) && ok;
+
+  if (prefix_notified)
+  {
+    g_printerr("\"prefix\" notified %u time(s) without change\n",
+               prefix_notified);
+    ok = FALSE;
+  }
+
+  g_object_unref(filter);
+  g_object_unref(store);
+
+  return ok ? 0 : 1;
+}
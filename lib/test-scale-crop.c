@@ -0,0 +1,240 @@
+#include "config.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+
+#include <string.h>
+
+#include "osso-abook-utils-private.h"
+
+#define BENCHMARK_ROUNDS 2000
+
+/* source sizes, photos are often much larger than the avatars made of them */
+static const int sources[][2] =
+{
+  { 48, 48 }, { 64, 48 }, { 48, 64 }, { 97, 31 }, { 31, 97 }, { 640, 480 },
+  { 480, 640 }, { 1024, 1024 }
+};
+static const int targets[][2] =
+{
+  { 48, 48 }, { 64, 64 }, { 144, 144 }, { 80, 60 }, { 60, 80 }, { 0, 0 },
+  { 0, 96 }, { 96, 0 }
+};
+static const int borders[] = { 0, 1, 4 };
+
+/* old implementation, kept as the reference */
+static GdkPixbuf *
+scale_pixbuf_and_crop_old(const GdkPixbuf *image, int width, int height,
+                          int crop, int border_size)
+{
+  int in_w;
+  int in_h;
+  double w;
+  double h;
+  double ratio_x;
+  double ratio_y;
+  double c;
+  int cy;
+  int cx;
+  int pix_x;
+  int pix_y;
+  GdkPixbuf *scaled;
+  GdkPixbuf *src_pixbuf;
+
+  in_w = gdk_pixbuf_get_width(image);
+  in_h = gdk_pixbuf_get_height(image);
+
+  if (width <= 0)
+    width = in_w;
+
+  if (height <= 0)
+    height = in_h;
+
+  w = (double)in_w;
+  h = (double)in_h;
+
+  ratio_x = (double)width / w;
+  ratio_y = (double)height / h;
+
+  if (crop)
+  {
+    if (ratio_x <= ratio_y)
+      ratio_x = (double)height / (double)in_h;
+  }
+  else if (ratio_x >= ratio_y)
+    ratio_x = (double)height / (double)in_h;
+
+  if (ratio_x < 3.0)
+    c = ratio_x;
+  else
+    c = 3.0;
+
+  cy = c * h;
+  cx = c * w;
+
+  pix_x = (width - cx) / 2;
+  pix_y = (height - cy) / 2;
+
+  src_pixbuf = gdk_pixbuf_scale_simple(image, cx, cy, GDK_INTERP_BILINEAR);
+
+  scaled = gdk_pixbuf_new(0, 1, 8, width + 2 * border_size,
+                          height + 2 * border_size);
+
+  gdk_pixbuf_fill(scaled, 0x7F7F7F00);
+
+  gdk_pixbuf_copy_area(src_pixbuf,
+                       width > cx ? 0 : (width - cx) / -2,
+                       height > cy ? 0 : (height - cy) / -2,
+                       cx >= width ? width : cx,
+                       cy >= height ? height : cy, scaled,
+                       pix_x < 0 ? border_size : border_size + pix_x,
+                       pix_y < 0 ? border_size : border_size + pix_y);
+
+  g_object_unref(src_pixbuf);
+
+  return scaled;
+}
+
+static GdkPixbuf *
+random_pixbuf(GRand *rand, int width, int height, gboolean has_alpha)
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width,
+                                     height);
+  guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+  gsize len = (gsize)gdk_pixbuf_get_rowstride(pixbuf) * height;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    pixels[i] = g_rand_int_range(rand, 0, 256);
+
+  return pixbuf;
+}
+
+static gboolean
+same_pixels(GdkPixbuf *a, GdkPixbuf *b)
+{
+  int width = gdk_pixbuf_get_width(a);
+  int height = gdk_pixbuf_get_height(a);
+  int y;
+
+  if ((width != gdk_pixbuf_get_width(b)) ||
+      (height != gdk_pixbuf_get_height(b)) ||
+      (gdk_pixbuf_get_n_channels(a) != gdk_pixbuf_get_n_channels(b)))
+  {
+    return FALSE;
+  }
+
+  /* rows may be padded differently */
+  for (y = 0; y < height; y++)
+  {
+    if (memcmp(gdk_pixbuf_get_pixels(a) + y * gdk_pixbuf_get_rowstride(a),
+               gdk_pixbuf_get_pixels(b) + y * gdk_pixbuf_get_rowstride(b),
+               width * gdk_pixbuf_get_n_channels(a)))
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean
+check(GdkPixbuf *source, int width, int height, int crop, int border_size)
+{
+  GdkPixbuf *expected = scale_pixbuf_and_crop_old(source, width, height, crop,
+                                                  border_size);
+  GdkPixbuf *actual = _osso_abook_scale_pixbuf_and_crop(source, width, height,
+                                                        crop, border_size);
+  gboolean ok = same_pixels(expected, actual);
+
+  if (!ok)
+  {
+    g_printerr("%dx%d%s to %dx%d, crop %d, border %d: pixels differ\n",
+               gdk_pixbuf_get_width(source), gdk_pixbuf_get_height(source),
+               gdk_pixbuf_get_has_alpha(source) ? " RGBA" : " RGB", width,
+               height, crop, border_size);
+  }
+
+  g_object_unref(actual);
+  g_object_unref(expected);
+
+  return ok;
+}
+
+static void
+benchmark(GRand *rand, int in_w, int in_h, int width, int height)
+{
+  GdkPixbuf *source = random_pixbuf(rand, in_w, in_h, FALSE);
+  gint64 old_time;
+  gint64 new_time;
+  gint64 start;
+  int round;
+
+  start = g_get_monotonic_time();
+
+  for (round = 0; round < BENCHMARK_ROUNDS; round++)
+    g_object_unref(scale_pixbuf_and_crop_old(source, width, height, TRUE, 0));
+
+  old_time = g_get_monotonic_time() - start;
+  start = g_get_monotonic_time();
+
+  for (round = 0; round < BENCHMARK_ROUNDS; round++)
+    g_object_unref(_osso_abook_scale_pixbuf_and_crop(source, width, height,
+                                                     TRUE, 0));
+
+  new_time = g_get_monotonic_time() - start;
+
+  g_print("%4dx%-4d to %3dx%-3d: old %.0f us/call, new %.0f us/call\n",
+          in_w, in_h, width, height,
+          (double)old_time / BENCHMARK_ROUNDS,
+          (double)new_time / BENCHMARK_ROUNDS);
+
+  g_object_unref(source);
+}
+
+int
+main(int argc, char **argv)
+{
+  GRand *rand = g_rand_new_with_seed(0x0abc);
+  gboolean ok = TRUE;
+  guint i;
+  guint j;
+  guint k;
+  int crop;
+  int has_alpha;
+
+  for (i = 0; i < G_N_ELEMENTS(sources); i++)
+  {
+    for (has_alpha = 0; has_alpha <= 1; has_alpha++)
+    {
+      GdkPixbuf *source = random_pixbuf(rand, sources[i][0], sources[i][1],
+                                        has_alpha);
+
+      for (j = 0; j < G_N_ELEMENTS(targets); j++)
+      {
+        for (k = 0; k < G_N_ELEMENTS(borders); k++)
+        {
+          for (crop = 0; crop <= 1; crop++)
+          {
+            ok = check(source, targets[j][0], targets[j][1], crop,
+                       borders[k]) && ok;
+          }
+        }
+      }
+
+      g_object_unref(source);
+    }
+  }
+
+  if (argc > 1 && !strcmp(argv[1], "--benchmark"))
+  {
+    benchmark(rand, 64, 64, 48, 48);
+    benchmark(rand, 144, 144, 64, 64);
+    benchmark(rand, 640, 480, 144, 144);
+    benchmark(rand, 1024, 768, 144, 144);
+  }
+
+  g_rand_free(rand);
+
+  return ok ? 0 : 1;
+}